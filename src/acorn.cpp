@@ -24,7 +24,9 @@ GPLv3 held by author
 #include "oakc_fns.hpp"
 #include "options.hpp"
 #include "tags.hpp"
+#include <algorithm>
 #include <filesystem>
+#include <fstream>
 
 // Dummy wrapper function for updating
 void update()
@@ -80,7 +82,71 @@ void queryPackage(const std::string &name,
     return;
 }
 
-int main(const int argc, const char *argv[])
+// Parses the argument of `-j` or `-b`, which must be positive.
+unsigned int parseCount(const std::string &what,
+                        const std::string &of)
+{
+    int count = 0;
+
+    try
+    {
+        count = std::stoi(what);
+    }
+    catch (std::logic_error &e)
+    {
+        count = 0;
+    }
+
+    if (count <= 0)
+    {
+        throw std::runtime_error("Invalid number of " + of +
+                                 " '" + what + "'");
+    }
+
+    return count;
+}
+
+// Links the objects of a macro compilation into a shared object
+// beside the executable `out`, so that the macro can be called
+// in-process. Failing to do so is not an error, since the
+// executable can still be run.
+void linkMacroObject(const std::string &out,
+                     AcornSettings &settings)
+{
+    std::string soPath =
+        fs::path(out).replace_extension(".so").string();
+
+    std::string command =
+        LINKER + " -shared -Wl,-Bsymbolic -o " + soPath + " ";
+    for (std::string object : settings.objects)
+    {
+        command += object + " ";
+    }
+
+    for (std::string flag : settings.cflags)
+    {
+        command += flag + " ";
+    }
+
+    if (settings.debug)
+    {
+        std::cout << "System call `" << command << "`\n";
+    }
+    else
+    {
+        command += ">/dev/null 2>&1";
+    }
+
+    if (system(command.c_str()) != 0 && settings.debug)
+    {
+        std::cout << "Failed to link shared object; macro "
+                     "will be run as a subprocess.\n";
+    }
+}
+
+// Runs the compiler with the given arguments. Returns the exit
+// status.
+int compile(const int argc, const char *argv[])
 {
     if (argc == 1)
     {
@@ -241,6 +307,56 @@ int main(const int argc, const char *argv[])
                         out = argv[i + 1];
                         i++;
                     }
+                    else if (cur == "--jobs")
+                    {
+                        if (i + 1 >= argc)
+                        {
+                            throw std::runtime_error(
+                                "--jobs must be followed by a "
+                                "number");
+                        }
+
+                        settings.jobs =
+                            parseCount(argv[i + 1], "jobs");
+                        i++;
+                    }
+                    else if (cur == "--units")
+                    {
+                        if (i + 1 >= argc)
+                        {
+                            throw std::runtime_error(
+                                "--units must be followed by a "
+                                "number");
+                        }
+
+                        settings.units =
+                            parseCount(argv[i + 1], "units");
+                        i++;
+                    }
+                    else if (cur == "--trace")
+                    {
+                        if (i + 1 >= argc)
+                        {
+                            throw std::runtime_error(
+                                "--trace must be followed by a "
+                                "filename");
+                        }
+
+                        settings.tracePath = argv[i + 1];
+                        i++;
+                    }
+                    else if (cur == "--memory")
+                    {
+                        if (i + 1 >= argc)
+                        {
+                            throw std::runtime_error(
+                                "--memory must be followed by "
+                                "a filename");
+                        }
+
+                        settings.memoryPath = argv[i + 1];
+                        i++;
+                    }
                     else if (cur == "--prettify")
                     {
                         settings.prettify = !settings.prettify;
@@ -382,6 +498,18 @@ int main(const int argc, const char *argv[])
                             std::atexit(uninstall);
                             exit(0);
 
+                            break;
+                        case 'b':
+                            if (i + 1 >= argc)
+                            {
+                                throw std::runtime_error(
+                                    "-b must be followed by a "
+                                    "number");
+                            }
+
+                            settings.units = parseCount(
+                                argv[i + 1], "units");
+                            i++;
                             break;
                         case 'c':
                             settings.compile = true;
@@ -454,6 +582,18 @@ int main(const int argc, const char *argv[])
                                       << '\n'
                                       << INFO << '\n';
 
+                            break;
+                        case 'j':
+                            if (i + 1 >= argc)
+                            {
+                                throw std::runtime_error(
+                                    "-j must be followed by a "
+                                    "number");
+                            }
+
+                            settings.jobs =
+                                parseCount(argv[i + 1], "jobs");
+                            i++;
                             break;
                         case 'l':
                             settings.noSave = false;
@@ -663,7 +803,29 @@ int main(const int argc, const char *argv[])
             }
         }
 
-        if (!files.empty() && !settings.test)
+        // A build whose manifest shows no changes is skipped
+        std::vector<std::string> args(argv + 1, argv + argc);
+        BuildManifest oldManifest, manifest;
+        bool useManifest =
+            !files.empty() && !settings.test &&
+            settings.compile && !settings.noSave &&
+            !settings.manual;
+        bool isCurrent = false;
+        if (useManifest)
+        {
+            oldManifest = loadManifest(out);
+            manifest.key = getBuildKey(args);
+            isCurrent = isUpToDate(oldManifest, manifest.key);
+
+            if (isCurrent && settings.debug)
+            {
+                std::cout << tags::green_bold << "'" << out
+                          << "' is up to date.\n"
+                          << tags::reset;
+            }
+        }
+
+        if (!files.empty() && !settings.test && !isCurrent)
         {
             // Actual calls
             if (settings.debug)
@@ -673,11 +835,13 @@ int main(const int argc, const char *argv[])
                           << tags::reset;
             }
 
+            beginTrace("File analysis", "phase", settings);
             for (auto f : files)
             {
                 settings.entryPoint = fs::canonical(f);
                 doFile(f, settings);
             }
+            endTrace(settings);
 
             // Reconstruct and save
             if (settings.debug)
@@ -712,8 +876,19 @@ int main(const int argc, const char *argv[])
             auto reconstructionStart =
                 std::chrono::high_resolution_clock::now();
 
-            std::string toCompileFrom =
-                reconstructAndSave(out, settings);
+            beginTrace("Reconstruction", "phase", settings);
+            std::list<std::string> toCompileFrom;
+            if (settings.units > 1)
+            {
+                toCompileFrom = reconstructAndSaveUnits(
+                    out, settings, settings.units);
+            }
+            else
+            {
+                toCompileFrom.push_back(
+                    reconstructAndSave(out, settings));
+            }
+            endTrace(settings);
 
             end = std::chrono::high_resolution_clock::now();
             oakElapsed =
@@ -728,13 +903,19 @@ int main(const int argc, const char *argv[])
 
             if (settings.debug)
             {
-                std::cout << "Output body:   '" << toCompileFrom
-                          << "'\n";
+                for (const auto &file : toCompileFrom)
+                {
+                    std::cout << "Output file:   '" << file
+                              << "'\n";
+                }
             }
 
             if (settings.noSave)
             {
-                fs::remove_all(toCompileFrom);
+                for (const auto &file : toCompileFrom)
+                {
+                    fs::remove_all(file);
+                }
 
                 if (settings.debug)
                 {
@@ -786,19 +967,79 @@ int main(const int argc, const char *argv[])
                     std::string rootCommand =
                         C_COMPILER + " -c ";
 
+                    // Macros are also linked as shared objects
+                    if (settings.isMacroCall)
+                    {
+                        rootCommand += "-fPIC ";
+                    }
+
                     for (std::string flag : settings.cflags)
                     {
                         rootCommand += flag + " ";
                     }
 
-                    std::string command =
-                        rootCommand + toCompileFrom + " -o " +
-                        toCompileFrom + ".o";
+                    // Every unit includes the Oak header and
+                    // the generated headers, so a unit is only
+                    // unchanged if they are too
+                    auto oakHeader =
+                        getFileStamp(OAK_HEADER_PATH);
+                    std::string sharedKey =
+                        std::to_string(oakHeader.first) + ' ' +
+                        std::to_string(oakHeader.second) + '\0';
 
-                    if (settings.debug)
+                    for (const auto &file : toCompileFrom)
+                    {
+                        if (fs::path(file).extension() != ".c")
+                        {
+                            std::ifstream header(file);
+                            std::stringstream contents;
+                            contents << header.rdbuf();
+                            sharedKey += file + '\0' +
+                                         contents.str() + '\0';
+                        }
+                    }
+
+                    // Compile each unit concurrently, skipping
+                    // those which are unchanged since last time
+                    std::vector<std::string> commands;
+                    for (const auto &file : toCompileFrom)
                     {
-                        std::cout << "System call `" << command
-                                  << "`\n";
+                        if (fs::path(file).extension() == ".c")
+                        {
+                            std::string command =
+                                rootCommand + file + " -o " +
+                                file + ".o";
+                            settings.objects.insert(file +
+                                                    ".o");
+
+                            std::ifstream source(file);
+                            std::stringstream contents;
+                            contents << source.rdbuf();
+                            std::string hash =
+                                hashString(command + '\0' +
+                                           sharedKey +
+                                           contents.str());
+                            manifest.sources[file] = hash;
+
+                            auto old =
+                                oldManifest.sources.find(file);
+                            if (old !=
+                                    oldManifest.sources.end() &&
+                                old->second == hash &&
+                                isOutputUnchanged(oldManifest,
+                                                  file + ".o"))
+                            {
+                                if (settings.debug)
+                                {
+                                    std::cout
+                                        << "'" << file
+                                        << "' is unchanged.\n";
+                                }
+                                continue;
+                            }
+
+                            commands.push_back(command);
+                        }
                     }
 
 #if !(defined(LINUX) || defined(__linux__))
@@ -806,17 +1047,54 @@ int main(const int argc, const char *argv[])
                                  "fail on non-POSIX systems!\n";
 #endif
 
-                    if (system(command.c_str()) != 0)
+                    beginTrace("Compile C", "clang", settings);
+                    if (!systemAll(commands, settings))
                     {
                         throw std::runtime_error(
                             "Failed to compile translated C "
                             "files");
                     }
+                    endTrace(settings);
 
-                    settings.objects.insert(toCompileFrom +
-                                            ".o");
+                    for (const auto &file : toCompileFrom)
+                    {
+                        addBuildOutput(manifest, file + ".o");
+                    }
 
-                    if (settings.doLink)
+                    // The final step can be skipped if its
+                    // command and objects are unchanged
+                    std::string linkKey = out + '\0';
+                    for (const auto &object : settings.objects)
+                    {
+                        auto stamp = getFileStamp(object);
+                        linkKey +=
+                            object + '\0' +
+                            std::to_string(stamp.first) + ' ' +
+                            std::to_string(stamp.second) + '\0';
+                    }
+                    manifest.link = hashString(linkKey);
+
+                    std::string soPath =
+                        fs::path(out)
+                            .replace_extension(".so")
+                            .string();
+                    bool isLinked =
+                        manifest.link == oldManifest.link &&
+                        isOutputUnchanged(oldManifest, out) &&
+                        (oldManifest.outputs.count(soPath) ==
+                             0 ||
+                         isOutputUnchanged(oldManifest,
+                                           soPath));
+
+                    if (isLinked)
+                    {
+                        if (settings.debug)
+                        {
+                            std::cout << "'" << out
+                                      << "' is unchanged.\n";
+                        }
+                    }
+                    else if (settings.doLink)
                     {
                         if (settings.debug)
                         {
@@ -851,11 +1129,18 @@ int main(const int argc, const char *argv[])
                                "non-POSIX systems!\n";
 #endif
 
+                        beginTrace("Link", "clang", settings);
                         if (system(command.c_str()) != 0)
                         {
                             throw std::runtime_error(
                                 "Failed to link object files.");
                         }
+                        endTrace(settings);
+
+                        if (settings.isMacroCall)
+                        {
+                            linkMacroObject(out, settings);
+                        }
                     }
                     else
                     {
@@ -891,12 +1176,21 @@ int main(const int argc, const char *argv[])
                                "non-POSIX systems!\n";
 #endif
 
+                        beginTrace("Combine objects", "clang",
+                                   settings);
                         if (system(command.c_str()) != 0)
                         {
                             throw std::runtime_error(
                                 "Failed to combine object "
                                 "files.");
                         }
+                        endTrace(settings);
+                    }
+
+                    addBuildOutput(manifest, out);
+                    if (settings.isMacroCall)
+                    {
+                        addBuildOutput(manifest, soPath);
                     }
                 }
 
@@ -926,10 +1220,22 @@ int main(const int argc, const char *argv[])
 
                 generate(files, manualPath);
             }
+
+            if (useManifest)
+            {
+                addBuildInputs(manifest, args, settings);
+                saveManifest(out, manifest);
+            }
         }
+
+        saveTrace(settings);
+        reportMemory(settings);
     }
     catch (std::runtime_error &e)
     {
+        saveTrace(settings);
+        reportMemory(settings);
+
         if (oakElapsed != 0)
         {
             std::cout << "Elapsed Oak ns: " << oakElapsed;
@@ -942,7 +1248,7 @@ int main(const int argc, const char *argv[])
         if (settings.curLineSymbols.size() != 0)
         {
             std::cout << "\t("
-                      << settings.curLineSymbols.front().file
+                      << settings.curLineSymbols.front().file()
                       << ":"
                       << settings.curLineSymbols.front().line
                       << ")\n";
@@ -969,6 +1275,9 @@ int main(const int argc, const char *argv[])
     }
     catch (...)
     {
+        saveTrace(settings);
+        reportMemory(settings);
+
         if (oakElapsed != 0)
         {
             std::cout << "Elapsed Oak ns: " << oakElapsed;
@@ -1105,6 +1414,12 @@ int main(const int argc, const char *argv[])
             "sequencing         ",
         };
 
+        // Skipped builds never visit a file, so log no phases
+        while (settings.phaseTimes.size() < passNames.size())
+        {
+            settings.phaseTimes.push_back(0);
+        }
+
         // Get total according to this:
         unsigned long long int total = 0;
         for (auto t : settings.phaseTimes)
@@ -1151,6 +1466,56 @@ int main(const int argc, const char *argv[])
                       totalPlusCompilation)
                   << "%\n";
 
+        if (!settings.ruleStats.empty())
+        {
+            std::vector<std::pair<std::string, RuleStats>>
+                ruleStats(settings.ruleStats.begin(),
+                          settings.ruleStats.end());
+            std::stable_sort(ruleStats.begin(), ruleStats.end(),
+                             [](const auto &a, const auto &b) {
+                                 return a.second.attempts >
+                                        b.second.attempts;
+                             });
+
+            std::cout << "Rule attempts / matches:\n";
+            for (const auto &p : ruleStats)
+            {
+                std::cout << std::left << "\t" << std::setw(30)
+                          << p.first << std::right
+                          << std::setw(15) << p.second.attempts
+                          << std::setw(15) << p.second.matches
+                          << '\n';
+            }
+        }
+
+        if (settings.macroCacheHits +
+                settings.macroCacheMisses !=
+            0)
+        {
+            std::cout << "Macro cache hits / misses: "
+                      << settings.macroCacheHits << " / "
+                      << settings.macroCacheMisses << '\n';
+        }
+
+        if (settings.macroMemoHits + settings.macroMemoMisses !=
+            0)
+        {
+            std::cout << "Macro memo hits / misses: "
+                      << settings.macroMemoHits << " / "
+                      << settings.macroMemoMisses << '\n';
+        }
+
+        if (settings.overloadMemoHits +
+                settings.overloadMemoMisses !=
+            0)
+        {
+            std::cout << "Overload memo hits / misses: "
+                      << settings.overloadMemoHits << " / "
+                      << settings.overloadMemoMisses << '\n'
+                      << "Overloads checked on misses: "
+                      << settings.overloadsChecked << '\n';
+        }
+
         std::cout << "Output file: " << out << '\n';
     }
 
@@ -1208,15 +1573,7 @@ int main(const int argc, const char *argv[])
                 return 15;
             }
 
-            int good = 0, bad = 0, result;
-            unsigned long long ms, totalMs = 0;
-            std::chrono::_V2::high_resolution_clock::time_point
-                start,
-                end;
-            std::ifstream file;
-            std::string line;
             std::set<std::string> test_files;
-            std::list<std::string> failed;
 
             // Get all files to run
             fs::create_directory(".oak_build");
@@ -1255,82 +1612,59 @@ int main(const int argc, const char *argv[])
                       << (settings.testFail ? "" : " NOT")
                       << " halting on failure]\n";
 
-            // Iterate through files
-            int i = 1;
+            // Run concurrently, each in its own directory
+            auto suiteStart =
+                std::chrono::high_resolution_clock::now();
+            std::vector<TestResult> results = runTests(
+                std::vector<std::string>(test_files.begin(),
+                                         test_files.end()),
+                settings);
+            unsigned long long wallMs =
+                std::chrono::duration_cast<
+                    std::chrono::milliseconds>(
+                    std::chrono::high_resolution_clock::now() -
+                    suiteStart)
+                    .count();
+
+            saveTestLog(results, "test_suite.tlog");
+            saveTestReport(results, wallMs, "test_suite.json");
+
+            // Gather statistics
+            int good = 0, bad = 0, skipped = 0;
+            unsigned long long totalMs = 0;
             unsigned long long min = -1ull, max = 0ull;
             std::string nameOfMin, nameOfMax;
-            for (auto test : test_files)
+            std::list<std::string> failed;
+            for (const auto &r : results)
             {
-                // Echo the current filename onto the test suite
-                // log
-                system(("echo " + test + " >> test_suite.tlog")
-                           .c_str());
-
-                // Execute the command to test this file, either
-                // in compile or compile+execute mode.
-                start =
-                    std::chrono::high_resolution_clock::now();
-                if (settings.execute)
+                if (r.skipped)
                 {
-                    result = system(
-                        ("acorn -o a.out --execute " + test +
-                         " >> test_suite.tlog 2>&1")
-                            .c_str());
-                }
-                else
-                {
-                    result =
-                        system(("acorn -o /dev/null " + test +
-                                " >> test_suite.tlog 2>&1")
-                                   .c_str());
+                    skipped++;
+                    good++;
+                    continue;
                 }
-                end = std::chrono::high_resolution_clock::now();
-                ms = std::chrono::duration_cast<
-                         std::chrono::milliseconds>(end - start)
-                         .count();
-
-                // Update statistics
-                totalMs += ms;
-                if (ms < min)
+
+                totalMs += r.wallMs;
+                if (r.wallMs < min)
                 {
-                    nameOfMin = test;
-                    min = ms;
+                    nameOfMin = r.file;
+                    min = r.wallMs;
                 }
-                if (ms > max)
+                if (r.wallMs > max)
                 {
-                    nameOfMax = test;
-                    max = ms;
+                    nameOfMax = r.file;
+                    max = r.wallMs;
                 }
 
-                // Update user on results of this test
-                std::cout
-                    << "[" << i << "/" << test_files.size()
-                    << "]\t["
-                    << (result == 0 ? tags::green : tags::red)
-                    << std::left << std::setw(4) << result
-                    << tags::reset << "]" << std::right
-                    << std::setw(8) << ms << " ms\t"
-                    << std::left << test << "\n";
-
-                // Update other statistics
-                if (result == 0)
+                if (r.result == 0)
                 {
                     good++;
                 }
                 else
                 {
-                    failed.push_back(test);
+                    failed.push_back(r.file);
                     bad++;
-
-                    // If using the `-TT` flag, cease testing
-                    // here.
-                    if (settings.testFail)
-                    {
-                        break;
-                    }
                 }
-
-                i++;
             }
 
             // Print number of passed tests
@@ -1342,6 +1676,13 @@ int main(const int argc, const char *argv[])
                           << "%)" << '\n';
             }
 
+            // Print number of skipped tests
+            if (skipped != 0)
+            {
+                std::cout << tags::green_bold << "Unchanged:\t"
+                          << skipped << '\n';
+            }
+
             // Print number of failed tests
             if (bad != 0)
             {
@@ -1355,13 +1696,19 @@ int main(const int argc, const char *argv[])
             std::cout << tags::reset << "Total:\t\t"
                       << good + bad << '\n'
                       << "ms:\t\t" << totalMs << '\n'
-                      << "min:\t\t" << min << "\t" << nameOfMin
-                      << " ms\n"
-                      << "max:\t\t" << max << " \t" << nameOfMax
-                      << " ms\n"
-                      << "mean test ms:\t"
-                      << (totalMs) / (double)(good + bad)
-                      << '\n';
+                      << "wall ms:\t" << wallMs << '\n';
+
+            if (good + bad > skipped)
+            {
+                std::cout << "min:\t\t" << min << "\t"
+                          << nameOfMin << " ms\n"
+                          << "max:\t\t" << max << " \t"
+                          << nameOfMax << " ms\n"
+                          << "mean test ms:\t"
+                          << totalMs /
+                                 (double)(good + bad - skipped)
+                          << '\n';
+            }
 
             if (bad != 0)
             {
@@ -1375,7 +1722,8 @@ int main(const int argc, const char *argv[])
             }
 
             std::cout
-                << "\nAny output is in ./test_suite.tlog.\n";
+                << "\nAny output is in ./test_suite.tlog.\n"
+                << "Timings are in ./test_suite.json.\n";
 
             // Check for ansi2txt
             if (system("ansi2txt < /dev/null") == 0)
@@ -1428,3 +1776,29 @@ int main(const int argc, const char *argv[])
 
     return 0;
 }
+
+int main(const int argc, const char *argv[])
+{
+    const std::string mode = argc > 1 ? argv[1] : "";
+
+    if (mode == "--server")
+    {
+        return serveCompiles(getServerSocketPath(), compile);
+    }
+    else if (mode == "--client")
+    {
+        // Compiles in a fork of the server's warm state, or
+        // here if there is no server
+        int status = requestCompile(
+            getServerSocketPath(),
+            std::vector<std::string>(argv + 2, argv + argc));
+        if (status >= 0)
+        {
+            return status;
+        }
+
+        return compile(argc - 1, argv + 1);
+    }
+
+    return compile(argc, argv);
+}
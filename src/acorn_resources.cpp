@@ -31,6 +31,306 @@ void getDiskUsage()
     return;
 }
 
+// Removes any quotes around each of the given macro arguments
+static void unquoteMacroArgs(std::list<std::string> &args)
+{
+    for (auto it = args.begin(); it != args.end(); it++)
+    {
+        while (!it->empty() &&
+               (it->front() == '"' || it->front() == '\''))
+        {
+            it->erase(0, 1);
+        }
+        while (!it->empty() &&
+               (it->back() == '"' || it->back() == '\''))
+        {
+            it->pop_back();
+        }
+    }
+}
+
+// Expands the compiler macro call at `it`, erasing it from
+// `lexed` and leaving `it` at the token after it. Returns false
+// (changing nothing) if `it` is not a compiler macro.
+static bool doCompilerMacro(TokenList &lexed,
+                            TokenList::iterator &it,
+                            AcornSettings &settings)
+{
+    // File handling / translation unit macros
+    if (*it == "include!")
+    {
+        if (settings.debug)
+        {
+            std::cout << settings.debugTreePrefix
+                      << "`include!`\n";
+        }
+
+        std::list<std::string> args = getMacroArgs(lexed, it);
+        unquoteMacroArgs(args);
+
+        for (std::string a : args)
+        {
+            auto base = settings.curFile.parent_path();
+
+            // If local, do that
+            if (fs::exists(base / a))
+            {
+                if (fs::exists(OAK_DIR_PATH + a) &&
+                    settings.visitedFiles.count(OAK_DIR_PATH +
+                                                a) == 0 &&
+                    settings.visitedFiles.count(a) == 0)
+                {
+                    std::cout << tags::yellow_bold
+                              << "Warning: Including '"
+                              << base / a
+                              << "' over package file '"
+                              << OAK_DIR_PATH << a << "'.\n"
+                              << tags::reset;
+                }
+
+                doFile(base / a, settings);
+            }
+
+            // Else, look in OAK_DIR_PATH, unless a compile
+            // server already has the result
+            else if (!loadIncludeState(OAK_DIR_PATH + a,
+                                       settings))
+            {
+                doFile(OAK_DIR_PATH + a, settings);
+            }
+        }
+    }
+    else if (*it == "tag!")
+    {
+        if (settings.debug)
+        {
+            std::cout << settings.debugTreePrefix
+                      << "`tag!`\n";
+        }
+
+        std::list<std::string> args = getMacroArgs(lexed, it);
+
+        if (args.size() == 1)
+        {
+            std::string name = cleanMacroArgument(args.front());
+
+            if (settings.file_tags[settings.curFile].count(
+                    name) == 0)
+            {
+                settings.file_tags[settings.curFile][name] = "";
+            }
+        }
+        else if (args.size() == 2)
+        {
+            std::string name = cleanMacroArgument(args.front());
+            args.pop_front();
+
+            settings.file_tags[settings.curFile][name] =
+                cleanMacroArgument(args.front());
+        }
+        else
+        {
+            throw sequencing_error(
+                "Compiler macro `tag!` must "
+                "take one or two arguments:"
+                "The tag, and optionally a "
+                "value.");
+        }
+    }
+    else if (*it == "link!")
+    {
+        if (settings.debug)
+        {
+            std::cout << settings.debugTreePrefix
+                      << "`link!`\n";
+        }
+
+        std::list<std::string> args = getMacroArgs(lexed, it);
+
+        // Clean arguments
+        for (auto it = args.begin(); it != args.end(); it++)
+        {
+            *it = cleanMacroArgument(*it);
+        }
+
+        for (std::string a : args)
+        {
+            if (settings.debug)
+            {
+                std::cout << settings.debugTreePrefix
+                          << "Inserting object " << a << '\n';
+            }
+
+            if (fs::exists(a) || a[0] == '-')
+            {
+                if (fs::exists(OAK_DIR_PATH + a))
+                {
+                    std::cout << tags::yellow_bold
+                              << "Warning: Including local "
+                                 "file '"
+                              << a
+                              << "' over package file of same "
+                                 "name.\n"
+                              << tags::reset;
+                }
+
+                settings.objects.insert(a);
+            }
+            else
+            {
+                settings.objects.insert(OAK_DIR_PATH + a);
+            }
+        }
+    }
+    else if (*it == "flag!")
+    {
+        if (settings.debug)
+        {
+            std::cout << settings.debugTreePrefix
+                      << "`flag!`\n";
+        }
+
+        std::list<std::string> args = getMacroArgs(lexed, it);
+        unquoteMacroArgs(args);
+
+        for (std::string a : args)
+        {
+            if (settings.debug)
+            {
+                std::cout << settings.debugTreePrefix
+                          << "Appending flag " << a << '\n';
+            }
+
+            settings.cflags.insert(a);
+        }
+    }
+    else if (*it == "package!")
+    {
+        if (settings.debug)
+        {
+            std::cout << settings.debugTreePrefix
+                      << "`package!`\n";
+        }
+
+        std::list<std::string> args = getMacroArgs(lexed, it);
+        unquoteMacroArgs(args);
+
+        // Backup dialect rules; These do NOT
+        std::vector<std::string> backupDialectRules =
+            settings.dialectRules;
+        settings.dialectRules.clear();
+
+        for (std::string a : args)
+        {
+            loadPackage(a, settings);
+        }
+
+        settings.dialectRules = backupDialectRules;
+    }
+    else
+    {
+        return false;
+    }
+
+    return true;
+}
+
+/*
+Expands the compiler macro calls at the given positions, which
+must be in order. This is the worklist used once the first scan
+of a file is over: rules may output new calls, but these are the
+only places which need revisiting. A call's arguments are erased
+along with it, so any later positions within them are skipped.
+*/
+static void expandCompilerMacros(
+    TokenList &lexed,
+    const std::vector<TokenList::iterator> &worklist,
+    AcornSettings &settings)
+{
+    size_t next = 0;
+    while (next < worklist.size())
+    {
+        auto it = worklist[next++];
+        if (!itCmp(lexed, it, 1, "("))
+        {
+            continue;
+        }
+
+        for (auto arg = std::next(it);
+             arg != lexed.end() && *arg != ";"; arg++)
+        {
+            if (next < worklist.size() && arg == worklist[next])
+            {
+                next++;
+            }
+        }
+
+        doCompilerMacro(lexed, it, settings);
+    }
+}
+
+void insertDefinitions(TokenList &lexed,
+                       AcornSettings &settings)
+{
+    Lexer dfa_lexer;
+
+    // Each definition is only lexed once. `line!` differs at
+    // each use, so is never cached.
+    std::map<std::string, TokenList> lexedDefs;
+    unsigned int line = 0;
+    bool isVisited = false;
+
+    for (auto it = lexed.begin(); it != lexed.end(); it++)
+    {
+        line = it->line;
+        isVisited = true;
+
+        if (*it == "line!")
+        {
+            TokenList lexedDef =
+                dfa_lexer.lex_list(std::to_string(line));
+            it = lexed.erase(it);
+            it = lexed.insert(it, lexedDef.begin(),
+                              lexedDef.end());
+            it--;
+            continue;
+        }
+
+        auto def = settings.preprocDefines.find(*it);
+        if (def != settings.preprocDefines.end())
+        {
+            auto cached = lexedDefs.find(def->first);
+            if (cached == lexedDefs.end())
+            {
+                cached = lexedDefs
+                             .emplace(def->first,
+                                      dfa_lexer.lex_list(
+                                          def->second))
+                             .first;
+            }
+
+            it = lexed.erase(it);
+            it = lexed.insert(it, cached->second.begin(),
+                              cached->second.end());
+
+            it--;
+        }
+        else if (it->size() > 1 && it->back() == '!' &&
+                 !itCmp(lexed, it, 1, "("))
+        {
+            throw sequencing_error(
+                "Unknown preprocessor definition '" + it->text +
+                "'");
+        }
+    }
+
+    // As though it had been set at each token
+    if (isVisited)
+    {
+        settings.preprocDefines["line!"] = std::to_string(line);
+    }
+}
+
 void doFile(const std::string &From, AcornSettings &settings)
 {
     if (settings.debug)
@@ -58,7 +358,7 @@ void doFile(const std::string &From, AcornSettings &settings)
     settings.curLine = 1;
     settings.curFile = fs::canonical(From);
 
-    std::list<Token> lexed, lexedCopy;
+    TokenList lexed, lexedCopy;
 
     try
     {
@@ -105,6 +405,7 @@ void doFile(const std::string &From, AcornSettings &settings)
         }
 
         settings.visitedFiles[fs::canonical(From)] = 0;
+        TraceSpan fileSpan(From, "file", settings);
 
         if (settings.debug)
         {
@@ -114,8 +415,12 @@ void doFile(const std::string &From, AcornSettings &settings)
         }
 
         // A: Load file
-        std::ifstream file(From, std::ios::in | std::ios::ate);
-        if (!file.is_open())
+        std::string_view text;
+        try
+        {
+            text = load_source(From);
+        }
+        catch (std::runtime_error &e)
         {
             settings.curFile = oldFile;
             settings.curLine = oldLineNum;
@@ -123,26 +428,6 @@ void doFile(const std::string &From, AcornSettings &settings)
                 "Could not open source file '" + From + "'");
         }
 
-        long long size = file.tellg();
-
-        file.clear();
-        file.seekg(0, std::ios::beg);
-
-        size -= file.tellg();
-
-        std::string text, line;
-
-        text.reserve(size);
-        line.reserve(64);
-
-        while (getline(file, line))
-        {
-            text.append(line);
-            text.push_back('\n');
-        }
-
-        file.close();
-
         // B: Syntax check
 
         if (settings.debug)
@@ -152,11 +437,13 @@ void doFile(const std::string &From, AcornSettings &settings)
             start = std::chrono::high_resolution_clock::now();
         }
 
+        beginTrace("Syntax check", "phase", settings);
         if (!(settings.ignoreSyntaxErrors ||
               settings.isMacroCall))
         {
             ensureSyntax(text, true, settings.curFile);
         }
+        endTrace(settings);
 
         if (settings.debug)
         {
@@ -176,9 +463,16 @@ void doFile(const std::string &From, AcornSettings &settings)
             start = std::chrono::high_resolution_clock::now();
         }
 
+        beginTrace("Lexing", "phase", settings);
         Lexer dfa_lexer;
         lexed = dfa_lexer.lex_list(text, From);
         lexedCopy = lexed;
+        endTrace(settings);
+
+        if (settings.memoryPath != "")
+        {
+            settings.fileMemory[From].tokens = lexed.size();
+        }
 
         if (settings.debug)
         {
@@ -200,6 +494,7 @@ void doFile(const std::string &From, AcornSettings &settings)
             start = std::chrono::high_resolution_clock::now();
         }
 
+        beginTrace("Macro definitions", "phase", settings);
         auto it = lexed.begin();
         it++;
 
@@ -292,7 +587,11 @@ void doFile(const std::string &From, AcornSettings &settings)
             curPhase++;
         }
 
+        endTrace(settings);
+
         // Preprocessor definition finding
+        beginTrace("Preprocessor definitions", "phase",
+                   settings);
         for (auto it = ++lexed.begin(); ++it != lexed.end();)
         {
             if (it->back() == '!' && *it != "!" &&
@@ -352,7 +651,17 @@ void doFile(const std::string &From, AcornSettings &settings)
             }
         }
 
-        bool compilerMacrosLeft;
+        endTrace(settings);
+
+        /*
+        The whole file is scanned for compiler macros once, then
+        rules are done. Rules may output more compiler macro
+        calls, in which case only these are revisited. Since
+        compiler macros only ever erase, rules need only be done
+        again if an included file changed which are active.
+        */
+        std::vector<TokenList::iterator> worklist;
+        bool isFirstScan = true;
         int compilerMacroPos = curPhase;
         do
         {
@@ -367,344 +676,67 @@ void doFile(const std::string &From, AcornSettings &settings)
                     std::chrono::high_resolution_clock::now();
             }
 
-            for (auto it = lexed.begin(); it != lexed.end();
-                 it++)
+            const std::vector<std::string> rulesBefore =
+                settings.activeRules;
+
+            beginTrace("Compiler macros", "phase", settings);
+            if (isFirstScan)
             {
-                if (*it != "!" && it->back() == '!' &&
-                    itCmp(lexed, it, 1, "("))
+                for (auto it = lexed.begin(); it != lexed.end();
+                     it++)
                 {
-                    // File handling / translation unit macros
-                    if (*it == "include!")
+                    if (*it == "!" || it->back() != '!' ||
+                        !itCmp(lexed, it, 1, "("))
                     {
-                        if (settings.debug)
-                        {
-                            std::cout
-                                << settings.debugTreePrefix
-                                << "`include!`\n";
-                        }
-
-                        std::list<std::string> args =
-                            getMacroArgs(lexed, it);
-
-                        // Clean arguments
-                        for (auto it = args.begin();
-                             it != args.end(); it++)
-                        {
-                            while (!it->empty() &&
-                                   (it->front() == '"' ||
-                                    it->front() == '\''))
-                            {
-                                it->erase(0, 1);
-                            }
-                            while (!it->empty() &&
-                                   (it->back() == '"' ||
-                                    it->back() == '\''))
-                            {
-                                it->pop_back();
-                            }
-                        }
-
-                        for (std::string a : args)
-                        {
-                            auto base =
-                                settings.curFile.parent_path();
-
-                            // If local, do that
-                            if (fs::exists(base / a))
-                            {
-                                if (fs::exists(OAK_DIR_PATH +
-                                               a) &&
-                                    settings.visitedFiles.count(
-                                        OAK_DIR_PATH + a) ==
-                                        0 &&
-                                    settings.visitedFiles.count(
-                                        a) == 0)
-                                {
-                                    std::cout
-                                        << tags::yellow_bold
-                                        << "Warning: Including "
-                                           "'"
-                                        << base / a
-                                        << "' over package "
-                                           "file '"
-                                        << OAK_DIR_PATH << a
-                                        << "'.\n"
-                                        << tags::reset;
-                                }
-
-                                doFile(base / a, settings);
-                            }
-
-                            // Else, look in OAK_DIR_PATH
-                            else
-                            {
-                                doFile(OAK_DIR_PATH + a,
-                                       settings);
-                            }
-                        }
-
-                        it--;
+                        continue;
                     }
-                    else if (*it == "tag!")
-                    {
-                        if (settings.debug)
-                        {
-                            std::cout
-                                << settings.debugTreePrefix
-                                << "`tag!`\n";
-                        }
-
-                        std::list<std::string> args =
-                            getMacroArgs(lexed, it);
 
-                        if (args.size() == 1)
-                        {
-                            std::string name =
-                                cleanMacroArgument(
-                                    args.front());
-
-                            if (settings
-                                    .file_tags[settings.curFile]
-                                    .count(name) == 0)
-                            {
-                                settings
-                                    .file_tags[settings.curFile]
-                                              [name] = "";
-                            }
-                        }
-                        else if (args.size() == 2)
-                        {
-                            std::string name =
-                                cleanMacroArgument(
-                                    args.front());
-                            args.pop_front();
-
-                            settings.file_tags[settings.curFile]
-                                              [name] =
-                                cleanMacroArgument(
-                                    args.front());
-                        }
-                        else
-                        {
-                            throw sequencing_error(
-                                "Compiler macro `tag!` must "
-                                "take one or two arguments:"
-                                "The tag, and optionally a "
-                                "value.");
-                        }
-
-                        it--;
-                    }
-                    else if (*it == "link!")
+                    if (doCompilerMacro(lexed, it, settings))
                     {
-                        if (settings.debug)
-                        {
-                            std::cout
-                                << settings.debugTreePrefix
-                                << "`link!`\n";
-                        }
-
-                        std::list<std::string> args =
-                            getMacroArgs(lexed, it);
-
-                        // Clean arguments
-                        for (auto it = args.begin();
-                             it != args.end(); it++)
-                        {
-                            *it = cleanMacroArgument(*it);
-                        }
-
-                        for (std::string a : args)
-                        {
-                            if (settings.debug)
-                            {
-                                std::cout
-                                    << settings.debugTreePrefix
-                                    << "Inserting object " << a
-                                    << '\n';
-                            }
-
-                            if (fs::exists(a) || a[0] == '-')
-                            {
-                                if (fs::exists(OAK_DIR_PATH +
-                                               a))
-                                {
-                                    std::cout
-                                        << tags::yellow_bold
-                                        << "Warning: Including "
-                                           "local file '"
-                                        << a
-                                        << "' over package "
-                                           "file of same "
-                                           "name.\n"
-                                        << tags::reset;
-                                }
-
-                                settings.objects.insert(a);
-                            }
-                            else
-                            {
-                                settings.objects.insert(
-                                    OAK_DIR_PATH + a);
-                            }
-                        }
                         it--;
                     }
-                    else if (*it == "flag!")
-                    {
-                        if (settings.debug)
-                        {
-                            std::cout
-                                << settings.debugTreePrefix
-                                << "`flag!`\n";
-                        }
 
-                        std::list<std::string> args =
-                            getMacroArgs(lexed, it);
-
-                        // Clean arguments
-                        for (auto it = args.begin();
-                             it != args.end(); it++)
-                        {
-                            while (!it->empty() &&
-                                   (it->front() == '"' ||
-                                    it->front() == '\''))
-                            {
-                                it->erase(0, 1);
-                            }
-                            while (!it->empty() &&
-                                   (it->back() == '"' ||
-                                    it->back() == '\''))
-                            {
-                                it->pop_back();
-                            }
-                        }
-
-                        for (std::string a : args)
-                        {
-                            if (settings.debug)
-                            {
-                                std::cout
-                                    << settings.debugTreePrefix
-                                    << "Appending flag " << a
-                                    << '\n';
-                            }
-
-                            settings.cflags.insert(a);
-                        }
-                        it--;
-                    }
-                    else if (*it == "package!")
+                    // Non-compiler macro definition
+                    // Nested stuff may be allowed within
+                    else if (it != lexed.begin() &&
+                             itCmp(lexed, it, -1, "let"))
                     {
-                        if (settings.debug)
+                        while (it != lexed.end() &&
+                               *it != "{" && *it != ";")
                         {
-                            std::cout
-                                << settings.debugTreePrefix
-                                << "`package!`\n";
+                            it++;
                         }
 
-                        std::list<std::string> args =
-                            getMacroArgs(lexed, it);
-                        std::list<std::string> files;
-
-                        // Clean arguments
-                        for (auto it = args.begin();
-                             it != args.end(); it++)
+                        if (*it == ";")
                         {
-                            while (!it->empty() &&
-                                   (it->front() == '"' ||
-                                    it->front() == '\''))
-                            {
-                                it->erase(0, 1);
-                            }
-                            while (!it->empty() &&
-                                   (it->back() == '"' ||
-                                    it->back() == '\''))
-                            {
-                                it->pop_back();
-                            }
+                            it++;
                         }
-
-                        // Backup dialect rules; These do NOT
-                        std::vector<std::string>
-                            backupDialectRules =
-                                settings.dialectRules;
-                        settings.dialectRules.clear();
-
-                        for (std::string a : args)
+                        else
                         {
-                            files =
-                                getPackageFiles(a, settings);
+                            int count = 1;
+                            it++;
 
-                            for (std::string f : files)
+                            while (count != 0)
                             {
-                                if (settings.debug)
+                                if (*it == "{")
                                 {
-                                    std::cout
-                                        << settings
-                                               .debugTreePrefix
-                                        << "Loading package "
-                                           "file '"
-                                        << f << "'...\n";
+                                    count++;
                                 }
-
-                                // Backup dialect rules
-                                std::vector<std::string>
-                                    backupDialectRules =
-                                        settings.dialectRules;
-                                settings.dialectRules.clear();
-
-                                doFile(f, settings);
-
-                                settings.dialectRules =
-                                    backupDialectRules;
-                            }
-                        }
-                        it--;
-
-                        settings.dialectRules =
-                            backupDialectRules;
-                    }
-                    else
-                    {
-                        // Non-compiler macro definition
-                        // Nested stuff may be allowed within
-                        if (it != lexed.begin() &&
-                            itCmp(lexed, it, -1, "let"))
-                        {
-                            while (it != lexed.end() &&
-                                   *it != "{" && *it != ";")
-                            {
-                                it++;
-                            }
-
-                            if (*it == ";")
-                            {
-                                it++;
-                            }
-                            else
-                            {
-                                int count = 1;
-                                it++;
-
-                                while (count != 0)
+                                else if (*it == "}")
                                 {
-                                    if (*it == "{")
-                                    {
-                                        count++;
-                                    }
-                                    else if (*it == "}")
-                                    {
-                                        count--;
-                                    }
-
-                                    it++;
+                                    count--;
                                 }
+
+                                it++;
                             }
                         }
                     }
                 }
             }
+            else
+            {
+                expandCompilerMacros(lexed, worklist, settings);
+            }
 
             if (settings.debug)
             {
@@ -735,7 +767,17 @@ void doFile(const std::string &From, AcornSettings &settings)
                     std::chrono::high_resolution_clock::now();
             }
 
-            doRules(lexed, settings);
+            endTrace(settings);
+
+            // Rules report any compiler macros they output
+            worklist.clear();
+            if (isFirstScan ||
+                settings.activeRules != rulesBefore)
+            {
+                beginTrace("Rules", "phase", settings);
+                doRules(lexed, settings, &worklist);
+                endTrace(settings);
+            }
 
             if (settings.debug)
             {
@@ -746,17 +788,8 @@ void doFile(const std::string &From, AcornSettings &settings)
                         .count();
             }
 
-            // Update compilerMacrosLeft
-            compilerMacrosLeft = false;
-            for (const auto &item : lexed)
-            {
-                if (COMPILER_MACROS.count(item) != 0)
-                {
-                    compilerMacrosLeft = true;
-                    break;
-                }
-            }
-        } while (compilerMacrosLeft);
+            isFirstScan = false;
+        } while (!worklist.empty());
         curPhase = compilerMacroPos + 2;
 
         // G: Scan for macro calls and handle them
@@ -767,6 +800,24 @@ void doFile(const std::string &From, AcornSettings &settings)
             start = std::chrono::high_resolution_clock::now();
         }
 
+        // Build every macro this file calls up front, so that
+        // they can be compiled concurrently
+        beginTrace("Macro calls", "phase", settings);
+        std::set<std::string> calledMacros;
+        for (const auto &item : lexed)
+        {
+            if (settings.compiled.count(item.text) == 0 &&
+                hasMacro(item.text, settings))
+            {
+                calledMacros.insert(item.text);
+            }
+        }
+
+        if (!calledMacros.empty())
+        {
+            compileMacros(calledMacros, settings);
+        }
+
         for (auto it = lexed.begin(); it != lexed.end(); it++)
         {
             // We can assume that no macro definitions remain
@@ -797,7 +848,7 @@ void doFile(const std::string &From, AcornSettings &settings)
 
                 std::string output =
                     callMacro(name, args, settings);
-                std::list<Token> lexedOutput =
+                TokenList lexedOutput =
                     dfa_lexer.lex_list(output, name);
 
                 // Reset preproc defs, as they tend to break w/
@@ -817,6 +868,7 @@ void doFile(const std::string &From, AcornSettings &settings)
                 // be scanned next.
             }
         }
+        endTrace(settings);
 
         if (settings.debug)
         {
@@ -860,29 +912,9 @@ void doFile(const std::string &From, AcornSettings &settings)
             start = std::chrono::high_resolution_clock::now();
         }
 
-        for (auto it = lexed.begin(); it != lexed.end(); it++)
-        {
-            settings.preprocDefines["line!"] =
-                std::to_string(it->line);
-            if (settings.preprocDefines.count(*it) != 0)
-            {
-                std::list<Token> lexedDef = dfa_lexer.lex_list(
-                    settings.preprocDefines[*it]);
-                it = lexed.erase(it);
-
-                it = lexed.insert(it, lexedDef.begin(),
-                                  lexedDef.end());
-
-                it--;
-            }
-            else if (it->size() > 1 && it->back() == '!' &&
-                     !itCmp(lexed, it, 1, "("))
-            {
-                throw sequencing_error(
-                    "Unknown preprocessor definition '" +
-                    it->text + "'");
-            }
-        }
+        beginTrace("Preprocessor insertion", "phase",
+                   settings);
+        insertDefinitions(lexed, settings);
 
         // Clean out any C keywords
         for (auto it = lexed.begin(); it != lexed.end(); it++)
@@ -896,6 +928,7 @@ void doFile(const std::string &From, AcornSettings &settings)
                 it->text += "__KWA";
             }
         }
+        endTrace(settings);
 
         if (settings.debug)
         {
@@ -916,7 +949,10 @@ void doFile(const std::string &From, AcornSettings &settings)
             start = std::chrono::high_resolution_clock::now();
         }
 
+        beginTrace("Operator substitution", "phase",
+                   settings);
         operatorSub(lexed);
+        endTrace(settings);
 
         if (settings.debug)
         {
@@ -936,7 +972,15 @@ void doFile(const std::string &From, AcornSettings &settings)
             start = std::chrono::high_resolution_clock::now();
         }
 
+        beginTrace("Sequencing", "phase", settings);
         ASTNode fileSeq = createSequence(lexed, settings);
+        endTrace(settings);
+
+        if (settings.memoryPath != "")
+        {
+            settings.fileMemory[From].nodes =
+                countNodes(fileSeq);
+        }
 
         if (settings.debug)
         {
@@ -952,7 +996,7 @@ void doFile(const std::string &From, AcornSettings &settings)
         {
             std::cout << tags::yellow_bold << "Warning: File '"
                       << From << "' has hanging type '"
-                      << toStr(&fileSeq.type) << "'\n"
+                      << toStr(&fileSeq.type.get()) << "'\n"
                       << tags::reset;
         }
 
@@ -1242,8 +1286,8 @@ void printSyntaxError(const std::string &what,
     return;
 }
 
-void ensureSyntax(const std::string &text, const bool &fatal,
-                  const std::string &curFile)
+void ensureSyntax(const std::string_view &text,
+                  const bool &fatal, const std::string &curFile)
 {
     std::vector<char> curLineVec;
     curLineVec.reserve(96);
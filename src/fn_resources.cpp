@@ -14,16 +14,28 @@ GPLv3 held by author
 #include "oakc_structs.hpp"
 #include "options.hpp"
 #include "tags.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <condition_variable>
+#include <cstdlib>
+#include <mutex>
 #include <stdexcept>
 #include <string>
+#include <thread>
+#include <sys/wait.h>
 #include <unistd.h>
 
+#if (defined(LINUX) || defined(__linux__))
+#include <dlfcn.h>
+#endif
+
 // Returns true if and only if (it + offset) == compareTo.
 // Runs in O(offset), unfortunately, so only use for small
 // offsets. If it is too close to the beginning or end of
 // `inside`, will return false,
-bool itCmp(const std::list<Token> &inside,
-           const std::list<Token>::iterator &it,
+bool itCmp(const TokenList &inside,
+           const TokenList::iterator &it,
            const int &offset, const Token &compareTo) noexcept
 {
     auto temp = it;
@@ -56,16 +68,16 @@ bool itCmp(const std::list<Token> &inside,
     return *temp == compareTo;
 }
 
-bool itCmp(const std::list<Token> &inside,
-           const std::list<Token>::iterator &it,
+bool itCmp(const TokenList &inside,
+           const TokenList::iterator &it,
            const int &offset,
            const std::string &compareTo) noexcept
 {
     return itCmp(inside, it, offset, Token(compareTo));
 }
 
-bool itCmp(const std::list<Token> &inside,
-           const std::list<Token>::const_iterator &it,
+bool itCmp(const TokenList &inside,
+           const TokenList::const_iterator &it,
            const int &offset,
            const std::string &compareTo) noexcept
 {
@@ -100,8 +112,8 @@ bool itCmp(const std::list<Token> &inside,
 }
 
 // Returns true if the given iterator is in range.
-bool itIsInRange(const std::list<Token> &inside,
-                 const std::list<Token>::iterator &it,
+bool itIsInRange(const TokenList &inside,
+                 const TokenList::iterator &it,
                  const int &offset) noexcept
 {
     auto temp = it;
@@ -141,8 +153,8 @@ bool itIsInRange(const std::list<Token> &inside,
 
 // Returns the token at the given offset, or a null token if
 // it is out of range.
-Token itGet(const std::list<Token> &inside,
-            const std::list<Token>::iterator &it,
+Token itGet(const TokenList &inside,
+            const TokenList::iterator &it,
             const int &offset) noexcept
 {
     auto temp = it;
@@ -222,6 +234,72 @@ std::string execute(const std::string &command)
     return output;
 }
 
+unsigned int getJobCount(const AcornSettings &settings)
+{
+    if (settings.jobs != 0)
+    {
+        return settings.jobs;
+    }
+
+    return std::max(1u, std::thread::hardware_concurrency());
+}
+
+bool systemAll(const std::vector<std::string> &commands,
+               AcornSettings &settings)
+{
+    std::atomic<size_t> next(0);
+    std::atomic<bool> succeeded(true);
+
+    // When each command started and ended, and on which worker
+    std::vector<unsigned long long> starts(commands.size()),
+        ends(commands.size());
+    std::vector<unsigned int> lanes(commands.size());
+
+    auto worker = [&](const unsigned int lane)
+    {
+        for (size_t i = next++; i < commands.size(); i = next++)
+        {
+            if (settings.debug)
+            {
+                std::cout << "System call `" + commands[i] +
+                                 "`\n";
+            }
+
+            starts[i] = getTraceTime(settings);
+            if (system(commands[i].c_str()) != 0)
+            {
+                succeeded = false;
+            }
+            ends[i] = getTraceTime(settings);
+            lanes[i] = lane;
+        }
+    };
+
+    size_t jobs = std::min<size_t>(getJobCount(settings),
+                                   commands.size());
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < jobs; i++)
+    {
+        workers.emplace_back(worker, i);
+    }
+
+    // This thread is a worker too
+    worker(0);
+
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+
+    for (size_t i = 0; i < commands.size(); i++)
+    {
+        addTrace(commands[i], "clang", starts[i], ends[i],
+                 lanes[i], settings);
+    }
+
+    return succeeded;
+}
+
 void generate(const std::list<std::string> &Files,
               const std::string &Output)
 {
@@ -260,23 +338,16 @@ void generate(const std::list<std::string> &Files,
 
         std::map<std::string, std::string> data;
         std::vector<std::string> lines;
-        std::string line;
 
-        // Load file
-        std::ifstream file(fileName);
-        if (!file.is_open())
+        // Load file; Every line ends in a newline
+        const std::string_view text = load_source(fileName);
+        for (size_t start = 0; start < text.size();)
         {
-            throw std::runtime_error("Failed to open file '" +
-                                     fileName + "'");
+            const size_t end = text.find('\n', start);
+            lines.emplace_back(text.substr(start, end - start));
+            start = end + 1;
         }
 
-        while (getline(file, line))
-        {
-            lines.push_back(line);
-        }
-
-        file.close();
-
         // Scan and build data
         std::string mostRecentComment = "";
         for (int i = 0; i < lines.size(); i++)
@@ -420,6 +491,39 @@ long long getFileLastModification(const std::string &filepath,
     return out;
 }
 
+std::pair<long long, unsigned long long> getFileStamp(
+    const std::string &path)
+{
+    std::error_code ec;
+    auto time = fs::last_write_time(path, ec);
+    if (ec)
+    {
+        return {0, 0};
+    }
+
+    auto size = fs::file_size(path, ec);
+    if (ec)
+    {
+        return {0, 0};
+    }
+
+    return {time.time_since_epoch().count(), size};
+}
+
+long long getCompilerStamp()
+{
+#if (defined(LINUX) || defined(__linux__))
+    std::error_code ec;
+    auto time = fs::last_write_time("/proc/self/exe", ec);
+    if (!ec)
+    {
+        return time.time_since_epoch().count();
+    }
+#endif
+
+    return 0;
+}
+
 // Returns true if the source file is newer than the destination
 // one OR if either file is nonexistant
 bool isSourceNewer(const std::string &source,
@@ -438,8 +542,143 @@ bool isSourceNewer(const std::string &source,
     return (sourceAge > destAge);
 }
 
-void compileMacro(const std::string &Name,
-                  AcornSettings &settings)
+std::string getMacroCachePath()
+{
+    const char *root = getenv("XDG_CACHE_HOME");
+    if (root != nullptr && root[0] != '\0')
+    {
+        return std::string(root) + "/" + MACRO_CACHE_DIR;
+    }
+
+    root = getenv("HOME");
+    if (root != nullptr && root[0] != '\0')
+    {
+        return std::string(root) + "/.cache/" + MACRO_CACHE_DIR;
+    }
+
+    return "";
+}
+
+std::string hashString(const std::string &what)
+{
+    unsigned long long hash = 14695981039346656037ull;
+    for (const unsigned char c : what)
+    {
+        hash ^= c;
+        hash *= 1099511628211ull;
+    }
+
+    std::stringstream out;
+    out << std::hex << std::setw(16) << std::setfill('0')
+        << hash;
+    return out.str();
+}
+
+std::string getMacroCacheKey(const std::string &Name,
+                             AcornSettings &settings)
+{
+    return hashString(VERSION + '\0' +
+                      std::to_string(getCompilerStamp()) +
+                      '\0' + COMPILER_COMMAND + " -M" + '\0' +
+                      C_COMPILER + '\0' + LINKER + '\0' +
+                      settings.macros[Name]);
+}
+
+// Returns true if none of the files read by the cached build
+// whose input list is at `depsPath` have changed since. An
+// entry without such a list is never trusted.
+static bool areMacroInputsCurrent(const std::string &depsPath)
+{
+    std::ifstream file(depsPath);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    // Each line is a stamp, then a path
+    std::string line;
+    while (getline(file, line))
+    {
+        std::stringstream fields(line);
+        std::pair<long long, unsigned long long> stamp;
+        std::string path;
+        fields >> stamp.first >> stamp.second;
+        fields.get();
+        getline(fields, path);
+
+        if (fields.fail() || getFileStamp(path) != stamp)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Saves the list of files read by the nested build of the given
+// macro (as given by its manifest) to `depsPath`. The macro's
+// own source is left out, since it is part of the cache key.
+// Returns false if the list is unknown.
+static bool saveMacroInputs(const std::string &Name,
+                            const std::string &depsPath)
+{
+    std::string rootName =
+        purifyStr(Name.substr(0, Name.size() - 1));
+    BuildManifest manifest =
+        loadManifest(COMPILED_PATH + rootName + ".out");
+
+    const std::string srcPath =
+        COMPILED_PATH + rootName + ".oak";
+    std::error_code ec;
+    manifest.inputs.erase(srcPath);
+    manifest.inputs.erase(fs::absolute(srcPath).string());
+    manifest.inputs.erase(fs::canonical(srcPath, ec).string());
+    if (manifest.inputs.empty())
+    {
+        return false;
+    }
+
+    std::string temp =
+        depsPath + "." + std::to_string(getpid());
+    std::ofstream file(temp);
+    for (const auto &p : manifest.inputs)
+    {
+        file << p.second.first << ' ' << p.second.second << ' '
+             << p.first << '\n';
+    }
+    file.close();
+
+    if (!file)
+    {
+        fs::remove(temp);
+        return false;
+    }
+
+    fs::rename(temp, depsPath);
+    return true;
+}
+
+// Copies a file into the macro cache. The copy is renamed into
+// place, so concurrent builds never see a partial file.
+static void cacheMacroFile(const std::string &from,
+                           const std::string &to)
+{
+    if (!fs::exists(from))
+    {
+        return;
+    }
+
+    std::string temp = to + "." + std::to_string(getpid());
+    fs::copy_file(from, temp,
+                  fs::copy_options::overwrite_existing);
+    fs::rename(temp, to);
+}
+
+// If the given macro needs to be built, writes its source code
+// and returns the command which will compile it. Returns "" if
+// it is already up to date.
+static std::string prepareMacro(const std::string &Name,
+                                AcornSettings &settings)
 {
     if (settings.macros.count(Name) == 0)
     {
@@ -457,7 +696,7 @@ void compileMacro(const std::string &Name,
     else if (settings.compiled.count(Name) != 0)
     {
         // Already compiled: This is fine
-        return;
+        return "";
     }
 
     std::string rootName =
@@ -466,16 +705,66 @@ void compileMacro(const std::string &Name,
     // Write file to be compiled
     std::string srcPath = COMPILED_PATH + rootName + ".oak";
     std::string binPath = COMPILED_PATH + rootName + ".out";
+    std::string soPath = COMPILED_PATH + rootName + ".so";
+
+    // Check the user-level cache if there is one, then ages,
+    // makefile-style
+    bool isCachedStale = false;
+    std::string cachePath = getMacroCachePath();
+    if (cachePath != "")
+    {
+        cachePath += getMacroCacheKey(Name, settings);
+
+        try
+        {
+            if (fs::exists(cachePath + ".out") &&
+                !areMacroInputsCurrent(cachePath + ".deps"))
+            {
+                isCachedStale = true;
+            }
+            else if (fs::exists(cachePath + ".out"))
+            {
+                fs::create_directory(COMPILED_PATH);
+                fs::copy_file(
+                    cachePath + ".out", binPath,
+                    fs::copy_options::overwrite_existing);
+
+                fs::remove(soPath);
+                if (fs::exists(cachePath + ".so"))
+                {
+                    fs::copy_file(cachePath + ".so", soPath);
+                }
+
+                settings.macroCacheHits++;
+                settings.compiled.insert(Name);
+                return "";
+            }
+        }
+        catch (fs::filesystem_error &e)
+        {
+            // The cache is only an optimization
+        }
+
+        settings.macroCacheMisses++;
+    }
 
-    // Check ages, makefile-style
-    if (!isSourceNewer(settings.macroSourceFiles[Name], binPath,
+    // The cache may be missing or unwritable, so a local binary
+    // is still used if it is newer than its source. One which a
+    // stale cache entry was built alongside may have read the
+    // same changed files, though.
+    if (!isCachedStale &&
+        !isSourceNewer(settings.macroSourceFiles[Name], binPath,
                        settings))
     {
-        return;
+        return "";
     }
 
     fs::create_directory(COMPILED_PATH);
 
+    // The shared object is only relinked if possible, so a
+    // stale one must not outlive its executable
+    fs::remove(soPath);
+
     std::ofstream macroFile(srcPath);
     if (!macroFile.is_open())
     {
@@ -487,12 +776,68 @@ void compileMacro(const std::string &Name,
 
     macroFile.close();
 
-    // Call compiler
-    std::string command = COMPILER_COMMAND +
-                          (settings.debug ? std::string(" -d")
-                                          : std::string("")) +
-                          " -Mo " + binPath + " " + srcPath;
+    // Macros may be built several at a time, so each nested
+    // compiler sticks to one job lest they multiply
+    return COMPILER_COMMAND +
+           (settings.debug ? std::string(" -d")
+                           : std::string("")) +
+           " -j 1 -Mo " + binPath + " " + srcPath;
+}
+
+// Marks the given macro as compiled, publishing it to the
+// user-level cache if there is one.
+static void finishMacro(const std::string &Name,
+                        AcornSettings &settings)
+{
+    std::string rootName =
+        purifyStr(Name.substr(0, Name.size() - 1));
+    std::string binPath = COMPILED_PATH + rootName + ".out";
+    std::string soPath = COMPILED_PATH + rootName + ".so";
+
+    // The executable goes in last, since its presence is what
+    // marks a cache entry as complete
+    std::string cachePath = getMacroCachePath();
+    if (cachePath != "")
+    {
+        cachePath += getMacroCacheKey(Name, settings);
 
+        try
+        {
+            fs::create_directories(
+                fs::path(cachePath).parent_path());
+
+            // Without knowing what the build read, the entry
+            // could never be checked for staleness
+            if (saveMacroInputs(Name, cachePath + ".deps"))
+            {
+                cacheMacroFile(soPath, cachePath + ".so");
+                cacheMacroFile(binPath, cachePath + ".out");
+            }
+        }
+        catch (fs::filesystem_error &e)
+        {
+            // The cache is only an optimization
+        }
+    }
+
+    settings.compiled.insert(Name);
+}
+
+void compileMacro(const std::string &Name,
+                  AcornSettings &settings)
+{
+    std::string command = prepareMacro(Name, settings);
+    if (command == "")
+    {
+        return;
+    }
+
+    std::string srcPath =
+        COMPILED_PATH +
+        purifyStr(Name.substr(0, Name.size() - 1)) + ".oak";
+    TraceSpan span(Name, "macro compile", settings);
+
+    // Call compiler
     if (settings.debug)
     {
         std::cout << "Compiling via command '" << command
@@ -543,14 +888,546 @@ void compileMacro(const std::string &Name,
                   << tags::reset << std::flush;
     }
 
-    settings.compiled.insert(Name);
+    finishMacro(Name, settings);
 
     return;
 }
 
-std::string callMacro(const std::string &Name,
-                      const std::list<std::string> &Args,
-                      AcornSettings &settings)
+// Returns the names of the macros which the given macro source
+// calls. Only whole call tokens count, so that `a!` is not
+// taken to be called by a macro which calls `ba!`.
+static std::set<std::string> getCalledMacros(
+    const std::string &source, AcornSettings &settings)
+{
+    std::set<std::string> out;
+
+    Lexer dfa_lexer;
+    TokenList lexed = dfa_lexer.lex_list(source);
+    for (auto it = lexed.begin(); it != lexed.end(); it++)
+    {
+        if (settings.macros.count(*it) != 0 &&
+            itCmp(lexed, it, 1, "("))
+        {
+            out.insert(*it);
+        }
+    }
+
+    return out;
+}
+
+void compileMacros(const std::set<std::string> &Names,
+                   AcornSettings &settings)
+{
+    TraceSpan span("Macro compilation", "phase", settings);
+
+    // Macros which the given ones call will be compiled by
+    // their nested compilers anyways, so build them here first
+    std::set<std::string> names = Names;
+    std::map<std::string, std::set<std::string>> calls;
+    std::list<std::string> toScan(Names.begin(), Names.end());
+    while (!toScan.empty())
+    {
+        const std::string &name = toScan.front();
+        std::set<std::string> &called = calls[name];
+        called =
+            getCalledMacros(settings.macros[name], settings);
+        called.erase(name);
+
+        for (const auto &macro : called)
+        {
+            if (settings.compiled.count(macro) == 0 &&
+                names.insert(macro).second)
+            {
+                toScan.push_back(macro);
+            }
+        }
+
+        toScan.pop_front();
+    }
+
+    std::map<std::string, std::string> commands;
+    for (const auto &name : names)
+    {
+        std::string command = prepareMacro(name, settings);
+        if (command != "")
+        {
+            commands[name] = command;
+        }
+    }
+
+    // A macro can only be built after all the others it calls
+    std::map<std::string, std::set<std::string>> dependencies;
+    for (const auto &macro : commands)
+    {
+        for (const auto &other : calls[macro.first])
+        {
+            if (commands.count(other) != 0)
+            {
+                dependencies[macro.first].insert(other);
+            }
+        }
+    }
+
+    unsigned int jobs = getJobCount(settings);
+
+    // Finished jobs as (name, error or ""), and their outputs
+    std::mutex lock;
+    std::condition_variable jobFinished;
+    std::list<std::pair<std::string, std::string>> done;
+    std::map<std::string, std::string> outputs;
+
+    std::set<std::string> pending, running;
+    for (const auto &macro : commands)
+    {
+        pending.insert(macro.first);
+    }
+
+    std::vector<std::thread> workers;
+    std::string failure;
+
+    // For the trace; Each running job has a lane of its own,
+    // and the times at which finished jobs started and ended
+    std::map<std::string, unsigned int> lanes;
+    std::set<unsigned int> busyLanes;
+    std::map<std::string, std::pair<unsigned long long,
+                                    unsigned long long>>
+        times;
+
+    auto startJob = [&](const std::string &name)
+    {
+        std::string command = commands[name];
+        pending.erase(name);
+        running.insert(name);
+
+        unsigned int lane = 1;
+        while (busyLanes.count(lane) != 0)
+        {
+            lane++;
+        }
+        busyLanes.insert(lane);
+        lanes[name] = lane;
+
+        if (settings.debug)
+        {
+            std::cout << "Compiling via command '" << command
+                      << "'\n";
+        }
+
+        workers.emplace_back(
+            [&, name, command]()
+            {
+                std::string output, error;
+                unsigned long long start =
+                    getTraceTime(settings);
+
+                try
+                {
+                    output = execute(command);
+                }
+                catch (std::exception &e)
+                {
+                    error = e.what();
+                }
+
+                std::lock_guard<std::mutex> guard(lock);
+                times[name] = {start, getTraceTime(settings)};
+                outputs[name] = output;
+                done.push_back({name, error});
+                jobFinished.notify_one();
+            });
+    };
+
+    while (!running.empty() ||
+           (!pending.empty() && failure == ""))
+    {
+        // Start everything which is ready, up to the job limit
+        std::list<std::string> ready;
+        for (const auto &name : pending)
+        {
+            bool isReady = true;
+            for (const auto &dependency : dependencies[name])
+            {
+                if (pending.count(dependency) != 0 ||
+                    running.count(dependency) != 0)
+                {
+                    isReady = false;
+                    break;
+                }
+            }
+
+            if (isReady)
+            {
+                ready.push_back(name);
+            }
+        }
+
+        for (const auto &name : ready)
+        {
+            if (running.size() >= jobs || failure != "")
+            {
+                break;
+            }
+
+            startJob(name);
+        }
+
+        // A dependency cycle cannot be honored, so break it
+        if (running.empty() && failure == "")
+        {
+            startJob(*pending.begin());
+        }
+
+        // Wait for at least one job to finish
+        std::list<std::pair<std::string, std::string>> finished;
+        {
+            std::unique_lock<std::mutex> guard(lock);
+            jobFinished.wait(guard,
+                             [&]() { return !done.empty(); });
+            finished.swap(done);
+        }
+
+        for (const auto &job : finished)
+        {
+            running.erase(job.first);
+            busyLanes.erase(lanes[job.first]);
+            addTrace(job.first, "macro compile",
+                     times[job.first].first,
+                     times[job.first].second, lanes[job.first],
+                     settings);
+
+            if (outputs[job.first] != "")
+            {
+                std::cout << outputs[job.first] << "\n";
+            }
+
+            if (job.second != "")
+            {
+                if (failure == "")
+                {
+                    failure = job.second;
+                }
+            }
+            else
+            {
+                finishMacro(job.first, settings);
+            }
+        }
+    }
+
+    for (auto &worker : workers)
+    {
+        worker.join();
+    }
+
+    if (failure != "")
+    {
+        throw std::runtime_error("Macro failure: " + failure);
+    }
+}
+
+// Splits a macro call command into its words, as `sh` would.
+// Returns false if the shell would expand anything in it, in
+// which case it must be run through the shell to be faithful.
+static bool splitMacroCommand(const std::string &command,
+                              std::vector<std::string> &words)
+{
+    std::string cur;
+    bool inWord = false, inQuotes = false;
+
+    for (size_t i = 0; i < command.size(); i++)
+    {
+        char c = command[i];
+
+        if (inQuotes)
+        {
+            if (c == '"')
+            {
+                inQuotes = false;
+            }
+            else if (c == '\\' && i + 1 < command.size() &&
+                     strchr("$`\"\\\n", command[i + 1]) !=
+                         nullptr)
+            {
+                i++;
+                if (command[i] != '\n')
+                {
+                    cur += command[i];
+                }
+            }
+            else if (c == '$' || c == '`')
+            {
+                return false;
+            }
+            else
+            {
+                cur += c;
+            }
+        }
+        else if (c == ' ')
+        {
+            if (inWord)
+            {
+                words.push_back(cur);
+                cur.clear();
+                inWord = false;
+            }
+        }
+        else if (c == '"')
+        {
+            inQuotes = inWord = true;
+        }
+        else if (strchr("\\$`'*?[~#&|;<>(){}\t\n", c) !=
+                 nullptr)
+        {
+            return false;
+        }
+        else
+        {
+            cur += c;
+            inWord = true;
+        }
+    }
+
+    if (inQuotes)
+    {
+        return false;
+    }
+    else if (inWord)
+    {
+        words.push_back(cur);
+    }
+
+    return true;
+}
+
+// Loads the shared object of the given (compiled) macro, if
+// there is one. Returns nullptr if it cannot be called
+// in-process.
+static MacroEntry getMacroEntry(const std::string &Name,
+                                AcornSettings &settings)
+{
+    auto found = settings.macroEntries.find(Name);
+    if (found != settings.macroEntries.end())
+    {
+        return found->second;
+    }
+
+    MacroEntry entry = nullptr;
+
+#if (defined(LINUX) || defined(__linux__))
+    std::string soPath =
+        COMPILED_PATH +
+        purifyStr(Name.substr(0, Name.size() - 1)) + ".so";
+
+    if (fs::exists(soPath))
+    {
+        void *handle =
+            dlopen(soPath.c_str(), RTLD_NOW | RTLD_LOCAL);
+
+        if (handle != nullptr)
+        {
+            entry = reinterpret_cast<MacroEntry>(
+                dlsym(handle, MACRO_ENTRY_POINT.c_str()));
+
+            if (entry == nullptr)
+            {
+                dlclose(handle);
+            }
+        }
+        else if (settings.debug)
+        {
+            std::cout << "Failed to load macro `" << Name
+                      << "`: " << dlerror() << '\n';
+        }
+    }
+#endif
+
+    settings.macroEntries[Name] = entry;
+    return entry;
+}
+
+/*
+Calls a macro's entry point (see `MacroEntry`) in a forked
+child, returning everything it printed. A macro may call `exit`
+(as failed `panic!`s and `assert!`s do), so running it within
+the compiler itself is not safe. Fails just as `execute` would
+have with the given command.
+*/
+static std::string
+callMacroEntry(MacroEntry entry, const std::string &command,
+               std::vector<std::string> &words)
+{
+    std::vector<char *> argv;
+    for (auto &word : words)
+    {
+        argv.push_back(word.data());
+    }
+    argv.push_back(nullptr);
+
+    // Otherwise, the child would flush these a second time
+    std::cout.flush();
+    fflush(stdout);
+
+    int fds[2];
+    if (pipe(fds) != 0)
+    {
+        throw sequencing_error("Failed to run command '" +
+                               command + "'");
+    }
+
+    pid_t pid = fork();
+    if (pid < 0)
+    {
+        close(fds[0]);
+        close(fds[1]);
+        throw sequencing_error("Failed to run command '" +
+                               command + "'");
+    }
+    else if (pid == 0)
+    {
+        close(fds[0]);
+        dup2(fds[1], STDOUT_FILENO);
+        close(fds[1]);
+
+        int result = entry(words.size(), argv.data());
+        fflush(stdout);
+        _exit(result);
+    }
+
+    close(fds[1]);
+
+    std::string output;
+    char buffer[4096];
+    ssize_t count;
+    while ((count = read(fds[0], buffer, sizeof(buffer))) != 0)
+    {
+        if (count > 0)
+        {
+            output.append(buffer, count);
+        }
+        else if (errno != EINTR)
+        {
+            break;
+        }
+    }
+    close(fds[0]);
+
+    int status = 0;
+    while (waitpid(pid, &status, 0) < 0 && errno == EINTR)
+    {
+    }
+
+    if (status != 0)
+    {
+        throw sequencing_error(
+            "Command '" + command + "' failed with exit code " +
+            std::to_string(status) + ".");
+    }
+
+    return output;
+}
+
+// Looks up a memoized macro call. `argsKey` is the call's
+// arguments joined by null characters.
+static bool getMacroMemo(const std::string &Name,
+                         const std::string &argsKey,
+                         std::string &out,
+                         AcornSettings &settings)
+{
+    std::string key = getMacroCacheKey(Name, settings);
+
+    auto found = settings.macroMemo.find(key + '\0' + argsKey);
+    if (found != settings.macroMemo.end())
+    {
+        out = found->second;
+        return true;
+    }
+
+    std::string cachePath = getMacroCachePath();
+    if (cachePath == "")
+    {
+        return false;
+    }
+
+    // The macro's output may depend on the files its build
+    // included, just as its binary does
+    if (!areMacroInputsCurrent(cachePath + key + ".deps"))
+    {
+        return false;
+    }
+
+    // Memo files hold the length of the arguments, then the
+    // arguments themselves (to rule out hash collisions), then
+    // the output
+    std::ifstream file(cachePath + key + "." +
+                           hashString(argsKey) + ".memo",
+                       std::ios::binary);
+    size_t argsSize = 0;
+    if (!file.is_open() || !(file >> argsSize) ||
+        file.get() != '\n' || argsSize != argsKey.size())
+    {
+        return false;
+    }
+
+    std::string contents((std::istreambuf_iterator<char>(file)),
+                         std::istreambuf_iterator<char>());
+    if (contents.compare(0, argsSize, argsKey) != 0)
+    {
+        return false;
+    }
+
+    out = contents.substr(argsSize);
+    settings.macroMemo[key + '\0' + argsKey] = out;
+    return true;
+}
+
+// Memoizes a macro call, both in memory and (if possible) on
+// disk. `argsKey` is as in getMacroMemo.
+static void setMacroMemo(const std::string &Name,
+                         const std::string &argsKey,
+                         const std::string &output,
+                         AcornSettings &settings)
+{
+    std::string key = getMacroCacheKey(Name, settings);
+    settings.macroMemo[key + '\0' + argsKey] = output;
+
+    std::string cachePath = getMacroCachePath();
+    if (cachePath == "")
+    {
+        return;
+    }
+
+    std::string path =
+        cachePath + key + "." + hashString(argsKey) + ".memo";
+    std::string temp = path + "." + std::to_string(getpid());
+
+    try
+    {
+        fs::create_directories(cachePath);
+
+        std::ofstream file(temp, std::ios::binary);
+        file << argsKey.size() << '\n' << argsKey << output;
+        file.close();
+
+        if (file)
+        {
+            fs::rename(temp, path);
+        }
+        else
+        {
+            fs::remove(temp);
+        }
+    }
+    catch (fs::filesystem_error &e)
+    {
+        // The cache is only an optimization
+    }
+}
+
+// Calls the given macro, compiling it if needed.
+static std::string runMacro(const std::string &Name,
+                            const std::list<std::string> &Args,
+                            AcornSettings &settings)
 {
     if (settings.compiled.count(Name) == 0)
     {
@@ -605,7 +1482,18 @@ std::string callMacro(const std::string &Name,
         std::cout << "Macro call `" << command << "`\n";
     }
 
-    std::string out = execute(command);
+    std::string out;
+    std::vector<std::string> words;
+    MacroEntry entry = getMacroEntry(Name, settings);
+
+    if (entry != nullptr && splitMacroCommand(command, words))
+    {
+        out = callMacroEntry(entry, command, words);
+    }
+    else
+    {
+        out = execute(command);
+    }
 
     if (settings.debug)
     {
@@ -616,6 +1504,57 @@ std::string callMacro(const std::string &Name,
     return out;
 }
 
+std::string callMacro(const std::string &Name,
+                      const std::list<std::string> &Args,
+                      AcornSettings &settings)
+{
+    // Macros are assumed to be pure unless their file says
+    // otherwise
+    const std::string &file = settings.macroSourceFiles[Name];
+    auto tags = settings.file_tags.find(file);
+    bool isPure = tags == settings.file_tags.end() ||
+                  tags->second.count("impure_macros") == 0;
+
+    TraceSpan span(Name, "macro call", settings);
+
+    std::string argsKey, out;
+    for (const auto &arg : Args)
+    {
+        argsKey += arg + '\0';
+    }
+
+    settings.macroCalls++;
+    if (!isPure)
+    {
+        settings.impureMacroCalled = true;
+    }
+    else if (getMacroMemo(Name, argsKey, out, settings))
+    {
+        settings.macroMemoHits++;
+        settings.macroOutputBytes += out.size();
+
+        if (settings.debug)
+        {
+            std::cout << "Memoized macro call `" << Name
+                      << "` returned\n```\n"
+                      << out << "\n```\n";
+        }
+
+        return out;
+    }
+
+    out = runMacro(Name, Args, settings);
+    settings.macroOutputBytes += out.size();
+
+    if (isPure)
+    {
+        settings.macroMemoMisses++;
+        setMacroMemo(Name, argsKey, out, settings);
+    }
+
+    return out;
+}
+
 std::string mangleStruct(
     const std::string &name,
     const std::list<std::list<std::string>> &generics)
@@ -837,7 +1776,7 @@ ASTNode getAllocSequence(Type &type, const std::string &name,
 
     // name = (type *)malloc(len * sizeof(type));
     out.items.push_back(ASTNode{
-        nullType, std::list<ASTNode>(), atom,
+        nullType, ASTList(), atom,
         name + " = (" + toStrC(&type, settings) +
             " *)malloc(sizeof(" + toStrC(&type, settings) +
             ") * " + num + ")"});
@@ -853,7 +1792,7 @@ ASTNode getFreeSequence(const std::string &name,
     out.type = nullType;
     out.items.clear();
 
-    out.items.push_back(ASTNode{nullType, std::list<ASTNode>(),
+    out.items.push_back(ASTNode{nullType, ASTList(),
                                 atom, "free(" + name + ")"});
 
     return out;
@@ -917,94 +1856,129 @@ std::string humanReadable(const unsigned long long int &Size)
     }
 }
 
+// Inserts a non-function symbol into the table, recording it in
+// the scope log so that closeSymbolScope can undo it.
+void addScopedSymbol(const std::string &name,
+                     const MultiTableSymbol &symbol,
+                     AcornSettings &settings)
+{
+    auto &entries = settings.table[name];
+    entries.push_back(symbol);
+    settings.scopeLog.push_back(
+        std::make_pair(name, std::prev(entries.end())));
+}
+
+// Returns a marker for the current position in the scope log.
+size_t openSymbolScope(AcornSettings &settings)
+{
+    return settings.scopeLog.size();
+}
+
 /*
-Erases any non-function symbols which were not present
-in the original table. However, skips all functions.
-If not contradicted by the above rules, bases off of
-the current table (not backup).
+Erases any non-function symbols which were added since `marker`
+and which do not share a type with a symbol of the same name
+that existed before it. Runs in time proportional to the number
+of symbols declared in the scope.
 */
 std::list<std::pair<std::string, std::string>>
-restoreSymbolTable(MultiSymbolTable &backup,
-                   MultiSymbolTable &realTable)
+closeSymbolScope(const size_t &marker, AcornSettings &settings)
 {
     std::list<std::pair<std::string, std::string>> out;
 
-    MultiSymbolTable newTable;
-    for (auto p : realTable)
+    if (marker >= settings.scopeLog.size())
+    {
+        return out;
+    }
+
+    ScopeLog added(settings.scopeLog.begin() + marker,
+                   settings.scopeLog.end());
+    settings.scopeLog.resize(marker);
+
+    // Stable sort by name so that destructors are emitted in
+    // the same order as a walk over the table would produce
+    std::stable_sort(added.begin(), added.end(),
+                     [](const auto &a, const auto &b)
+                     { return a.first < b.first; });
+
+    std::set<const MultiTableSymbol *> addedSet;
+    for (const auto &p : added)
+    {
+        addedSet.insert(&*p.second);
+    }
+
+    ScopeLog toErase;
+
+    for (const auto &p : added)
     {
-        for (auto s : p.second)
+        const MultiTableSymbol &s = *p.second;
+
+        // Functions are always kept- the logic for this is
+        // handled elsewhere.
+        bool keep = s.type[0].info == function;
+
+        // Check for presence before this scope
+        for (auto cand = settings.table[p.first].begin();
+             !keep && cand != settings.table[p.first].end();
+             cand++)
         {
-            // Functions are always added- the logic for
-            // this is handled elsewhere.
-            if (s.type[0].info == function)
+            if (addedSet.count(&*cand) == 0 &&
+                cand->type == s.type)
             {
-                // Add to new table for sure
-                newTable[p.first];
-                newTable[p.first].push_back(s);
+                keep = true;
             }
+        }
 
-            // Variables are more complicated
-            else
-            {
-                // Check for presence in backup
-                bool present = false;
-                for (auto cand : backup[p.first])
-                {
-                    if (cand.type == s.type)
-                    {
-                        present = true;
-                        break;
-                    }
-                }
-
-                // If was present in backup, add for sure
-                if (present)
-                {
-                    // Add to table for sure
-                    newTable[p.first];
-                    newTable[p.first].push_back(s);
-                }
+        // If was present before, keep for sure (it belongs to
+        // the enclosing scope now)
+        if (keep)
+        {
+            settings.scopeLog.push_back(p);
+            continue;
+        }
 
-                // Otherwise, do not add (do destructor literal
-                // check)
-                else
-                {
-                    // Variable falling out of scope
-                    // Do not call Del if is atomic literal
-                    if (!(s.type[0].info == atomic &&
-                          (s.type[0].name == "u8" ||
-                           s.type[0].name == "i8" ||
-                           s.type[0].name == "u16" ||
-                           s.type[0].name == "i16" ||
-                           s.type[0].name == "u32" ||
-                           s.type[0].name == "i32" ||
-                           s.type[0].name == "u64" ||
-                           s.type[0].name == "i64" ||
-                           s.type[0].name == "u128" ||
-                           s.type[0].name == "i128" ||
-                           s.type[0].name == "f32" ||
-                           s.type[0].name == "f64" ||
-                           s.type[0].name == "f128" ||
-                           s.type[0].name == "bool" ||
-                           s.type[0].name == "str")) &&
-                        s.type[0].info != function &&
-                        s.type[0].info != pointer &&
-                        s.type[0].info != arr &&
-                        s.type[0].info != sarr && p.first != "")
-                    {
-                        // Del_FN_PTR_typename_MAPS_void
-                        out.push_back(std::make_pair(
-                            p.first, "Del_FN_PTR_" +
-                                         s.type[0].name +
-                                         "_MAPS_void(&" +
-                                         p.first + ");"));
-                    }
-                }
-            }
+        // Variable falling out of scope
+        // Do not call Del if is atomic literal
+        if (!(s.type[0].info == atomic &&
+              (s.type[0].name == "u8" ||
+               s.type[0].name == "i8" ||
+               s.type[0].name == "u16" ||
+               s.type[0].name == "i16" ||
+               s.type[0].name == "u32" ||
+               s.type[0].name == "i32" ||
+               s.type[0].name == "u64" ||
+               s.type[0].name == "i64" ||
+               s.type[0].name == "u128" ||
+               s.type[0].name == "i128" ||
+               s.type[0].name == "f32" ||
+               s.type[0].name == "f64" ||
+               s.type[0].name == "f128" ||
+               s.type[0].name == "bool" ||
+               s.type[0].name == "str")) &&
+            s.type[0].info != pointer &&
+            s.type[0].info != arr && s.type[0].info != sarr &&
+            p.first != "")
+        {
+            // Del_FN_PTR_typename_MAPS_void
+            out.push_back(std::make_pair(
+                p.first, "Del_FN_PTR_" + s.type[0].name +
+                             "_MAPS_void(&" + p.first + ");"));
         }
+
+        toErase.push_back(p);
     }
 
-    realTable = newTable;
+    // Erase only after all presence checks are done
+    for (const auto &p : toErase)
+    {
+        auto &entries = settings.table[p.first];
+        entries.erase(p.second);
+        invalidateOverloads(p.first, settings);
+
+        if (entries.empty())
+        {
+            settings.table.erase(p.first);
+        }
+    }
 
     return out;
 }
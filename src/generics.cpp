@@ -145,8 +145,8 @@ bool typeIsPrefixOfAny(Type t,
                        AcornSettings &settings)
 {
     Type completedT = t;
-    completedT.internal.push_back(TypeNode{maps, ""});
-    completedT.internal.push_back(TypeNode{atomic, "void"});
+    completedT.append(maps);
+    completedT.append(atomic, "void");
 
     auto obsArgs = getArgs(completedT, settings);
     std::list<Type> obsArgTypes;
@@ -296,7 +296,7 @@ std::string __instantiateGeneric(
         r++;
     }
 
-    std::list<Token> copy;
+    TokenList copy;
 
     // Needs block (pre, so no functions)
     if (info.preBlock.size() != 0)
@@ -397,6 +397,7 @@ std::string instantiateGeneric(
     int oldCurLine = settings.curLine;
 
     std::string mangleStr = mangleStruct(what, genericSubs);
+    TraceSpan span(mangleStr, "generic", settings);
     std::list<std::string> errors;
 
     bool didInstantiate = false;
@@ -566,12 +567,12 @@ std::string instantiateGeneric(
     return mangleStr;
 }
 
-void addGeneric(const std::list<Token> &what,
+void addGeneric(const TokenList &what,
                 const std::string &name,
                 const std::list<std::string> &genericsList,
                 const std::list<std::string> &typeVec,
-                const std::list<Token> &preBlock,
-                const std::list<Token> &postBlock,
+                const TokenList &preBlock,
+                const TokenList &postBlock,
                 AcornSettings &settings)
 {
     GenericInfo toAdd;
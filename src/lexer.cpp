@@ -7,12 +7,303 @@ jdehmel@outlook.com
 
 #include "lexer.hpp"
 #include "tags.hpp"
-#include <fstream>
+#include <deque>
 #include <iostream>
+#include <set>
 #include <stdexcept>
+#include <unordered_map>
 
-bool Lexer::is_initialized = false;
-LexerState **Lexer::dfa = nullptr;
+#if defined(__x86_64__)
+#include <immintrin.h>
+#define LEXER_HAS_X86
+#endif
+
+// A deque, so that references to names are never invalidated
+static std::deque<std::string> &file_names()
+{
+    static std::deque<std::string> names = {"NULL"};
+    return names;
+}
+
+unsigned int intern_file(const std::string &filepath)
+{
+    static std::unordered_map<std::string, unsigned int> ids = {
+        {"NULL", 0}};
+
+    auto found = ids.find(filepath);
+    if (found != ids.end())
+    {
+        return found->second;
+    }
+
+    unsigned int id = file_names().size();
+    file_names().push_back(filepath);
+    ids[filepath] = id;
+    return id;
+}
+
+const std::string &file_name(const unsigned int &id)
+{
+    return file_names()[id];
+}
+
+const std::string &intern_text(const std::string_view &text)
+{
+    // Texts live in the deque, which never moves them, so the
+    // views used as keys stay valid
+    static std::deque<std::string> texts = {""};
+    static std::unordered_map<std::string_view,
+                              const std::string *>
+        ids = {{texts.front(), &texts.front()}};
+
+    auto found = ids.find(text);
+    if (found != ids.end())
+    {
+        return *found->second;
+    }
+
+    texts.emplace_back(text);
+    ids[texts.back()] = &texts.back();
+    return texts.back();
+}
+
+////////////////////////////////////////////////////////////////
+// Scanning
+
+// The bytes a scan stops at. Smaller sets repeat a member.
+typedef char ScanStops[5];
+
+const static ScanStops WHITESPACE_STOPS = {' ', '\t', '\n',
+                                           '\n', '\n'};
+const static ScanStops LINE_COMMENT_STOPS = {'\n', '\'', '"',
+                                             '\\', '\\'};
+const static ScanStops BLOCK_COMMENT_STOPS = {'*', '/', '\'',
+                                              '"', '\\'};
+const static ScanStops SINGLE_STRING_STOPS = {'\'', '\\', '\n',
+                                              '\n', '\n'};
+const static ScanStops DOUBLE_STRING_STOPS = {'"', '\\', '\n',
+                                              '\n', '\n'};
+
+// Returns the index of the first of the `n` bytes at `p` which
+// is one of `stops` (or if `invert`, is not), or `n` if none
+// is.
+typedef size_t (*ScanFn)(const char *p, const size_t n,
+                         const ScanStops &stops,
+                         const bool invert);
+
+// Returns the number of newlines in the `n` bytes at `p`.
+typedef size_t (*CountFn)(const char *p, const size_t n);
+
+static size_t find_bytes(const char *p, const size_t n,
+                         const ScanStops &stops,
+                         const bool invert)
+{
+    for (size_t i = 0; i < n; i++)
+    {
+        const char c = p[i];
+        const bool is_stop = c == stops[0] || c == stops[1] ||
+                             c == stops[2] || c == stops[3] ||
+                             c == stops[4];
+        if (is_stop != invert)
+        {
+            return i;
+        }
+    }
+
+    return n;
+}
+
+static size_t count_bytes(const char *p, const size_t n)
+{
+    size_t out = 0;
+    for (size_t i = 0; i < n; i++)
+    {
+        out += p[i] == '\n';
+    }
+
+    return out;
+}
+
+#ifdef LEXER_HAS_X86
+
+static size_t find_sse2(const char *p, const size_t n,
+                        const ScanStops &stops,
+                        const bool invert)
+{
+    const __m128i s0 = _mm_set1_epi8(stops[0]),
+                  s1 = _mm_set1_epi8(stops[1]),
+                  s2 = _mm_set1_epi8(stops[2]),
+                  s3 = _mm_set1_epi8(stops[3]),
+                  s4 = _mm_set1_epi8(stops[4]);
+    const unsigned int flip = invert ? 0xFFFF : 0;
+
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i v =
+            _mm_loadu_si128((const __m128i *)(p + i));
+        __m128i hit = _mm_or_si128(_mm_cmpeq_epi8(v, s0),
+                                   _mm_cmpeq_epi8(v, s1));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, s2));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, s3));
+        hit = _mm_or_si128(hit, _mm_cmpeq_epi8(v, s4));
+
+        const unsigned int bits =
+            (unsigned int)_mm_movemask_epi8(hit) ^ flip;
+        if (bits != 0)
+        {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return i + find_bytes(p + i, n - i, stops, invert);
+}
+
+static size_t count_sse2(const char *p, const size_t n)
+{
+    const __m128i newline = _mm_set1_epi8('\n');
+
+    size_t out = 0, i = 0;
+    for (; i + 16 <= n; i += 16)
+    {
+        const __m128i v =
+            _mm_loadu_si128((const __m128i *)(p + i));
+        out += __builtin_popcount(
+            _mm_movemask_epi8(_mm_cmpeq_epi8(v, newline)));
+    }
+
+    return out + count_bytes(p + i, n - i);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+find_avx2(const char *p, const size_t n,
+          const ScanStops &stops, const bool invert)
+{
+    const __m256i s0 = _mm256_set1_epi8(stops[0]),
+                  s1 = _mm256_set1_epi8(stops[1]),
+                  s2 = _mm256_set1_epi8(stops[2]),
+                  s3 = _mm256_set1_epi8(stops[3]),
+                  s4 = _mm256_set1_epi8(stops[4]);
+    const unsigned int flip = invert ? 0xFFFFFFFF : 0;
+
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        const __m256i v =
+            _mm256_loadu_si256((const __m256i *)(p + i));
+        __m256i hit = _mm256_or_si256(_mm256_cmpeq_epi8(v, s0),
+                                      _mm256_cmpeq_epi8(v, s1));
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, s2));
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, s3));
+        hit = _mm256_or_si256(hit, _mm256_cmpeq_epi8(v, s4));
+
+        const unsigned int bits =
+            (unsigned int)_mm256_movemask_epi8(hit) ^ flip;
+        if (bits != 0)
+        {
+            return i + __builtin_ctz(bits);
+        }
+    }
+
+    return i + find_sse2(p + i, n - i, stops, invert);
+}
+
+__attribute__((target("avx2,popcnt"))) static size_t
+count_avx2(const char *p, const size_t n)
+{
+    const __m256i newline = _mm256_set1_epi8('\n');
+
+    size_t out = 0, i = 0;
+    for (; i + 32 <= n; i += 32)
+    {
+        const __m256i v =
+            _mm256_loadu_si256((const __m256i *)(p + i));
+        out += __builtin_popcount(_mm256_movemask_epi8(
+            _mm256_cmpeq_epi8(v, newline)));
+    }
+
+    return out + count_sse2(p + i, n - i);
+}
+
+#endif
+
+// The scan mode in use, and its kernels
+struct Scanner
+{
+    LexerScanMode mode;
+    ScanFn scan;
+    CountFn count;
+};
+
+static Scanner &scanner()
+{
+    static Scanner current = {scan_none, find_bytes,
+                              count_bytes};
+    static bool is_chosen = false;
+
+    if (!is_chosen)
+    {
+        is_chosen = true;
+        for (int mode = scan_avx2; mode > scan_none; mode--)
+        {
+            if (set_scan_mode((LexerScanMode)mode))
+            {
+                break;
+            }
+        }
+    }
+
+    return current;
+}
+
+bool set_scan_mode(const LexerScanMode &to)
+{
+    Scanner out = {to, find_bytes, count_bytes};
+
+    switch (to)
+    {
+    case scan_none:
+    case scan_scalar:
+        break;
+
+#ifdef LEXER_HAS_X86
+    case scan_sse2:
+        // Always present on x86-64
+        out.scan = find_sse2;
+        out.count = count_sse2;
+        break;
+
+    case scan_avx2:
+        __builtin_cpu_init();
+        if (!__builtin_cpu_supports("avx2") ||
+            !__builtin_cpu_supports("popcnt"))
+        {
+            return false;
+        }
+        out.scan = find_avx2;
+        out.count = count_avx2;
+        break;
+#endif
+
+    default:
+        return false;
+    }
+
+    scanner() = out;
+    return true;
+}
+
+LexerScanMode get_scan_mode()
+{
+    return scanner().mode;
+}
+
+static bool is_whitespace(const char &c)
+{
+    return c == ' ' || c == '\t' || c == '\n';
+}
+
+////////////////////////////////////////////////////////////////
 
 std::string to_string(Token &what)
 {
@@ -34,7 +325,31 @@ std::string to_string(Token &what)
     }
 }
 
-Lexer::Lexer()
+/*
+A table of the DFA's transitions, laid out flat: The state after
+`from` on the byte `c` is `dfa[from][c]`. Only modified while
+being built.
+*/
+class DFATable
+{
+  public:
+    constexpr unsigned char *operator[](const int &from)
+    {
+        return &cells[from * number_chars];
+    }
+
+    constexpr const unsigned char *operator[](
+        const int &from) const
+    {
+        return &cells[from * number_chars];
+    }
+
+  private:
+    // Zero is the deliminator state, so this is the default
+    unsigned char cells[number_states * number_chars] = {};
+};
+
+static constexpr DFATable build_dfa()
 {
     const char *alpha = "abcdefghijklmnopqrstuvwxyz_"
                         "ABCDEFGHIJKLMNOPQRSTUVWXYZ`";
@@ -43,36 +358,7 @@ Lexer::Lexer()
     const char *singletons = "^@#(){};,?";
     const char *whitespace = " \t\n";
 
-    cur_file = "NULL";
-
-    // Localize variables
-    text = "";
-    pos = 0;
-    line = 1;
-    state = delim_state;
-
-    // Initialize singleton members
-    if (Lexer::is_initialized)
-    {
-        is_responsible = false;
-        return;
-    }
-
-    is_responsible = true;
-    Lexer::is_initialized = true;
-
-    // Initialize DFA
-    dfa = new LexerState *[number_states];
-    for (int i = 0; i < number_states; i++)
-    {
-        dfa[i] = new LexerState[number_chars];
-
-        // Set default to deliminator state
-        for (int j = 0; j < number_chars; j++)
-        {
-            dfa[i][j] = delim_state;
-        }
-    }
+    DFATable dfa;
 
     // Alphabetic stuff
     for (const char *i = &alpha[0]; *i != '\0'; i++)
@@ -238,57 +524,46 @@ Lexer::Lexer()
     dfa[dollar_sign_state][(unsigned int)'\t'] = delim_state;
     dfa[dollar_sign_state][(unsigned int)'\n'] = delim_state;
     dfa[colon_state][(unsigned int)':'] = colon_state;
+
+    return dfa;
 }
 
-Lexer::~Lexer()
-{
-    if (!is_responsible)
-    {
-        return;
-    }
+// Built at compile time
+static constexpr DFATable DFA = build_dfa();
 
-    for (int i = 0; i < number_states; i++)
-    {
-        delete[] dfa[i];
-    }
-    delete[] dfa;
-    dfa = 0;
+static_assert(DFA[delim_state][(unsigned int)'a'] ==
+              alpha_state);
+static_assert(DFA[dash_state][(unsigned int)'>'] ==
+              operator_state);
 
-    is_initialized = false;
+LexerState lexer_transition(const LexerState &from,
+                            const unsigned char &c)
+{
+    return (LexerState)DFA[from][c];
+}
+
+Lexer::Lexer()
+{
+    cur_file = 0;
+    pos = 0;
+    line = 1;
+    state = delim_state;
 }
 
 void Lexer::str(const std::string &from) noexcept
 {
     pos = 0;
     line = 1;
-    text = from;
+    memory = from;
+    text = memory;
 }
 
 void Lexer::file(const std::string &filepath)
 {
     pos = 0;
     line = 1;
-    cur_file = filepath;
-
-    std::string line;
-    std::ifstream f(filepath, std::ios::ate);
-
-    if (!f.is_open())
-    {
-        throw std::runtime_error("Failed to open file '" +
-                                 filepath + "'");
-    }
-
-    text.clear();
-    text.reserve(f.tellg());
-    f.seekg(std::ios::beg);
-
-    while (getline(f, line))
-    {
-        text.append(line + '\n');
-    }
-
-    f.close();
+    cur_file = intern_file(filepath);
+    text = load_source(filepath);
 }
 
 Token Lexer::single()
@@ -304,7 +579,7 @@ Token Lexer::single()
 
     out.pos = pos;
     out.line = line;
-    out.file = cur_file;
+    out.file_id = cur_file;
 
     bool skip = false;
     do
@@ -336,9 +611,14 @@ Token Lexer::single()
 
         prev_state = state;
 
-        if (pos <= text.size())
+        if (pos < text.size())
+        {
+            state = (LexerState)
+                DFA[state][(unsigned char)text[pos]];
+        }
+        else if (pos == text.size())
         {
-            state = dfa[state][(unsigned char)text[pos]];
+            state = (LexerState)DFA[state][0];
         }
         else
         {
@@ -346,6 +626,26 @@ Token Lexer::single()
         }
 
         pos++;
+
+        // Nothing in a string literal but its closing quote, an
+        // escape or a newline can change the state
+        if ((state == string_literal_state_single ||
+             state == string_literal_state_double) &&
+            pos < text.size() && scanner().mode != scan_none)
+        {
+            const size_t run = scanner().scan(
+                text.data() + pos, text.size() - pos,
+                state == string_literal_state_single
+                    ? SINGLE_STRING_STOPS
+                    : DOUBLE_STRING_STOPS,
+                false);
+
+            if (run != 0)
+            {
+                prev_state = state;
+                pos += run;
+            }
+        }
     } while (state != delim_state);
 
     if (prev_state != string_literal_state_single &&
@@ -361,7 +661,7 @@ Token Lexer::single()
         end = std::min((long long)text.size(),
                        (long long)(pos + 20));
 
-        std::string sub = text.substr(start, end - start);
+        std::string sub(text.substr(start, end - start));
         for (int i = 0; i < sub.size(); i++)
         {
             if (sub[i] == '\n')
@@ -383,7 +683,7 @@ Token Lexer::single()
     }
 
     // Record the falling state and text
-    out.text = text.substr(out.pos, pos - out.pos);
+    out.text = TokenText(text.substr(out.pos, pos - out.pos));
     out.state = prev_state;
 
     return out;
@@ -394,7 +694,66 @@ bool Lexer::done() const noexcept
     return pos >= text.size();
 }
 
-void erase_comments(std::list<Token> &what)
+void Lexer::skip_dropped(const bool &in_line_comment,
+                         const bool &in_block_comment)
+{
+    const Scanner &scan = scanner();
+    if (scan.mode == scan_none || pos >= text.size())
+    {
+        return;
+    }
+
+    const char *start = text.data() + pos;
+    const size_t n = text.size() - pos;
+    size_t stop;
+
+    if (in_line_comment)
+    {
+        stop = scan.scan(start, n, LINE_COMMENT_STOPS, false);
+    }
+    else if (in_block_comment)
+    {
+        stop = scan.scan(start, n, BLOCK_COMMENT_STOPS, false);
+    }
+    else if (is_whitespace(start[0]))
+    {
+        stop = scan.scan(start, n, WHITESPACE_STOPS, true);
+    }
+    else
+    {
+        return;
+    }
+
+    /*
+    A newline always starts a token outside of a string. So does
+    any other whitespace, as long as no escape comes before it.
+    Everything else could be joined to whatever is before it,
+    so stop at the last whitespace instead.
+    */
+    if (!(in_line_comment && stop < n && start[stop] == '\n'))
+    {
+        while (stop > 0 && !is_whitespace(start[stop - 1]))
+        {
+            stop--;
+        }
+
+        if (stop == 0)
+        {
+            return;
+        }
+        stop--;
+    }
+
+    /*
+    The DFA counts each newline as it looks ahead to it, so only
+    one which starts the text or follows a string (neither of
+    which are skipped here) goes uncounted.
+    */
+    line += scan.count(start + 1, stop);
+    pos += stop;
+}
+
+void erase_comments(TokenList &what)
 {
     int count = 0;
     for (auto it = what.begin(); it != what.end(); it++)
@@ -428,7 +787,7 @@ void erase_comments(std::list<Token> &what)
     }
 }
 
-void erase_whitespace(std::list<Token> &what)
+void erase_whitespace(TokenList &what)
 {
     for (auto it = what.begin(); it != what.end(); it++)
     {
@@ -440,7 +799,7 @@ void erase_whitespace(std::list<Token> &what)
     }
 }
 
-void join_numbers(std::list<Token> &what)
+void join_numbers(TokenList &what)
 {
     for (auto it = what.begin(); it != what.end(); it++)
     {
@@ -481,7 +840,7 @@ void join_numbers(std::list<Token> &what)
             {
                 std::cout << tags::yellow_bold
                           << "Warning: Untyped number literal "
-                          << "at " << it->file << ":"
+                          << "at " << it->file() << ":"
                           << it->line << ".\n"
                           << tags::reset;
             }
@@ -491,10 +850,7 @@ void join_numbers(std::list<Token> &what)
     }
 }
 
-/*
-Applies the namespace rule, where '::' becomes '_'.
-*/
-void join_namespaces(std::list<Token> &what)
+void join_namespaces(TokenList &what)
 {
     for (auto it = what.begin(); it != what.end(); it++)
     {
@@ -513,11 +869,7 @@ void join_namespaces(std::list<Token> &what)
     }
 }
 
-/*
-Joins successive string literals together. Assumes that
-whitespace is no longer present.
-*/
-void join_strings(std::list<Token> &what)
+void join_strings(TokenList &what)
 {
     // Single quote pass
     for (auto it = what.begin(); it != what.end(); it++)
@@ -530,8 +882,9 @@ void join_strings(std::list<Token> &what)
             {
                 std::string temp = it->text.substr(1);
                 it--;
-                it->text.pop_back();
-                it->text += temp;
+                const std::string &prev = it->text;
+                it->text =
+                    prev.substr(0, prev.size() - 1) + temp;
                 it++;
 
                 it = what.erase(it);
@@ -552,8 +905,9 @@ void join_strings(std::list<Token> &what)
             {
                 std::string temp = it->text.substr(1);
                 it--;
-                it->text.pop_back();
-                it->text += temp;
+                const std::string &prev = it->text;
+                it->text =
+                    prev.substr(0, prev.size() - 1) + temp;
                 it++;
 
                 it = what.erase(it);
@@ -564,7 +918,7 @@ void join_strings(std::list<Token> &what)
     }
 }
 
-void join_bitshifts(std::list<Token> &what)
+void join_bitshifts(TokenList &what)
 {
     for (auto it = what.begin(); it != what.end(); it++)
     {
@@ -643,20 +997,16 @@ void join_bitshifts(std::list<Token> &what)
 void Lexer::str(const std::string &from,
                 const std::string &filepath) noexcept
 {
-    pos = 0;
-    line = 1;
-    text = from;
-    cur_file = filepath;
+    str(from);
+    cur_file = intern_file(filepath);
 }
 
-std::list<Token> Lexer::str_all(
+TokenList Lexer::str_all(
     const std::string &from) noexcept
 {
-    pos = 0;
-    line = 1;
-    text = from;
+    str(from);
 
-    std::list<Token> out;
+    TokenList out;
 
     while (!done())
     {
@@ -666,16 +1016,13 @@ std::list<Token> Lexer::str_all(
     return out;
 }
 
-std::list<Token> Lexer::str_all(
+TokenList Lexer::str_all(
     const std::string &from,
     const std::string &filepath) noexcept
 {
-    pos = 0;
-    line = 1;
-    text = from;
-    cur_file = filepath;
+    str(from, filepath);
 
-    std::list<Token> out;
+    TokenList out;
 
     while (!done())
     {
@@ -685,27 +1032,330 @@ std::list<Token> Lexer::str_all(
     return out;
 }
 
-// Antiquated version:
-// std::vector<Token> Lexer::lex(const std::string &What, const
-// std::string &filepath)
-// {
-//     auto lexed = lex_list(What, filepath);
-//     std::vector<Token> out_vec;
-//     out_vec.assign(lexed.begin(), lexed.end());
-//     return out_vec;
-// }
+/*
+The fixups of `lex_list_multipass`, fused so that each token is
+handled as soon as it is lexed. Each stage passes tokens on to
+the next in order, holding back only those which a later token
+could still change. Must agree with erase_comments,
+erase_whitespace, join_namespaces, join_numbers, join_bitshifts
+and join_strings, applied in that order.
+*/
+class TokenPipeline
+{
+  public:
+    TokenPipeline(TokenList &into) : out(into)
+    {
+    }
+
+    // Takes the next token from the DFA
+    void push(const Token &what)
+    {
+        // Comments
+        if (in_line_comment)
+        {
+            if (what.text != "\n")
+            {
+                return;
+            }
+            in_line_comment = false;
+        }
+
+        if (what.text == "/*")
+        {
+            comment_depth++;
+        }
+        else if (what.text == "*/")
+        {
+            comment_depth--;
+        }
+
+        if (comment_depth != 0 || what.text == "*/")
+        {
+            return;
+        }
+        else if (what.substr(0, 2) == "//" ||
+                 what.substr(0, 1) == "#")
+        {
+            in_line_comment = true;
+            return;
+        }
+
+        // Whitespace
+        if (what.state == whitespace_state)
+        {
+            return;
+        }
+
+        to_namespaces(what);
+    }
+
+    // True if the next tokens are in a line comment
+    bool is_in_line_comment() const
+    {
+        return in_line_comment;
+    }
+
+    // True if the next tokens are in a block comment
+    bool is_in_block_comment() const
+    {
+        return comment_depth != 0;
+    }
+
+    // Passes on everything held back, at the end of the text
+    void finish()
+    {
+        if (has_last)
+        {
+            has_last = false;
+            to_numbers(last);
+        }
+
+        if (has_number)
+        {
+            has_number = false;
+            to_bitshifts(number);
+        }
+
+        drain_bitshifts(true);
+    }
+
+  private:
+    void to_namespaces(const Token &what)
+    {
+        if (join_next)
+        {
+            last.text += "_" + what.text;
+            join_next = false;
+            return;
+        }
+        else if (has_last && what.text == "::")
+        {
+            join_next = true;
+            return;
+        }
+
+        if (has_last)
+        {
+            to_numbers(last);
+        }
+
+        last = what;
+        has_last = true;
+    }
+
+    void to_numbers(const Token &what)
+    {
+        if (has_number)
+        {
+            if (what.state == numerical_state)
+            {
+                number.text += what.text;
+                return;
+            }
+
+            has_number = false;
+
+            if (NUMBER_SUFFIXES.count(what.text) != 0)
+            {
+                number.text += what.text;
+                to_bitshifts(number);
+                return;
+            }
+
+            std::cout << tags::yellow_bold
+                      << "Warning: Untyped number literal "
+                      << "at " << what.file() << ":"
+                      << what.line << ".\n"
+                      << tags::reset;
+            to_bitshifts(number);
+        }
+
+        if (what.state == numerical_state)
+        {
+            number = what;
+            has_number = true;
+            return;
+        }
+
+        to_bitshifts(what);
+    }
+
+    void to_bitshifts(const Token &what)
+    {
+        held.push_back(what);
+        drain_bitshifts(false);
+    }
+
+    // Passes on the front of `held` to the next stage
+    void pop_held()
+    {
+        to_strings(held.front());
+        held.pop_front();
+        scanned = 0;
+        depth = 1;
+    }
+
+    // Passes on all of `held` which can no longer change. If
+    // final, there are no more tokens to wait for.
+    void drain_bitshifts(const bool &is_final)
+    {
+        while (!held.empty())
+        {
+            if (held.size() == 1 && !is_final &&
+                (held.front() == "<" || held.front() == ">"))
+            {
+                return;
+            }
 
-std::list<Token> Lexer::lex_list(const std::string &What,
-                                 const std::string &filepath)
+            if (held.front() == "<")
+            {
+                // Scan for the end of a template, resuming
+                // where the last scan stopped
+                bool is_decided = false, is_templating = false;
+                for (; scanned < held.size(); scanned++)
+                {
+                    const std::string &cur = held[scanned].text;
+                    if (cur == ";" || cur == ")")
+                    {
+                        is_decided = true;
+                        break;
+                    }
+                    else if (cur == ">")
+                    {
+                        depth--;
+                        if (depth == 0)
+                        {
+                            is_decided = is_templating = true;
+                            break;
+                        }
+                    }
+                    else if (cur == "<")
+                    {
+                        depth++;
+                    }
+                }
+
+                if (!is_decided && !is_final)
+                {
+                    return;
+                }
+                else if (is_templating)
+                {
+                    // Pass on the whole template unchanged
+                    for (size_t i = scanned; i > 0; i--)
+                    {
+                        to_strings(held.front());
+                        held.pop_front();
+                    }
+                    pop_held();
+                    continue;
+                }
+
+                scanned = 0;
+                depth = 1;
+                if (held.size() > 1 && held[1] == "<")
+                {
+                    held.pop_front();
+                    held.front().text = "<<";
+                    held.front().state = operator_state;
+                }
+            }
+            else if (held.front() == ">" && held.size() > 1 &&
+                     held[1] == ">")
+            {
+                held.pop_front();
+                held.front().text = ">>";
+                held.front().state = operator_state;
+            }
+
+            pop_held();
+        }
+    }
+
+    void to_strings(const Token &what)
+    {
+        if ((what.state == string_literal_state_single ||
+             what.state == string_literal_state_double) &&
+            !out.empty() && out.back().state == what.state)
+        {
+            const std::string &prev = out.back().text;
+            out.back().text = prev.substr(0, prev.size() - 1) +
+                              what.text.substr(1);
+            return;
+        }
+
+        out.push_back(what);
+    }
+
+    const static std::set<std::string> NUMBER_SUFFIXES;
+
+    TokenList &out;
+
+    // Comments
+    int comment_depth = 0;
+    bool in_line_comment = false;
+
+    // Namespaces; The last token, which a `::` may extend
+    Token last;
+    bool has_last = false, join_next = false;
+
+    // Numbers; One which later tokens may extend
+    Token number;
+    bool has_number = false;
+
+    // Bitshifts; Tokens from a `<` or `>` which cannot yet be
+    // passed on, and how far the search for the end of a
+    // template starting at the front has gotten
+    std::deque<Token> held;
+    size_t scanned = 0;
+    int depth = 1;
+};
+
+const std::set<std::string> TokenPipeline::NUMBER_SUFFIXES = {
+    "u8",  "u16", "u32", "u64", "u128", "i8",
+    "i16", "i32", "i64", "i128", "f32", "f64"};
+
+TokenList Lexer::lex_list(const std::string_view &What,
+                          const std::string &filepath)
+{
+    if (filepath != "")
+    {
+        cur_file = intern_file(filepath);
+    }
+
+    // Lexed in place, rather than copied
+    pos = 0;
+    line = 1;
+    text = What;
+
+    TokenList out;
+    TokenPipeline pipeline(out);
+
+    while (!done())
+    {
+        skip_dropped(pipeline.is_in_line_comment(),
+                     pipeline.is_in_block_comment());
+        pipeline.push(single());
+    }
+    pipeline.finish();
+
+    return out;
+}
+
+TokenList
+Lexer::lex_list_multipass(const std::string_view &What,
+                          const std::string &filepath)
 {
     if (filepath != "")
     {
-        cur_file = filepath;
+        cur_file = intern_file(filepath);
     }
 
-    str(What);
+    pos = 0;
+    line = 1;
+    text = What;
 
-    std::list<Token> out;
+    TokenList out;
 
     while (!done())
     {
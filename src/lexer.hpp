@@ -27,7 +27,9 @@ jdehmel@outlook.com
 
 #include <limits.h>
 #include <list>
+#include <ostream>
 #include <string>
+#include <string_view>
 
 /*
 States for use in the lexer DFA later on.
@@ -54,31 +56,305 @@ enum LexerState
 Stats about the states above. Also for use with the DFA later.
 */
 const static int number_states = whitespace_state + 1;
-const static int number_chars = UCHAR_MAX;
+const static int number_chars = UCHAR_MAX + 1;
+
+/*
+How the lexer finds the ends of whitespace, comments and string
+literals. `scan_none` steps the DFA over every byte, and is the
+reference which the others must match. The rest skip ahead
+using the given instruction set. The best mode which this
+machine supports is used unless another is set.
+*/
+enum LexerScanMode
+{
+    scan_none = 0,
+    scan_scalar,
+    scan_sse2,
+    scan_avx2,
+};
+
+/*
+Sets the scan mode of all lexers. Returns false, changing
+nothing, if this machine does not support the given mode.
+*/
+bool set_scan_mode(const LexerScanMode &to);
+
+/*
+Returns the scan mode in use.
+*/
+LexerScanMode get_scan_mode();
+
+/*
+Returns the ID of the given file path. Tokens store this in
+place of their own copy of the path. IDs are stable for the
+life of the process, and 0 is "NULL". Paths are never freed;
+A compile server's own process only interns while warming up,
+and each request interns in a forked process of its own.
+*/
+unsigned int intern_file(const std::string &filepath);
+
+/*
+Returns the file path with the given ID.
+*/
+const std::string &file_name(const unsigned int &id);
+
+/*
+Returns the text of the given source file, with a newline added
+if it does not already end in one. Files are mapped read-only
+and cached for the life of the process by canonical path, so
+loading one again costs only a check of its modification time
+and size. The text stays valid until the file is loaded again
+after changing.
+*/
+std::string_view load_source(const std::string &filepath);
+
+/*
+Sets whether `load_source` may map files. A mapped file which
+is truncated raises `SIGBUS` when its text is next read, so a
+process which outlives the files it loaded (such as a compile
+server) copies them instead. Files already loaded are kept as
+they are.
+*/
+void set_source_mapping(const bool &enabled);
+
+/*
+Returns the shared copy of the given token text. Equal texts
+share one copy, which is kept for the life of the process, so
+tokens may refer to it instead of owning their own. As with
+`intern_file`, a compile server only interns while warming up.
+*/
+const std::string &intern_text(const std::string_view &text);
+
+/*
+The text of a token, as a pointer to its interned copy. Acts as
+a constant string; Changing it interns the new text. Two texts
+are equal iff they point to the same copy.
+*/
+class TokenText
+{
+  public:
+    TokenText() noexcept : str(&intern_text(""))
+    {
+    }
+
+    explicit TokenText(const std::string_view &other)
+        : str(&intern_text(other))
+    {
+    }
+
+    TokenText(const std::string &other)
+        : str(&intern_text(other))
+    {
+    }
+
+    TokenText(const char *const other)
+        : str(&intern_text(other))
+    {
+    }
+
+    inline operator const std::string &() const noexcept
+    {
+        return *str;
+    }
+
+    inline const std::string &string() const noexcept
+    {
+        return *str;
+    }
+
+    inline TokenText &operator+=(const std::string &other)
+    {
+        str = &intern_text(*str + other);
+        return *this;
+    }
+
+    inline TokenText &operator+=(const char other)
+    {
+        str = &intern_text(*str + other);
+        return *this;
+    }
+
+    inline bool operator==(
+        const TokenText &other) const noexcept
+    {
+        return str == other.str;
+    }
+
+    inline bool operator!=(
+        const TokenText &other) const noexcept
+    {
+        return str != other.str;
+    }
+
+    inline bool operator<(const TokenText &other) const noexcept
+    {
+        return *str < *other.str;
+    }
+
+    inline bool empty() const noexcept
+    {
+        return str->empty();
+    }
+
+    inline size_t size() const noexcept
+    {
+        return str->size();
+    }
+
+    inline size_t length() const noexcept
+    {
+        return str->size();
+    }
+
+    inline const char &front() const
+    {
+        return str->front();
+    }
+
+    inline const char &back() const
+    {
+        return str->back();
+    }
+
+    inline const char &operator[](const size_t &i) const
+    {
+        return (*str)[i];
+    }
+
+    inline const char *c_str() const noexcept
+    {
+        return str->c_str();
+    }
+
+    inline std::string::const_iterator begin() const noexcept
+    {
+        return str->begin();
+    }
+
+    inline std::string::const_iterator end() const noexcept
+    {
+        return str->end();
+    }
+
+    inline std::string substr(
+        const size_t &start,
+        const size_t &n = std::string::npos) const
+    {
+        return str->substr(start, n);
+    }
+
+    template <typename T>
+    inline size_t find(const T &what,
+                       const size_t &start = 0) const
+    {
+        return str->find(what, start);
+    }
+
+    template <typename... Args>
+    inline int compare(const Args &...args) const
+    {
+        return str->compare(args...);
+    }
+
+  private:
+    const std::string *str;
+};
+
+inline bool operator==(const TokenText &a, const std::string &b)
+{
+    return a.string() == b;
+}
+
+inline bool operator==(const std::string &a, const TokenText &b)
+{
+    return a == b.string();
+}
+
+inline bool operator==(const TokenText &a, const char *const b)
+{
+    return a.string() == b;
+}
+
+inline bool operator!=(const TokenText &a, const std::string &b)
+{
+    return a.string() != b;
+}
+
+inline bool operator!=(const std::string &a, const TokenText &b)
+{
+    return a != b.string();
+}
+
+inline bool operator!=(const TokenText &a, const char *const b)
+{
+    return a.string() != b;
+}
+
+inline std::string operator+(const TokenText &a,
+                             const std::string &b)
+{
+    return a.string() + b;
+}
+
+inline std::string operator+(const std::string &a,
+                             const TokenText &b)
+{
+    return a + b.string();
+}
+
+inline std::string operator+(const TokenText &a,
+                             const char *const b)
+{
+    return a.string() + b;
+}
+
+inline std::string operator+(const char *const a,
+                             const TokenText &b)
+{
+    return a + b.string();
+}
+
+inline std::string operator+(const TokenText &a, const char b)
+{
+    return a.string() + b;
+}
+
+inline std::ostream &operator<<(std::ostream &to,
+                                const TokenText &what)
+{
+    return to << what.string();
+}
 
 /*
 A more involved token structure. Meant to be a drop-in
 replacement for strings, which were the earlier token structs.
+Cheap to copy, since its text is interned and its file is an ID.
 */
 class Token
 {
   public:
-    std::string text;
+    TokenText text;
 
     LexerState state;
     unsigned int line, pos;
-    std::string file;
+    unsigned int file_id;
 
     Token()
         : text(""), state(alpha_state), line(-1), pos(-1),
-          file("NULL")
+          file_id(0)
     {
     }
 
     Token(const std::string &other)
         : text(other), state(alpha_state), line(-1), pos(-1),
-          file("NULL")
+          file_id(0)
+    {
+    }
+
+    // The path of the file this token came from
+    inline const std::string &file() const
     {
+        return file_name(file_id);
     }
 
     // Miscellaneous string-equivalence operators
@@ -89,7 +365,7 @@ class Token
         state = other.state;
         line = other.line;
         pos = other.pos;
-        file = other.file;
+        file_id = other.file_id;
 
         return other;
     }
@@ -179,12 +455,114 @@ class Token
     }
 };
 
+/*
+Allocates token list nodes out of large contiguous slabs, so
+that lexed streams are laid out sequentially in memory rather
+than scattered across the heap. Freed nodes are recycled for
+later tokens, and slabs are never returned.
+*/
+template <typename T> class TokenAllocator
+{
+  public:
+    typedef T value_type;
+
+    TokenAllocator() noexcept = default;
+
+    template <typename U>
+    TokenAllocator(const TokenAllocator<U> &) noexcept
+    {
+    }
+
+    T *allocate(const size_t n)
+    {
+        if (n != 1)
+        {
+            return static_cast<T *>(
+                ::operator new(n * sizeof(T)));
+        }
+
+        Pool &pool = get_pool();
+        Slot *out = pool.free_list;
+
+        if (out != nullptr)
+        {
+            pool.free_list = out->next;
+        }
+        else
+        {
+            if (pool.next == pool.end)
+            {
+                pool.next = static_cast<Slot *>(
+                    ::operator new(SLAB_SIZE * sizeof(Slot)));
+                pool.end = pool.next + SLAB_SIZE;
+            }
+
+            out = pool.next++;
+        }
+
+        return reinterpret_cast<T *>(out);
+    }
+
+    void deallocate(T *const p, const size_t n) noexcept
+    {
+        if (n != 1)
+        {
+            ::operator delete(p);
+            return;
+        }
+
+        Pool &pool = get_pool();
+        Slot *slot = reinterpret_cast<Slot *>(p);
+        slot->next = pool.free_list;
+        pool.free_list = slot;
+    }
+
+    template <typename U>
+    bool operator==(const TokenAllocator<U> &) const noexcept
+    {
+        return true;
+    }
+
+    template <typename U>
+    bool operator!=(const TokenAllocator<U> &) const noexcept
+    {
+        return false;
+    }
+
+  private:
+    const static size_t SLAB_SIZE = 256;
+
+    union Slot
+    {
+        Slot *next;
+        alignas(T) unsigned char data[sizeof(T)];
+    };
+
+    struct Pool
+    {
+        Slot *free_list = nullptr;
+        Slot *next = nullptr, *end = nullptr;
+    };
+
+    // One pool per thread, so that no locking is needed
+    static Pool &get_pool() noexcept
+    {
+        static thread_local Pool pool;
+        return pool;
+    }
+};
+
+// A stream of tokens, as passed throughout the front end. Its
+// nodes come from a pool, but it is still a linked list: Its
+// iterators step from node to node.
+typedef std::list<Token, TokenAllocator<Token>> TokenList;
+
 /*
 Erase all in-line comments (beginning with '// ') and multi-line
 comments (such as this one) from an Oak token stream. This is
 in-place.
 */
-void erase_comments(std::list<Token> &what);
+void erase_comments(TokenList &what);
 
 /*
 Erase all whitespace tokens from an Oak token stream. This is
@@ -192,20 +570,47 @@ specifically anything tagged by the lexer as whitespace. This
 is spaces, tabs, and newlines (as well as any conglomerations of
 these).
 */
-void erase_whitespace(std::list<Token> &what);
+void erase_whitespace(TokenList &what);
+
+/*
+Join each run of numerical tokens, and any type suffix after it,
+into a single token. Warns of numbers without type suffixes.
+*/
+void join_numbers(TokenList &what);
+
+/*
+Applies the namespace rule, where '::' becomes '_'.
+*/
+void join_namespaces(TokenList &what);
+
+/*
+Joins successive string literals together. Assumes that
+whitespace is no longer present.
+*/
+void join_strings(TokenList &what);
+
+/*
+Joins '<' '<' and '>' '>' into bitshift operators, except where
+they close templates.
+*/
+void join_bitshifts(TokenList &what);
+
+/*
+Returns the state which the lexer DFA moves to from the given
+state on the given byte. The table is built at compile time.
+*/
+LexerState lexer_transition(const LexerState &from,
+                            const unsigned char &c);
 
 /*
-Takes a text, yields a token stream. Uses a global static DFA,
-which is compiled and cleaned up by the first instance. Thus,
-this instance should live as long as the compiler to avoid
-unnecessary re-initializations.
+Takes a text, yields a token stream. All instances share a
+single DFA table, built at compile time, so they are costless to
+construct.
 */
 class Lexer
 {
   public:
-    // If this is the first instance, compile (and delete) DFA
     Lexer();
-    ~Lexer();
 
     // Load from a string
     void str(const std::string &from) noexcept;
@@ -218,10 +623,10 @@ class Lexer
              const std::string &filepath) noexcept;
 
     // Load a full token stream from a given string
-    std::list<Token> str_all(const std::string &from) noexcept;
+    TokenList str_all(const std::string &from) noexcept;
 
     // Load a full token stream from a given string (w/ file)
-    std::list<Token> str_all(
+    TokenList str_all(
         const std::string &from,
         const std::string &filepath) noexcept;
 
@@ -231,23 +636,36 @@ class Lexer
     // Returns true when exhausted
     bool done() const noexcept;
 
-    // std::vector<Token> lex(const std::string &What, const
-    // std::string &filepath = "");
-    std::list<Token> lex_list(const std::string &What,
-                              const std::string &filepath = "");
+    // Lex the given text into final tokens: Comments and
+    // whitespace are dropped, and numbers, namespaces, strings
+    // and bitshifts are joined as each token is lexed.
+    TokenList lex_list(const std::string_view &What,
+                       const std::string &filepath = "");
+
+    // Equivalent to `lex_list`, but lexes the whole text before
+    // applying each of the above as a pass of its own. Kept as
+    // a reference for testing and benchmarking.
+    TokenList
+    lex_list_multipass(const std::string_view &What,
+                       const std::string &filepath = "");
 
   private:
-    // Text handling members
-    std::string text, memory, cur_file;
+    // Skips ahead over tokens which `lex_list` would drop:
+    // Whitespace, or the body of the comment it is in. Only
+    // ever stops where the DFA would have started a token.
+    void skip_dropped(const bool &in_line_comment,
+                      const bool &in_block_comment);
+
+    // Text handling members. `text` views either `memory` or
+    // text owned by the caller.
+    std::string_view text;
+    std::string memory;
+    unsigned int cur_file;
     unsigned long long pos;
     int line;
 
     // DFA handling members
-    bool is_responsible = false;
     LexerState state;
-
-    static bool is_initialized;
-    static LexerState **dfa;
 };
 
 #endif
@@ -0,0 +1,288 @@
+/*
+Build manifests. After each build, acorn records in `.oak_build`
+the stamps of every file it read, the hashes of the `C` it
+generated and the times of everything it wrote. A later build of
+the same output can then skip itself entirely if no input has
+changed, or skip compiling any `C` file which came out
+byte-identical.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "oakc_fns.hpp"
+#include "oakc_structs.hpp"
+#include "options.hpp"
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+// Identifies a manifest file, and the version of its format.
+const static std::string MANIFEST_HEADER = "oak_manifest 1";
+
+// Returns the path of the manifest for the given output.
+static std::string getManifestPath(const std::string &Name)
+{
+    return COMPILED_PATH + purifyStr(Name) + ".manifest";
+}
+
+std::string getBuildKey(const std::vector<std::string> &args)
+{
+    std::string key = VERSION + '\0' +
+                      std::to_string(getCompilerStamp()) +
+                      '\0' + fs::current_path().string();
+
+    for (size_t i = 0; i < args.size(); i++)
+    {
+        // The number of jobs does not change the output
+        if ((args[i] == "--jobs" || args[i] == "-j") &&
+            i + 1 < args.size())
+        {
+            i++;
+            continue;
+        }
+
+        key += '\0' + args[i];
+    }
+
+    return hashString(key);
+}
+
+BuildManifest loadManifest(const std::string &Name)
+{
+    BuildManifest out;
+
+    std::ifstream file(getManifestPath(Name));
+    std::string line;
+    if (!file.is_open() || !getline(file, line) ||
+        line != MANIFEST_HEADER)
+    {
+        return out;
+    }
+
+    // Each line is a kind, then its fields. Paths come last, as
+    // they may contain spaces.
+    while (getline(file, line))
+    {
+        std::stringstream fields(line);
+        std::string kind, path;
+        fields >> kind;
+
+        if (kind == "key")
+        {
+            fields >> out.key;
+        }
+        else if (kind == "input")
+        {
+            std::pair<long long, unsigned long long> stamp;
+            fields >> stamp.first >> stamp.second;
+            fields.get();
+            getline(fields, path);
+            out.inputs[path] = stamp;
+        }
+        else if (kind == "package")
+        {
+            std::string name;
+            fields >> name;
+            fields.get();
+            getline(fields, out.packages[name]);
+        }
+        else if (kind == "cflag")
+        {
+            fields.get();
+            getline(fields, path);
+            out.cflags.insert(path);
+        }
+        else if (kind == "source")
+        {
+            std::string hash;
+            fields >> hash;
+            fields.get();
+            getline(fields, path);
+            out.sources[path] = hash;
+        }
+        else if (kind == "output")
+        {
+            long long time;
+            fields >> time;
+            fields.get();
+            getline(fields, path);
+            out.outputs[path] = time;
+        }
+        else if (kind == "link")
+        {
+            fields >> out.link;
+        }
+
+        if (fields.fail())
+        {
+            // Malformed, so trust none of it
+            return BuildManifest();
+        }
+    }
+
+    return out;
+}
+
+void saveManifest(const std::string &Name,
+                  const BuildManifest &manifest)
+{
+    fs::create_directory(COMPILED_PATH);
+
+    std::string path = getManifestPath(Name);
+    std::string temp = path + "." + std::to_string(getpid());
+
+    std::ofstream file(temp);
+    if (!file.is_open())
+    {
+        return;
+    }
+
+    file << MANIFEST_HEADER << '\n';
+
+    if (manifest.key != "")
+    {
+        file << "key " << manifest.key << '\n';
+    }
+
+    for (const auto &p : manifest.inputs)
+    {
+        file << "input " << p.second.first << ' '
+             << p.second.second << ' ' << p.first << '\n';
+    }
+
+    for (const auto &p : manifest.packages)
+    {
+        file << "package " << p.first << ' ' << p.second
+             << '\n';
+    }
+
+    for (const auto &flag : manifest.cflags)
+    {
+        file << "cflag " << flag << '\n';
+    }
+
+    for (const auto &p : manifest.sources)
+    {
+        file << "source " << p.second << ' ' << p.first << '\n';
+    }
+
+    for (const auto &p : manifest.outputs)
+    {
+        file << "output " << p.second << ' ' << p.first << '\n';
+    }
+
+    if (manifest.link != "")
+    {
+        file << "link " << manifest.link << '\n';
+    }
+
+    file.close();
+    fs::rename(temp, path);
+}
+
+bool isOutputUnchanged(const BuildManifest &manifest,
+                       const std::string &path)
+{
+    auto it = manifest.outputs.find(path);
+    return it != manifest.outputs.end() &&
+           fs::exists(path) &&
+           getFileStamp(path).first == it->second;
+}
+
+bool isUpToDate(const BuildManifest &manifest,
+                const std::string &key)
+{
+    if (manifest.key == "" || manifest.key != key ||
+        manifest.outputs.empty())
+    {
+        return false;
+    }
+
+    for (const auto &p : manifest.inputs)
+    {
+        if (getFileStamp(p.first) != p.second)
+        {
+            return false;
+        }
+    }
+
+    for (const auto &p : manifest.outputs)
+    {
+        if (!isOutputUnchanged(manifest, p.first))
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+void addBuildOutput(BuildManifest &manifest,
+                    const std::string &path)
+{
+    if (fs::exists(path))
+    {
+        manifest.outputs[path] = getFileStamp(path).first;
+    }
+}
+
+void addBuildInputs(BuildManifest &manifest,
+                    const std::vector<std::string> &args,
+                    AcornSettings &settings)
+{
+    std::set<std::string> paths;
+
+    // Source files, and anything else named on the command line
+    // (such as dialect files)
+    for (const auto &p : settings.visitedFiles)
+    {
+        paths.insert(p.first.string());
+    }
+
+    for (const auto &arg : args)
+    {
+        if (fs::is_regular_file(arg) &&
+            manifest.outputs.count(arg) == 0)
+        {
+            paths.insert(fs::absolute(arg).string());
+        }
+    }
+
+    paths.insert(OAK_HEADER_PATH);
+
+    for (const auto &p : settings.packages)
+    {
+        paths.insert(PACKAGE_INCLUDE_PATH + p.first + "/" +
+                     INFO_FILE);
+        manifest.packages[p.first] = p.second.version;
+    }
+
+    // Objects from outside the build folder
+    for (const auto &object : settings.objects)
+    {
+        if (object.compare(0, COMPILED_PATH.size(),
+                           COMPILED_PATH) != 0 &&
+            fs::exists(object))
+        {
+            paths.insert(object);
+        }
+    }
+
+    for (const auto &path : paths)
+    {
+        if (fs::exists(path))
+        {
+            manifest.inputs[path] = getFileStamp(path);
+        }
+    }
+
+    manifest.cflags = settings.cflags;
+
+    // The outputs of impure macros may change while their
+    // inputs do not, so such builds must always be redone
+    if (settings.impureMacroCalled)
+    {
+        manifest.key = "";
+    }
+}
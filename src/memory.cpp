@@ -0,0 +1,238 @@
+/*
+The memory report behind `acorn --memory`. The peak resident set
+size is sampled at the start and end of each phase (see
+`beginTrace`), and the sizes of the compiler's tables and caches
+are counted once compilation is over.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "oakc_fns.hpp"
+#include "oakc_structs.hpp"
+#include "options.hpp"
+#include "tags.hpp"
+#include <algorithm>
+#include <fstream>
+#include <iomanip>
+#include <sys/resource.h>
+
+// The number of rows to print of the longer tables. All of them
+// are saved.
+const static size_t MEMORY_TABLE_ROWS = 10;
+
+long long getPeakKb()
+{
+    rusage usage;
+    if (getrusage(RUSAGE_SELF, &usage) != 0)
+    {
+        return 0;
+    }
+
+#if defined(__APPLE__)
+    // Given in bytes, rather than KB
+    return usage.ru_maxrss / 1024;
+#else
+    return usage.ru_maxrss;
+#endif
+}
+
+unsigned long long countNodes(const ASTNode &what)
+{
+    unsigned long long out = 1;
+    for (const auto &child : what.items)
+    {
+        out += countNodes(child);
+    }
+
+    return out;
+}
+
+// Returns the given counts, largest first, breaking ties by
+// name.
+static std::vector<std::pair<std::string, unsigned long long>>
+sortCounts(
+    const std::map<std::string, unsigned long long> &counts)
+{
+    std::vector<std::pair<std::string, unsigned long long>> out(
+        counts.begin(), counts.end());
+    std::stable_sort(out.begin(), out.end(),
+                     [](const auto &a, const auto &b)
+                     { return a.second > b.second; });
+    return out;
+}
+
+// Prints a row of the memory report.
+static void printRow(const std::string &name,
+                     const std::vector<std::string> &values)
+{
+    std::cout << "\t" << std::left << std::setw(36) << name
+              << std::right;
+    for (const auto &value : values)
+    {
+        std::cout << std::setw(14) << value;
+    }
+    std::cout << '\n';
+}
+
+// Prints the largest of the given counts, and saves all of them
+// as a JSON array of objects.
+static void reportCounts(
+    const std::string &title, const std::string &key,
+    const std::map<std::string, unsigned long long> &counts,
+    std::ofstream &json)
+{
+    const auto sorted = sortCounts(counts);
+
+    std::cout << title << " (" << sorted.size() << "):\n";
+    for (size_t i = 0;
+         i < sorted.size() && i < MEMORY_TABLE_ROWS; i++)
+    {
+        printRow(sorted[i].first,
+                 {std::to_string(sorted[i].second)});
+    }
+
+    json << "  \"" << key << "\": [";
+    for (size_t i = 0; i < sorted.size(); i++)
+    {
+        json << (i == 0 ? "\n" : ",\n") << "    {\"name\": "
+             << toJsonString(sorted[i].first)
+             << ", \"count\": " << sorted[i].second << "}";
+    }
+    json << "\n  ],\n";
+}
+
+void reportMemory(const AcornSettings &settings)
+{
+    if (settings.memoryPath == "")
+    {
+        return;
+    }
+
+    // The table is still worth printing if this fails
+    std::ofstream json(settings.memoryPath);
+    if (!json.is_open())
+    {
+        std::cout << tags::yellow_bold
+                  << "Warning: Failed to save memory report '"
+                  << settings.memoryPath << "'\n"
+                  << tags::reset;
+    }
+
+    const long long peakKb = getPeakKb();
+    std::cout << tags::violet_bold << "\nMemory report\n"
+              << tags::reset << "Peak resident set size: "
+              << peakKb << " KB\n";
+    json << "{\n  \"peak_rss_kb\": " << peakKb << ",\n";
+
+    // Phases
+    std::cout << "By phase:\n";
+    printRow("", {"calls", "peak KB", "raised KB"});
+    json << "  \"phases\": [";
+    bool isFirst = true;
+    for (const auto &p : settings.phaseMemory)
+    {
+        printRow(p.first, {std::to_string(p.second.calls),
+                           std::to_string(p.second.peakKb),
+                           std::to_string(p.second.growthKb)});
+        json << (isFirst ? "\n" : ",\n") << "    {\"name\": "
+             << toJsonString(p.first)
+             << ", \"calls\": " << p.second.calls
+             << ", \"peak_rss_kb\": " << p.second.peakKb
+             << ", \"growth_kb\": " << p.second.growthKb << "}";
+        isFirst = false;
+    }
+    json << "\n  ],\n";
+
+    // Files
+    std::cout << "By file:\n";
+    printRow("", {"tokens", "AST nodes"});
+    json << "  \"files\": [";
+    isFirst = true;
+    for (const auto &p : settings.fileMemory)
+    {
+        printRow(p.first, {std::to_string(p.second.tokens),
+                           std::to_string(p.second.nodes)});
+        json << (isFirst ? "\n" : ",\n") << "    {\"file\": "
+             << toJsonString(p.first)
+             << ", \"tokens\": " << p.second.tokens
+             << ", \"ast_nodes\": " << p.second.nodes << "}";
+        isFirst = false;
+    }
+    json << "\n  ],\n";
+
+    // Symbol table
+    unsigned long long entries = 0, nodes = 0;
+    std::map<std::string, unsigned long long> overloads;
+    for (const auto &p : settings.table)
+    {
+        entries += p.second.size();
+        overloads[p.first] = p.second.size();
+        for (const auto &symb : p.second)
+        {
+            nodes += countNodes(symb.seq);
+        }
+    }
+
+    std::cout << "Symbol table:\n";
+    printRow("names", {std::to_string(settings.table.size())});
+    printRow("entries", {std::to_string(entries)});
+    printRow("AST nodes", {std::to_string(nodes)});
+    json << "  \"symbol_names\": " << settings.table.size()
+         << ",\n  \"symbol_entries\": " << entries
+         << ",\n  \"symbol_ast_nodes\": " << nodes << ",\n";
+    reportCounts("Overloads per name", "overloads", overloads,
+                 json);
+
+    // Generics
+    unsigned long long templates = 0, instances = 0;
+    std::map<std::string, unsigned long long> byTemplate;
+    for (const auto &p : settings.generics)
+    {
+        templates += p.second.size();
+        for (const auto &info : p.second)
+        {
+            instances += info.instances.size();
+            byTemplate[p.first] += info.instances.size();
+        }
+    }
+
+    std::cout << "Generics:\n";
+    printRow("templates", {std::to_string(templates)});
+    printRow("instances", {std::to_string(instances)});
+    json << "  \"generic_templates\": " << templates
+         << ",\n  \"generic_instances\": " << instances
+         << ",\n";
+    reportCounts("Instances per template", "instances",
+                 byTemplate, json);
+
+    // Caches, by entries
+    const std::map<std::string, unsigned long long> caches = {
+        {"toStrCTypeCache", settings.toStrCTypeCache.size()},
+        {"toStrCEnumCache", settings.toStrCEnumCache.size()},
+        {"getArgs cache", settings.cache.size()},
+        {"getReturnTypeCache",
+         settings.getReturnTypeCache.size()},
+        {"ageCache", settings.ageCache.size()},
+        {"overloads", settings.overloads.size()},
+        {"macroMemo", settings.macroMemo.size()}};
+    reportCounts("Cache entries", "caches", caches, json);
+
+    // Macros
+    unsigned long long memoBytes = 0;
+    for (const auto &p : settings.macroMemo)
+    {
+        memoBytes += p.first.size() + p.second.size();
+    }
+
+    std::cout << "Macros:\n";
+    printRow("calls", {std::to_string(settings.macroCalls)});
+    printRow("output bytes",
+             {std::to_string(settings.macroOutputBytes)});
+    printRow("memo bytes", {std::to_string(memoBytes)});
+    json << "  \"macro_calls\": " << settings.macroCalls
+         << ",\n  \"macro_output_bytes\": "
+         << settings.macroOutputBytes
+         << ",\n  \"macro_memo_bytes\": " << memoBytes
+         << "\n}\n";
+}
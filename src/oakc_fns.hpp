@@ -32,34 +32,144 @@ jdehmel@outlook.com
 // Runs in O(offset), unfortunately, so only use for small
 // offsets. If it is too close to the beginning or end of
 // `inside`, will return false,
-bool itCmp(const std::list<Token> &inside,
-           const std::list<Token>::iterator &it,
+bool itCmp(const TokenList &inside,
+           const TokenList::iterator &it,
            const int &offset, const Token &compareTo) noexcept;
-bool itCmp(const std::list<Token> &inside,
-           const std::list<Token>::iterator &it,
+bool itCmp(const TokenList &inside,
+           const TokenList::iterator &it,
            const int &offset,
            const std::string &compareTo) noexcept;
 
-bool itCmp(const std::list<Token> &inside,
-           const std::list<Token>::const_iterator &it,
+bool itCmp(const TokenList &inside,
+           const TokenList::const_iterator &it,
            const int &offset,
            const std::string &compareTo) noexcept;
 
 // Returns true if the given iterator is in range.
-bool itIsInRange(const std::list<Token> &inside,
-                 const std::list<Token>::iterator &it,
+bool itIsInRange(const TokenList &inside,
+                 const TokenList::iterator &it,
                  const int &offset) noexcept;
 
 // Returns the token at the given offset, or a null token if
 // it is out of range.
-Token itGet(const std::list<Token> &inside,
-            const std::list<Token>::iterator &it,
+Token itGet(const TokenList &inside,
+            const TokenList::iterator &it,
             const int &offset) noexcept;
 
 // Execute a given command and return the printed result.
 // Throws a runtime error if the return value is not 0.
 std::string execute(const std::string &command);
 
+// Returns the number of jobs to run at once; One per hardware
+// thread unless otherwise specified.
+unsigned int getJobCount(const AcornSettings &settings);
+
+// USES SYSTEM CALLS. Runs each of the given commands, up to
+// `settings.jobs` at once, tracing each. Returns true iff all
+// of them succeeded.
+bool systemAll(const std::vector<std::string> &commands,
+               AcornSettings &settings);
+
+// USES SYSTEM CALLS. Compiles each of the given test files (and
+// runs it, if `settings.execute`) in a build directory of its
+// own, up to `settings.jobs` at once, printing each result as
+// it arrives. A test which passed in the same mode last time
+// is skipped if its inputs are unchanged. If
+// `settings.testFail`, no more tests are started after one
+// fails. Returns the results of the tests which ran or were
+// skipped, in order.
+std::vector<TestResult> runTests(
+    const std::vector<std::string> &tests,
+    AcornSettings &settings);
+
+// Returns the build directory of the given test.
+std::string getTestDir(const std::string &test);
+
+// Returns the arguments with which to compile the given test,
+// when `workers` tests are compiled at once. Each gets an equal
+// share of the jobs in `settings`.
+std::vector<std::string> getTestArgs(
+    const std::string &test, const size_t &workers,
+    const AcornSettings &settings);
+
+// Returns true if the given test passed in the same mode last
+// time, and nothing it was built from has changed since. Must
+// be given the arguments it would be compiled with.
+bool isTestCurrent(const std::string &test,
+                   const std::vector<std::string> &args,
+                   const std::string &mode);
+
+// Returns the given string as a JSON string literal.
+std::string toJsonString(const std::string &what);
+
+// Saves the given test results, and the total time they took,
+// as JSON.
+void saveTestReport(const std::vector<TestResult> &results,
+                    const unsigned long long &wallMs,
+                    const std::string &path);
+
+// Saves the output of each of the given tests, in order.
+void saveTestLog(const std::vector<TestResult> &results,
+                 const std::string &path);
+
+// Returns the microseconds since `settings` was created.
+unsigned long long getTraceTime(const AcornSettings &settings);
+
+// Opens a span of the given name in the `--trace` output, which
+// lasts until the matching call to `endTrace`. Spans nest. The
+// memory report is kept by spans of the "phase" category. Does
+// nothing unless tracing or reporting memory.
+void beginTrace(const std::string &name,
+                const std::string &category,
+                AcornSettings &settings);
+
+// Closes the innermost open span, if any.
+void endTrace(AcornSettings &settings);
+
+// Records a span which ran from `start` to `end` (as given by
+// `getTraceTime`). Work done by other threads must use lanes
+// other than 0, as the spans on each lane must nest.
+void addTrace(const std::string &name,
+              const std::string &category,
+              const unsigned long long &start,
+              const unsigned long long &end,
+              const unsigned int &lane,
+              AcornSettings &settings);
+
+// Saves the trace, if one was requested, closing any spans
+// which are still open. Only warns on failure.
+void saveTrace(AcornSettings &settings);
+
+// A span which lasts as long as this object does. Closes any
+// spans opened within it which are still open, such as when an
+// exception skips their `endTrace`.
+class TraceSpan
+{
+  public:
+    TraceSpan(const std::string &name,
+              const std::string &category,
+              AcornSettings &settings);
+    ~TraceSpan();
+
+  private:
+    AcornSettings &settings;
+    size_t depth;
+};
+
+// Returns the peak resident set size of this process so far,
+// in KB.
+long long getPeakKb();
+
+// Returns the number of nodes in the given AST.
+unsigned long long countNodes(const ASTNode &what);
+
+// Prints where memory went during compilation: The peak
+// resident set size after each phase, the size of each file,
+// the symbol table, generic instances, caches and macro
+// outputs. Also saves all of it as JSON. Does nothing unless
+// `settings.memoryPath` is set.
+void reportMemory(const AcornSettings &settings);
+
 // Prints the cumulative disk usage of Oak (human-readable).
 void getDiskUsage();
 
@@ -69,6 +179,13 @@ void getDiskUsage();
 void doFile(const std::string &filepath,
             AcornSettings &settings);
 
+// Replaces each preprocessor definition in the given tokens
+// with its value, including any definitions within that value.
+// Each definition is lexed only once. Throws a sequencing_error
+// upon an unknown definition.
+void insertDefinitions(TokenList &lexed,
+                       AcornSettings &settings);
+
 // Creates a factory-settings package with the given name in the
 // current directory. Sets up everything you need.
 void makePackage(const std::string &name);
@@ -77,7 +194,8 @@ void makePackage(const std::string &name);
 // syntactical requirements (IE line width limits, matching
 // parenthesis). If fatal, does not allow recovery. Otherwise,
 // does.
-void ensureSyntax(const std::string &text, const bool &fatal,
+void ensureSyntax(const std::string_view &text,
+                  const bool &fatal,
                   const std::string &curFile);
 
 // Generate a single `.md` file from the given file(s). Saves at
@@ -96,12 +214,12 @@ std::string instantiateGeneric(
 
 // Also holds the skeleton of the inst block system, although
 // gathering of these happens elsewhere.
-void addGeneric(const std::list<Token> &what,
+void addGeneric(const TokenList &what,
                 const std::string &name,
                 const std::list<std::string> &genericsList,
                 const std::list<std::string> &typeVec,
-                const std::list<Token> &preBlock,
-                const std::list<Token> &postBlock,
+                const TokenList &preBlock,
+                const TokenList &postBlock,
                 AcornSettings &settings);
 
 // Print the info of all existing generics to a file stream
@@ -110,7 +228,11 @@ void printGenericDumpInfo(std::ostream &file,
 
 // USES SYSTEM CALLS. Ensures a given macro exists, then calls
 // it with the given arguments. If debug is true, specifies such
-// in the call.
+// in the call. Macros are called via their shared object in a
+// forked child when possible, falling back on running their
+// executable otherwise. Results are memoized (in memory and in
+// the macro cache) unless the macro's file has the
+// `impure_macros` tag.
 std::string callMacro(const std::string &Name,
                       const std::list<std::string> &Args,
                       AcornSettings &settings);
@@ -119,15 +241,49 @@ std::string callMacro(const std::string &Name,
 // not yet compiled, calls another instance of the compiler on
 // its contents. Note: The sub-instance of the compiler runs in
 // a special macro-compilation mode which inhibits its outputs
-// and syntax constraints.
+// and syntax constraints, and which also links a shared object
+// for in-process calls where possible.
 void compileMacro(const std::string &Name,
                   AcornSettings &settings);
 
+// USES SYSTEM CALLS. Compiles the given macros, along with any
+// others they call, running up to `settings.jobs` nested
+// compilers at once. A macro is only built after all the others
+// it calls have been.
+void compileMacros(const std::set<std::string> &Names,
+                   AcornSettings &settings);
+
+// Returns the user-level directory in which compiled macros are
+// cached, or "" if there is none.
+std::string getMacroCachePath();
+
+// Returns the name under which the given macro is cached. This
+// is a hash of its source code and of the compiler which builds
+// it. The files its build includes are not known until it is
+// built, so each entry also lists their stamps, and is only
+// used while none of them have changed.
+std::string getMacroCacheKey(const std::string &Name,
+                             AcornSettings &settings);
+
 // Returns the given file's last modification time, in seconds
 // after the epoch.
 long long getFileLastModification(const std::string &filepath,
                                   AcornSettings &settings);
 
+// Returns the given file's last modification time and size, or
+// zeros if it does not exist. A file whose stamp is unchanged
+// is assumed to be unchanged.
+std::pair<long long, unsigned long long> getFileStamp(
+    const std::string &path);
+
+// Identifies the running compiler, so that rebuilding it
+// invalidates everything it cached. Zero if this is unknown.
+long long getCompilerStamp();
+
+// Returns the 64-bit FNV-1a hash of the given string in hex.
+// Unlike std::hash, this is stable across builds.
+std::string hashString(const std::string &what);
+
 // Returns true if the source file is newer than the destination
 // one OR if either file is nonexistant.
 bool isSourceNewer(const std::string &source,
@@ -183,7 +339,7 @@ ASTNode getFreeSequence(const std::string &name,
 Takes entire lexed token stream. After call, no operators
 should remain.
 */
-void operatorSub(std::list<Token> &from);
+void operatorSub(TokenList &from);
 
 // Installs a given SYSTEM package; NOT an Oak one.
 void install(const std::string &what, AcornSettings &settings);
@@ -215,6 +371,96 @@ void downloadPackage(const std::string &url,
 std::list<std::string> getPackageFiles(const std::string &Name,
                                        AcornSettings &settings);
 
+// Loads the named package into `settings`, restoring its
+// snapshot if one is up to date and otherwise processing its
+// files. A package loaded into an otherwise empty state is
+// snapshotted for next time.
+void loadPackage(const std::string &Name,
+                 AcornSettings &settings);
+
+// Restores the named package's snapshot into `settings`.
+// Returns false if there is no up-to-date snapshot, or if
+// `settings` is not empty enough for it to apply.
+bool loadPackageSnapshot(const std::string &Name,
+                         AcornSettings &settings);
+
+// Reads the named package's snapshot into memory, so that the
+// next load of it in this process (or in any it forks) takes it
+// from there instead. Returns false if there is no usable
+// snapshot.
+bool keepPackageSnapshot(const std::string &Name);
+
+// Processes the given file on its own and keeps the resulting
+// state in memory, so that the next include of it into an
+// otherwise empty state in this process (or in any it forks)
+// takes it from there instead. Returns false if the file fails
+// to process, or if its state cannot be reused.
+bool keepIncludeState(const std::string &Path);
+
+// Restores the state kept for the given file into `settings`.
+// Returns false if there is none, if the file has changed, or
+// if `settings` is not empty enough for it to apply.
+bool loadIncludeState(const std::string &Path,
+                      AcornSettings &settings);
+
+// Processes an installed package from scratch and saves its
+// snapshot. Called upon install.
+void buildPackageSnapshot(const std::string &Name,
+                          AcornSettings &settings);
+
+// Returns a hash of the running compiler, the working directory
+// and the given arguments, besides the number of jobs. A
+// build's manifest is only trusted if its key matches.
+std::string getBuildKey(const std::vector<std::string> &args);
+
+// Loads the manifest of the last build of the given output.
+// Returns an empty manifest if there is none.
+BuildManifest loadManifest(const std::string &Name);
+
+// Saves the manifest of the given output into `.oak_build`.
+void saveManifest(const std::string &Name,
+                  const BuildManifest &manifest);
+
+// Returns true if the manifest recorded the given output, and
+// it has not been modified since.
+bool isOutputUnchanged(const BuildManifest &manifest,
+                       const std::string &path);
+
+// Returns true if the manifest has the given key, none of its
+// inputs have changed and all of its outputs are untouched.
+bool isUpToDate(const BuildManifest &manifest,
+                const std::string &key);
+
+// Records the given file's current modification time as an
+// output of the build.
+void addBuildOutput(BuildManifest &manifest,
+                    const std::string &path);
+
+// Records every file, package and flag the finished build
+// depended upon, besides its own outputs. Must be called after
+// they are added. Clears the key if any macro tagged
+// `impure_macros` was called.
+void addBuildInputs(BuildManifest &manifest,
+                    const std::vector<std::string> &args,
+                    AcornSettings &settings);
+
+// Returns the path of the current user's compile server socket.
+std::string getServerSocketPath();
+
+// USES SYSTEM CALLS. Warms up the compiler, then serves compile
+// requests on the given socket until killed. Each request is
+// run by calling `compile` in a process forked from the warm
+// one, with the client's arguments, working directory and
+// standard streams. Returns nonzero if it cannot serve.
+int serveCompiles(const std::string &path,
+                  int (*compile)(const int, const char *[]));
+
+// Asks the server on the given socket to compile with the given
+// arguments, as if from this process. Returns the exit status,
+// or -1 if there is no server of this exact compiler.
+int requestCompile(const std::string &path,
+                   const std::vector<std::string> &args);
+
 // Removes illegal characters.
 std::string purifyStr(const std::string &what);
 
@@ -223,6 +469,11 @@ void reconstruct(const std::string &Name,
                  AcornSettings &settings,
                  std::stringstream &body);
 
+// Returns the C definition of the entry point through which a
+// macro's shared object is called in-process. The symbol table
+// must contain the macro's `main`.
+std::string macroEntryToC(AcornSettings &settings);
+
 // Save reconstructed files and return compilation command
 // Return pair<sstream, sstream>{header, body};
 std::string save(const std::stringstream &body,
@@ -233,6 +484,16 @@ std::string save(const std::stringstream &body,
 std::string reconstructAndSave(const std::string &Name,
                                AcornSettings &settings);
 
+// Reconstruct the existing symbol table into a header of
+// structs and prototypes plus at most `Units` files of function
+// definitions, which can be compiled concurrently. Definitions
+// are grouped by source file, and the groups are balanced
+// across units by size. Returns the header path, then the
+// source paths.
+std::list<std::string> reconstructAndSaveUnits(
+    const std::string &Name, AcornSettings &settings,
+    const unsigned int &Units);
+
 // Return the C format-version of a type, to be followed by
 // symbol name.
 std::string toStrC(const Type *What, AcornSettings &settings,
@@ -257,32 +518,58 @@ std::string toStrCFunctionRef(const Type *what,
 std::string enumToC(const std::string &name,
                     AcornSettings &settings);
 
+// Return only the struct definition of an Oak `enum`.
+std::string enumTypeToC(const std::string &name,
+                        AcornSettings &settings);
+
+// Return only the constructor definitions of an Oak `enum`.
+std::string enumConstructorsToC(const std::string &name,
+                                AcornSettings &settings);
+
 // Add a new rule engine.
 void addEngine(const std::string &name,
-               void (*hook)(std::list<Token> &,
-                            std::list<Token>::iterator &,
+               void (*hook)(TokenList &,
+                            TokenList::iterator &,
                             Rule &, AcornSettings &),
                AcornSettings &settings);
 
 // `i` is the point in Lexed at which a macro name was found.
 // CONSUMPTIVE on `lexed`.
 std::list<std::string> getMacroArgs(
-    std::list<Token> &lexed, std::list<Token>::iterator &i);
+    TokenList &lexed, TokenList::iterator &i);
 
-// Does all active rules on a given token stream.
-void doRules(std::list<Token> &From, AcornSettings &settings);
+// Does all active rules on a given token stream. If
+// `macroCalls` is given, the positions of any compiler macros
+// in the rules' output are added to it, in order.
+void doRules(TokenList &From, AcornSettings &settings,
+             std::vector<TokenList::iterator> *macroCalls =
+                 nullptr);
 
 // Load a dialect file.
 void loadDialectFile(const std::string &File,
                      AcornSettings &settings);
 
-// Internal pass-through for Sapling rule engine.
-void doRuleAcorn(std::list<Token> &From,
-                 std::list<Token>::iterator &i, Rule &curRule,
-                 AcornSettings &settings);
+// Internal pass-through for Sapling rule engine. Returns true
+// iff the rule matched (and was applied) at `i`, in which case
+// `i` is the first token of the output, and the number of
+// tokens output is saved in `inserted` if given.
+bool doRuleAcorn(TokenList &From,
+                 TokenList::iterator &i, Rule &curRule,
+                 AcornSettings &settings,
+                 size_t *inserted = nullptr);
+
+// Builds the index of rules currently in effect for the current
+// file. Must be rebuilt whenever the active rules change.
+void buildRuleIndex(RuleIndex &index, AcornSettings &settings);
+
+// Returns the position in `index` of the first rule after
+// `last` which could match beginning at a token with the given
+// text, or -1 if there are none.
+int getNextRule(const RuleIndex &index, const std::string &text,
+                const int &last);
 
 // Converts lexed symbols into a type.
-Type toType(const std::list<Token> &whatIn,
+Type toType(const TokenList &whatIn,
             AcornSettings &settings);
 
 // Converts lexed symbols into a type.
@@ -316,21 +603,21 @@ void debugPrint(const ASTNode &what, int spaces = 0,
                 std::ostream &to = std::cout);
 
 // Adds an enumeration into the type symbol table.
-void addEnum(const std::list<Token> &From,
+void addEnum(const TokenList &From,
              AcornSettings &settings);
 
 // Can throw errors (IE malformed definitions)
 // Takes in the whole definition, starting at let
 // and ending after }. (Oak has no trailing semicolon)
 // Can also handle templating
-void addStruct(const std::list<Token> &From,
+void addStruct(const TokenList &From,
                AcornSettings &settings);
 
 // Dump data to file. Mostly used for debugging purposes.
-void dump(const std::list<Token> &Lexed,
+void dump(const TokenList &Lexed,
           const std::string &Where, const std::string &FileName,
           const int &Line, const ASTNode &FileSeq,
-          const std::list<Token> LexedBackup,
+          const TokenList LexedBackup,
           const std::string &ErrorMsg, AcornSettings &settings);
 
 // Get a valid constructor call for a given struct member var.
@@ -377,21 +664,60 @@ std::list<int> getReferenceCandidates(
     const std::list<std::list<Type>> &candArgs,
     const std::list<Type> &argTypes);
 
+// As above, but only considering the candidates at the given
+// indices into candArgs, which must be in increasing order.
+std::list<int> getExactCandidates(
+    const std::vector<std::list<Type>> &candArgs,
+    const std::vector<int> &among,
+    const std::list<Type> &argTypes);
+std::list<int> getCastingCandidates(
+    const std::vector<std::list<Type>> &candArgs,
+    const std::vector<int> &among,
+    const std::list<Type> &argTypes);
+std::list<int> getReferenceCandidates(
+    const std::vector<std::list<Type>> &candArgs,
+    const std::vector<int> &among,
+    const std::list<Type> &argTypes);
+
+// Returns the indexed overloads of the given name, which must
+// be in the symbol table. The index is rebuilt if the table
+// entry has changed since it was built.
+OverloadSet &getOverloads(const std::string &name,
+                          AcornSettings &settings);
+
+// Discards the indexed overloads of the given name. Must be
+// called whenever any of its entries in the table is removed or
+// modified. Additions are detected by getOverloads.
+void invalidateOverloads(const std::string &name,
+                         AcornSettings &settings);
+
 // Prints the reason why each candidate was rejected
 void printCandidateErrors(
     const std::vector<MultiTableSymbol> &candidates,
     const std::list<Type> &argTypes, const std::string &name,
     AcornSettings &settings);
 
+// If `candidate` is a bodiless operator function declared in
+// `std/atom_math.oak` on numeric or boolean atomics, writes
+// the equivalent native `C` expression to `out` and returns
+// true. `argC` holds the `C` text of each (already referenced)
+// argument. Otherwise, returns false and leaves `out` empty.
+bool getAtomicOperatorC(const std::string &name,
+                        const MultiTableSymbol &candidate,
+                        const std::list<Type> &argTypes,
+                        const std::vector<std::string> &argC,
+                        std::string &out,
+                        AcornSettings &settings);
+
 // Creates a sequence from a lexed string.
 // Return type is deduced naturally from the contents.
 // Can throw sequencing errors.
-ASTNode createSequence(const std::list<Token> &from,
+ASTNode createSequence(const TokenList &from,
                        AcornSettings &settings);
 
 // Get the return type; Set as a global
-Type resolveFunction(std::list<Token> &What,
-                     std::list<Token>::iterator &start,
+Type resolveFunction(TokenList &What,
+                     TokenList::iterator &start,
                      std::string &c, AcornSettings &settings);
 
 // Use filesystem calls to get the size in kilobytes of a given
@@ -401,15 +727,24 @@ unsigned long long int getSize(const std::string &filePath);
 // Turn the output of getSize into a human-readable string.
 std::string humanReadable(const unsigned long long int &size);
 
+// Inserts a non-function symbol into the table and records it
+// in the scope log.
+void addScopedSymbol(const std::string &name,
+                     const MultiTableSymbol &symbol,
+                     AcornSettings &settings);
+
+// Returns a marker for the current symbol scope, to later be
+// passed to closeSymbolScope.
+size_t openSymbolScope(AcornSettings &settings);
+
 /*
-Erases any non-function symbols which were not present
-in the original table. However, skips all functions.
-If not contradicted by the above rules, bases off of
-the current table (not backup).
+Erases any scoped symbols added since `marker` which do not
+share a type with a same-named symbol from before it. Functions
+are always kept. Returns the destructor calls for the erased
+symbols.
 */
 std::list<std::pair<std::string, std::string>>
-restoreSymbolTable(MultiSymbolTable &backup,
-                   MultiSymbolTable &realTable);
+closeSymbolScope(const size_t &marker, AcornSettings &settings);
 
 // Return the standard C representation of this type.
 std::string toStr(const Type *const what);
@@ -100,14 +100,40 @@ struct Rule
     std::string engineName;
 };
 
+// Match statistics for a single rule. Reported in debug mode.
+struct RuleStats
+{
+    unsigned long long attempts = 0;
+    unsigned long long matches = 0;
+};
+
+// The rules which are currently in effect, in order of
+// application, indexed by the literal token which any match
+// must begin with. Rules without a leading literal (wildcards,
+// suites, non-Sapling engines, etc) must be tried everywhere.
+struct RuleIndex
+{
+    std::vector<std::string> names;
+    std::vector<Rule *> rules;
+    std::map<std::string, std::vector<int>> byLeadingLiteral;
+    std::vector<int> wildcards;
+};
+
+// The entry point of a macro which has been compiled to a
+// shared object. Runs the macro's `main` on the given
+// arguments, printing to stdout as usual. Returns the macro's
+// exit code. Only ever called within a forked child, since
+// macros may exit.
+typedef int (*MacroEntry)(int argc, char **argv);
+
 // Info about a single generic template. This can be used to
 // instantiate.
 struct GenericInfo
 {
     std::list<std::string> typeVec;
     std::string originFile;
-    std::list<Token> symbols;
-    std::list<Token> preBlock, postBlock;
+    TokenList symbols;
+    TokenList preBlock, postBlock;
     std::list<std::string> genericNames;
     std::list<std::list<std::list<std::string>>> instances;
 };
@@ -132,6 +158,92 @@ struct PackageInfo
     std::string oakDeps;   // Oak dependencies
 };
 
+// A record of everything which went into the last build of an
+// output, saved in `.oak_build`. Lets the next build skip any
+// step whose inputs are unchanged.
+struct BuildManifest
+{
+    // Hash of the compiler and its arguments. Empty if the
+    // build cannot be skipped even when nothing has changed.
+    std::string key;
+
+    // Files read by the build, mapped to their stamps.
+    std::map<std::string,
+             std::pair<long long, unsigned long long>>
+        inputs;
+
+    // Loaded packages, mapped to their versions.
+    std::map<std::string, std::string> packages;
+
+    std::set<std::string> cflags;
+
+    // Generated `C` files, mapped to the hash of their contents
+    // and of the command which compiles them.
+    std::map<std::string, std::string> sources;
+
+    // Files written by the build, mapped to their modification
+    // times.
+    std::map<std::string, long long> outputs;
+
+    // Hash of the final link command and its objects.
+    std::string link;
+};
+
+// The outcome of a single file of a test suite.
+struct TestResult
+{
+    std::string file;
+
+    // The exit status of the test. Nonzero is failure.
+    int result = 0;
+
+    // True if the test passed last time and its inputs are
+    // unchanged, so it was not run again.
+    bool skipped = false;
+
+    // Elapsed and CPU time, including that of every process
+    // the test started.
+    unsigned long long wallMs = 0, cpuMs = 0;
+
+    // Peak resident set size of any process in the test.
+    long long peakKb = 0;
+
+    // The file holding everything the test printed.
+    std::string log;
+};
+
+// A finished span of compiler work, as saved by `--trace`.
+struct TraceEvent
+{
+    std::string name, category;
+
+    // In microseconds since compilation began.
+    unsigned long long start = 0, duration = 0;
+
+    // The row on which the span is shown; 0 is the main thread.
+    unsigned int lane = 0;
+
+    // The peak resident set size in KB when the span began.
+    // Only kept for phases, for the memory report.
+    long long startKb = 0;
+};
+
+// The memory used by a single compiler phase, over every file.
+struct PhaseMemory
+{
+    unsigned long long calls = 0;
+
+    // The peak resident set size in KB at the end of the last
+    // call, and how far all calls together raised it.
+    long long peakKb = 0, growthKb = 0;
+};
+
+// The size of a single file, as loaded by doFile.
+struct FileMemory
+{
+    unsigned long long tokens = 0, nodes = 0;
+};
+
 // Enumeration representing the type of a single AST node.
 enum SequenceInfo
 {
@@ -167,7 +279,11 @@ struct TypeNode
 };
 
 // A list of type nodes which, taken all together, comprise a
-// valid Oak type.
+// valid Oak type. Types are hash-consed: Structurally identical
+// types share the same interned IDs, so comparison and cache
+// lookups are integer operations. The nodes are only changed
+// via the member functions below, each of which invalidates
+// the IDs.
 class Type
 {
   public:
@@ -193,11 +309,35 @@ class Type
 
     const size_t size() const;
 
-    TypeNode &operator[](const int &index) const;
+    const TypeNode &operator[](const int &index) const;
+
+    // Replaces the node at the given index
+    void set(const int &index, const TypeInfo &info,
+             const std::string &name = "");
+
+    std::vector<TypeNode>::const_iterator begin() const;
+    std::vector<TypeNode>::const_iterator end() const;
+
+    // Interned ID of this exact type, including all names.
+    // Suitable as a cache key.
+    unsigned long long getID() const;
+
+    // Interned ID which matches iff `operator==` does.
+    unsigned long long getStructuralID() const;
 
-    unsigned long long ID;
+    // Interned ID which matches iff the types match ignoring
+    // variable names and array sizes.
+    unsigned long long getExactID() const;
 
-    std::list<TypeNode> internal;
+  private:
+    std::vector<TypeNode> internal;
+
+    // Marks the interned IDs as needing recomputation.
+    void invalidate();
+
+    // Zero iff not yet computed.
+    mutable unsigned long long ID = 0, structuralID = 0,
+                               exactID = 0;
 };
 
 // An entry in the struct symbol table.
@@ -218,15 +358,67 @@ struct EnumLookupData
     bool erased = false;
 };
 
+// A costless reference to an interned, immutable Type. Each
+// distinct type (by getID) is stored once, so copying one of
+// these never allocates. Interned types are kept until the
+// process ends; Acorn compiles one unit per process, and the
+// server forks a new one for each request. The server's own
+// process only interns while warming up, for the types of its
+// resident snapshots and included files.
+class TypeRef
+{
+  public:
+    TypeRef();
+    TypeRef(const Type &what);
+
+    operator const Type &() const
+    {
+        return *type;
+    }
+
+    const Type &get() const
+    {
+        return *type;
+    }
+
+    const TypeNode &operator[](const int &index) const
+    {
+        return (*type)[index];
+    }
+
+    const size_t size() const
+    {
+        return type->size();
+    }
+
+    bool operator==(const Type &other) const
+    {
+        return *type == other;
+    }
+
+    bool operator!=(const Type &other) const
+    {
+        return *type != other;
+    }
+
+  private:
+    const Type *type;
+};
+
+struct ASTNode;
+
+// The children of an AST node, stored contiguously.
+typedef std::vector<ASTNode> ASTList;
+
 // Abstract Syntax Tree node. This represents a complete AST in
 // itself. This is where the majority of reconstructive and
 // transformative work will be done.
 struct ASTNode
 {
-    Type type;
-    std::list<ASTNode> items;
+    TypeRef type;
+    ASTList items;
     SequenceInfo info = code_line;
-    std::string raw; // If needed
+    std::string raw; // If needed. Owned, not interned.
 };
 
 // Holds multiple possible entrees for a given name in the
@@ -247,6 +439,40 @@ struct MultiTableSymbol
 typedef std::map<std::string, std::list<MultiTableSymbol>>
     MultiSymbolTable;
 
+// Undo log of scoped (non-function) symbols in the symbol
+// table, in order of insertion.
+typedef std::vector<std::pair<
+    std::string, std::list<MultiTableSymbol>::iterator>>
+    ScopeLog;
+
+// The overloads of a single name in the symbol table, indexed
+// for resolution. Holds pointers into the table, so is only
+// valid while `list` is still the name's entry and still has
+// `size` items.
+struct OverloadSet
+{
+    const std::list<MultiTableSymbol> *list = nullptr;
+    size_t size = 0;
+
+    // The overloads, in table order, and the types of their
+    // arguments.
+    std::vector<const MultiTableSymbol *> symbols;
+    std::vector<std::list<Type>> args;
+
+    // Indices of the overloads taking each number of arguments.
+    std::map<size_t, std::vector<int>> byArity;
+
+    // Indices of the overloads by number of arguments and the
+    // exact ID of the first argument's type.
+    std::map<std::pair<size_t, unsigned long long>,
+             std::vector<int>>
+        byLeadingType;
+
+    // Maps the IDs of the argument types of a call to the index
+    // of the overload it resolved to.
+    std::map<std::vector<unsigned long long>, int> resolved;
+};
+
 // The null type, used for comparisons.
 const static Type nullType = {atomic, "NULL"};
 
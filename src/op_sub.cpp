@@ -16,9 +16,9 @@ and the ternary must be added via rules, if at all.
 // Moves pre and post to include the operands to a binary
 // operator
 // Assumes that pre = i - 1, post = i + 1, i = index of bin op
-void getOperands(std::list<Token> &from,
-                 std::list<Token>::iterator &pre,
-                 std::list<Token>::iterator &post,
+void getOperands(TokenList &from,
+                 TokenList::iterator &pre,
+                 TokenList::iterator &post,
                  const bool &useLine = false)
 {
     int count = 0;
@@ -157,9 +157,9 @@ void getOperands(std::list<Token> &from,
 // Moves post to include the operand to a binary
 // operator. Oak only has prefix unaries.
 // Assumes that pre = i - 1, post = i + 1, i = index of bin op
-void getOperandUnary(std::list<Token> &from,
-                     const std::list<Token>::iterator &pre,
-                     std::list<Token>::iterator &post)
+void getOperandUnary(TokenList &from,
+                     const TokenList::iterator &pre,
+                     TokenList::iterator &post)
 {
     int count = 0;
 
@@ -208,8 +208,8 @@ void getOperandUnary(std::list<Token> &from,
 }
 
 // Substitute a single binary operation as identified
-void doSub(std::list<Token> &from,
-           std::list<Token>::iterator &pos,
+void doSub(TokenList &from,
+           TokenList::iterator &pos,
            const std::string &name)
 {
     auto pre = pos, post = pos;
@@ -284,8 +284,8 @@ void doSub(std::list<Token> &from,
 }
 
 // Substitute a single unary operation as identified
-void doSubUnary(std::list<Token> &from,
-                std::list<Token>::iterator &pos,
+void doSubUnary(TokenList &from,
+                TokenList::iterator &pos,
                 const std::string &name)
 {
     auto pre = pos, post = pos;
@@ -350,9 +350,9 @@ void doSubUnary(std::list<Token> &from,
 
 // Fixes method call notation.
 // All iterators within the given range will be invalidated.
-void fixMethod(std::list<Token> &from,
-               std::list<Token>::iterator &beginObj,
-               std::list<Token>::iterator &beginCall,
+void fixMethod(TokenList &from,
+               TokenList::iterator &beginObj,
+               TokenList::iterator &beginCall,
                Token &fnName)
 {
     // beginCall points to "("
@@ -389,7 +389,7 @@ void fixMethod(std::list<Token> &from,
 
     // Insert fnName, "(" at beginning
     // g(a.b.c.d.e.f
-    templ.text = fnName;
+    templ.text = fnName.text;
     from.emplace(beginObj, templ);
 
     templ.text = "(";
@@ -406,13 +406,13 @@ void fixMethod(std::list<Token> &from,
 // These are some common rule-like token stream manipulations
 // which would be too hard (or perhaps impossible) to implement
 // with the rule system.
-void operatorSub(std::list<Token> &From)
+void operatorSub(TokenList &From)
 {
     // Level -1: Method resolution
     // This one works via DFA
     {
         int state = 0;
-        std::list<Token>::iterator startOfObj;
+        TokenList::iterator startOfObj;
         Token methodName;
 
         for (auto it = From.begin(); it != From.end(); it++)
@@ -27,6 +27,7 @@ jdehmel@outlook.com
 
 #include "lexer.hpp"
 #include "oakc_structs.hpp"
+#include <chrono>
 #include <filesystem>
 #include <fstream>
 #include <map>
@@ -55,6 +56,10 @@ const static std::string COMPILED_PATH = ".oak_build/";
 // The command to use to compile Oak files (for macros).
 const static std::string COMPILER_COMMAND = "acorn";
 
+// The symbol which macro shared objects export so that they can
+// be called in-process. See `MacroEntry`.
+const static std::string MACRO_ENTRY_POINT = "oak_macro_main";
+
 // The `C` (not `C++`) compiler which will turn the translated
 // `C` files into object files.
 const static std::string C_COMPILER = "clang";
@@ -68,6 +73,10 @@ const static std::string LINKER = "clang++";
 const static std::string PRETTIFIER =
     "clang-format --style=Microsoft -i ";
 
+// Where compiled macros are cached across projects, relative
+// to the user's cache directory ($XDG_CACHE_HOME or ~/.cache).
+const static std::string MACRO_CACHE_DIR = "oak/macros/";
+
 // Max allowable size of .acorn_build in kilobytes
 const static unsigned long long MAX_CACHE_KB = 2000;
 
@@ -80,6 +89,7 @@ const static std::string HELP_TEXT =
     "-------|-------------|-------------------------------\n"
     " -a    |             | Update acorn\n"
     " -A    |             | Uninstall acorn\n"
+    " -b    | --units     | Split C into N parallel units\n"
     " -c    | --compile   | Produce object files\n"
     " -d    | --debug     | Toggle debug mode\n"
     " -D    | --dialect   | Uses a dialect file\n"
@@ -88,6 +98,7 @@ const static std::string HELP_TEXT =
     " -g    | --exe_debug | Use LLVM debug flag\n"
     " -h    | --help      | Show this\n"
     " -i    | --install   | Install a package\n"
+    " -j    | --jobs      | Max parallel builds or tests\n"
     " -l    | --link      | Produce executables\n"
     " -m    | --manual    | Produce a .md doc\n"
     " -M    |             | Used for macro compilation\n"
@@ -107,7 +118,11 @@ const static std::string HELP_TEXT =
     " -U    |             | Save rule log files\n"
     " -v    | --version   | Show version\n"
     " -w    | --new       | Create a new package\n"
-    " -x    | --syntax    | Ignore syntax errors\n";
+    " -x    | --syntax    | Ignore syntax errors\n"
+    "       | --server    | Serve compiles from warm state\n"
+    "       | --client    | Compile via the server, if any\n"
+    "       | --trace     | Save a trace of the compilation\n"
+    "       | --memory    | Report and save memory usage\n";
 
 // A temporary place to store packages during installation.
 // These will be deleted after install.
@@ -120,6 +135,15 @@ const static std::string PACKAGE_INCLUDE_PATH = OAK_DIR_PATH;
 // The file name to use as the package information file.
 const static std::string INFO_FILE = "oak_package_info.txt";
 
+// The file name to use as the precompiled state of a package,
+// saved within its install directory.
+const static std::string SNAPSHOT_FILE =
+    "oak_package_snapshot.bin";
+
+// The version of the package snapshot format. Snapshots of any
+// other version are ignored.
+const static unsigned long long SNAPSHOT_VERSION = 1;
+
 // A locally stored list of all official packages.
 const static std::string PACKAGES_LIST_PATH =
     "/usr/include/oak/packages_list.txt";
@@ -133,6 +157,36 @@ const static std::set<std::string> ATOMICS = {
     "u64",  "i64",  "u128", "i128", "f32",    "f64",
     "f128", "bool", "str",  "void", "struct", "enum"};
 
+// Operator functions which, when called upon numeric or
+// boolean atomics, are emitted as the equivalent `C` operator
+// instead of as a call into `std/atom_math.c`. Maps function
+// name to operator. Assignment and unary operators take a
+// pointer as their first argument. `Andd` and `Orr` use the
+// bitwise operators, since both of their arguments are always
+// evaluated as a call.
+const static std::map<std::string, std::string>
+    ATOMIC_BINARY_OPERATORS = {
+        {"Add", "+"},   {"Sub", "-"},   {"Mult", "*"},
+        {"Div", "/"},   {"Mod", "%"},   {"And", "&"},
+        {"Or", "|"},    {"Xor", "^"},   {"Lbs", "<<"},
+        {"Rbs", ">>"},  {"Eq", "=="},   {"Neq", "!="},
+        {"Less", "<"},  {"Great", ">"}, {"Leq", "<="},
+        {"Greq", ">="}, {"Andd", "&"},  {"Orr", "|"}};
+const static std::map<std::string, std::string>
+    ATOMIC_ASSIGNMENT_OPERATORS = {
+        {"Copy", "="},   {"AddEq", "+="},  {"SubEq", "-="},
+        {"MultEq", "*="}, {"DivEq", "/="}, {"ModEq", "%="},
+        {"AndEq", "&="}, {"OrEq", "|="},   {"XorEq", "^="}};
+const static std::map<std::string, std::string>
+    ATOMIC_UNARY_OPERATORS = {
+        {"Incr", "++"}, {"Decr", "--"}, {"Not", "!"}};
+
+// The installed file which declares the operators above. Only
+// its declarations are lowered; Others of the same name are
+// called as normal.
+const static std::string ATOMIC_OPERATORS_FILE =
+    PACKAGE_INCLUDE_PATH + "std/atom_math.oak";
+
 // Where to look for the standard `oak` header file. This is
 // included at the top of all target `C` files.
 const static std::string OAK_HEADER_PATH =
@@ -316,6 +370,23 @@ struct AcornSettings
     // the program.
     MultiSymbolTable table;
 
+    // Scoped symbols which have been added to `table`, so that
+    // they can be removed when their scope closes.
+    ScopeLog scopeLog;
+
+    // Indexed overloads of names in `table`, built on demand.
+    // See getOverloads.
+    std::map<std::string, OverloadSet> overloads;
+
+    // Function calls resolved from the memo of the overload
+    // set, and those which were not. Only reported in debug
+    // mode.
+    unsigned long long overloadMemoHits = 0,
+                       overloadMemoMisses = 0;
+
+    // Overloads compared against calls on memo misses.
+    unsigned long long overloadsChecked = 0;
+
     // The current line.
     unsigned long long int curLine = 1;
 
@@ -323,7 +394,7 @@ struct AcornSettings
     fs::path curFile = "NULL";
 
     // The tokens in the current line. Used for debugging.
-    std::list<Token> curLineSymbols;
+    TokenList curLineSymbols;
 
     std::vector<std::string> activeRules;
     std::vector<std::string> dialectRules;
@@ -333,11 +404,15 @@ struct AcornSettings
     std::ofstream ruleLogFile;
 
     std::map<std::string, Rule> rules;
-    std::map<std::string, void (*)(std::list<Token> &,
-                                   std::list<Token>::iterator &,
+    std::map<std::string, void (*)(TokenList &,
+                                   TokenList::iterator &,
                                    Rule &, AcornSettings &)>
         engines;
 
+    // Per-rule match statistics, keyed by rule name. Only kept
+    // and reported in debug mode.
+    std::map<std::string, RuleStats> ruleStats;
+
     // The set of all macros for which an executable version
     // already exists. If a macro is not present here, it will
     // need to be compiled before it is used.
@@ -352,9 +427,37 @@ struct AcornSettings
     // The set of all macros. Maps name to source code.
     std::map<std::string, std::string> macros;
 
+    // The in-process entry points of loaded macros. A macro
+    // whose shared object could not be loaded maps to nullptr,
+    // and is called as a subprocess instead.
+    std::map<std::string, MacroEntry> macroEntries;
+
     // Maps the name of a macro to the file it came from.
     std::map<std::string, std::string> macroSourceFiles;
 
+    // The maximum number of macros or `C` files to compile at
+    // once. 0 means one per hardware thread.
+    unsigned int jobs = 0;
+
+    // The number of `C` files to split function definitions
+    // across, so that they can be compiled concurrently. 1
+    // means a single file.
+    unsigned int units = 1;
+
+    // Lookups in the user-level macro cache. Only reported in
+    // debug mode.
+    unsigned long long macroCacheHits = 0, macroCacheMisses = 0;
+
+    // Memoized outputs of pure macro calls, keyed by macro
+    // cache key and null-separated arguments. Also kept on
+    // disk.
+    std::map<std::string, std::string> macroMemo;
+    unsigned long long macroMemoHits = 0, macroMemoMisses = 0;
+
+    // Set once a macro tagged `impure_macros` is called, since
+    // its output may depend on more than this build's inputs.
+    bool impureMacroCalled = false;
+
     // The set of all existing templates for generics.
     std::map<std::string, std::list<GenericInfo>> generics;
 
@@ -384,6 +487,30 @@ struct AcornSettings
 
     std::map<std::string, PackageInfo> packages;
 
+    // Where to save the trace of this compilation, or "" for
+    // none. See beginTrace.
+    std::string tracePath = "";
+
+    // Finished spans, then those still open, innermost last.
+    std::vector<TraceEvent> traceEvents, openTraces;
+
+    // The moment from which trace times are measured.
+    std::chrono::steady_clock::time_point traceStart =
+        std::chrono::steady_clock::now();
+
+    // Where to save the memory report, or "" for none. See
+    // printMemoryReport.
+    std::string memoryPath = "";
+
+    // Memory use by phase name and by file. Only kept for the
+    // memory report.
+    std::map<std::string, PhaseMemory> phaseMemory;
+    std::map<std::string, FileMemory> fileMemory;
+
+    // The number of macro calls, and the total size of their
+    // outputs.
+    unsigned long long macroCalls = 0, macroOutputBytes = 0;
+
 }; // struct AcornSettings
 
 #endif // OPTIONS_HPP
@@ -596,6 +596,21 @@ void downloadPackage(const std::string &URLArg,
         // Copy files
         fs::copy(tempFolderName, destFolderName);
 
+        // Precompile the package, so that including it does
+        // not mean processing all of its files
+        try
+        {
+            buildPackageSnapshot(info.name, settings);
+        }
+        catch (std::runtime_error &e)
+        {
+            std::cout << tags::yellow_bold
+                      << "Warning: Failed to precompile "
+                         "package '"
+                      << info.name << "': " << e.what() << '\n'
+                      << tags::reset;
+        }
+
         // Clean up garbage; Doesn't really matter if this fails
         if (fs::remove_all(PACKAGE_TEMP_LOCATION) == 0)
         {
@@ -9,6 +9,7 @@ GPLv3 held by author
 #include "oakc_fns.hpp"
 #include "options.hpp"
 #include "tags.hpp"
+#include <algorithm>
 
 // Removes illegal characters
 std::string purifyStr(const std::string &What)
@@ -46,49 +47,159 @@ std::string reconstructAndSave(const std::string &Name,
     return save(body, Name);
 }
 
-void reconstruct(const std::string &Name,
-                 AcornSettings &settings,
-                 std::stringstream &body)
+// Step A2: Struct definitions. The constructors of enums are
+// written to `constructors`, which may be the same stream.
+static void reconstructStructs(AcornSettings &settings,
+                               std::ostream &types,
+                               std::ostream &constructors)
 {
-    // Step A1: Load Oak standard translational header
-    body << "#include \"" << OAK_HEADER_PATH << "\"\n";
-
-    // Step A2: Struct definitions
     for (auto name : settings.structOrder)
     {
         if (settings.enumData.count(name) != 0)
         {
-            body << enumToC(name, settings) << '\n';
+            types << enumTypeToC(name, settings);
+            constructors << enumConstructorsToC(name, settings);
+            types << '\n';
             continue;
         }
 
-        body << "struct " << name << "\n{\n";
+        types << "struct " << name << "\n{\n";
 
         for (auto m : settings.structData[name].order)
         {
-            body << toStrC(
-                        &settings.structData[name].members[m],
-                        settings, m)
-                 << ";\n";
+            types << toStrC(
+                         &settings.structData[name].members[m],
+                         settings, m)
+                  << ";\n";
+        }
+
+        types << "};\n";
+    }
+}
+
+// The symbols which are to be emitted.
+typedef std::set<const MultiTableSymbol *> SymbolSet;
+
+// Adds every identifier in the given AST to `into`. Calls are
+// mangled during sequencing, so these are the C names of every
+// function the AST may refer to, including via `raw_c!`.
+static void getIdentifiers(const ASTNode &what,
+                           std::set<std::string> &into)
+{
+    for (size_t start = 0; start < what.raw.size();)
+    {
+        size_t end = start;
+        while (end < what.raw.size() &&
+               (isalnum(what.raw[end]) || what.raw[end] == '_'))
+        {
+            end++;
+        }
+
+        if (end != start)
+        {
+            into.insert(what.raw.substr(start, end - start));
+        }
+
+        start = end + 1;
+    }
+
+    for (const auto &child : what.items)
+    {
+        getIdentifiers(child, into);
+    }
+}
+
+// Returns true if the given symbol was defined in a file with
+// the `export` tag, so that it may be called from outside of
+// `Oak` (for instance, from a linked `C` object).
+static bool isExported(const MultiTableSymbol &s,
+                       AcornSettings &settings)
+{
+    auto tags = settings.file_tags.find(s.sourceFilePath);
+    return tags != settings.file_tags.end() &&
+           tags->second.count("export") != 0;
+}
+
+// Returns the symbols which can be reached from `main` or from
+// any exported symbol. When the output will not be linked as an
+// executable (so anything may be called from elsewhere), this
+// is every symbol.
+static SymbolSet getReachable(AcornSettings &settings)
+{
+    SymbolSet out;
+    std::map<std::string, const MultiTableSymbol *> byCName;
+    std::list<const MultiTableSymbol *> toVisit;
+
+    const bool isPrunable =
+        settings.doLink && settings.table.count("main") != 0;
+
+    for (const auto &entry : settings.table)
+    {
+        for (const MultiTableSymbol &s : entry.second)
+        {
+            if (!isPrunable || entry.first == "main" ||
+                isExported(s, settings))
+            {
+                out.insert(&s);
+                toVisit.push_back(&s);
+            }
+            else
+            {
+                byCName[mangleSymb(entry.first,
+                                   mangleType(s.type))] = &s;
+            }
         }
+    }
+
+    if (!isPrunable)
+    {
+        return out;
+    }
+
+    while (!toVisit.empty())
+    {
+        std::set<std::string> identifiers;
+        getIdentifiers(toVisit.front()->seq, identifiers);
+        toVisit.pop_front();
 
-        body << "};\n";
+        for (const auto &identifier : identifiers)
+        {
+            auto it = byCName.find(identifier);
+            if (it != byCName.end() &&
+                out.count(it->second) == 0)
+            {
+                out.insert(it->second);
+                toVisit.push_back(it->second);
+            }
+        }
     }
 
-    // Step A4: Insert global definitions into header
-    // (Translate Oak syntax into C syntax)
-    for (auto entry : settings.table)
+    return out;
+}
+
+// Step A4: Insert global definitions into header
+// (Translate Oak syntax into C syntax)
+static void reconstructPrototypes(AcornSettings &settings,
+                                  const SymbolSet &reachable,
+                                  std::ostream &out)
+{
+    for (const auto &entry : settings.table)
     {
-        std::string name = entry.first;
+        const std::string &name = entry.first;
 
-        for (MultiTableSymbol s : entry.second)
+        for (const MultiTableSymbol &s : entry.second)
         {
+            if (reachable.count(&s) == 0)
+            {
+                continue;
+            }
+
             try
             {
                 std::string toAdd =
                     toStrCFunction(&s.type, settings, name);
 
-                body << toAdd << ";\n";
+                out << toAdd << ";\n";
             }
             catch (std::runtime_error &e)
             {
@@ -101,52 +212,250 @@ void reconstruct(const std::string &Name,
             }
         }
     }
+}
 
-    for (auto entry : settings.table)
+// Returns the C definition of the given symbol, or "" if it
+// has none.
+static std::string reconstructDefinition(
+    const std::string &name, const MultiTableSymbol &s,
+    AcornSettings &settings)
+{
+    std::stringstream out;
+
+    try
     {
-        std::string name = entry.first;
+        std::string toAdd =
+            toStrCFunction(&s.type, settings, name);
 
-        for (MultiTableSymbol s : entry.second)
+        if (s.seq.items.size() != 0)
         {
-            try
-            {
-                std::string toAdd =
-                    toStrCFunction(&s.type, settings, name);
+            std::string definition = toC(s.seq, settings);
 
-                if (s.seq.items.size() != 0)
+            if (definition != "")
+            {
+                if (s.line != 0)
                 {
-                    std::string definition =
-                        toC(s.seq, settings);
-
-                    if (definition != "")
-                    {
-                        if (s.line != 0)
-                        {
-                            body << "\n#line " << s.line
-                                 << " \"" << s.sourceFilePath
-                                 << "\"\n";
-                        }
-
-                        body << toAdd << " " << definition
-                             << '\n';
-                    }
+                    out << "\n#line " << s.line << " \""
+                        << s.sourceFilePath << "\"\n";
                 }
+
+                out << toAdd << " " << definition << '\n';
             }
-            catch (std::runtime_error &e)
-            {
-                std::cout << "Failure in symbol " << name
-                          << " w/ type " << toStr(&s.type)
-                          << " from " << s.sourceFilePath
-                          << '\n';
+        }
+    }
+    catch (std::runtime_error &e)
+    {
+        std::cout << "Failure in symbol " << name << " w/ type "
+                  << toStr(&s.type) << " from "
+                  << s.sourceFilePath << '\n';
 
-                throw sequencing_error(e.what());
+        throw sequencing_error(e.what());
+    }
+
+    return out.str();
+}
+
+void reconstruct(const std::string &Name,
+                 AcornSettings &settings,
+                 std::stringstream &body)
+{
+    // Step A1: Load Oak standard translational header
+    body << "#include \"" << OAK_HEADER_PATH << "\"\n";
+
+    // Only what `main` or an export can reach is emitted
+    const SymbolSet reachable = getReachable(settings);
+
+    reconstructStructs(settings, body, body);
+    reconstructPrototypes(settings, reachable, body);
+
+    for (const auto &entry : settings.table)
+    {
+        for (const MultiTableSymbol &s : entry.second)
+        {
+            if (reachable.count(&s) != 0)
+            {
+                body << reconstructDefinition(entry.first, s,
+                                              settings);
             }
         }
     }
 
+    // Step A5: In-process entry point for macros
+    if (settings.isMacroCall &&
+        settings.table.count("main") != 0 &&
+        !settings.table["main"].empty())
+    {
+        body << macroEntryToC(settings);
+    }
+
     return;
 }
 
+std::list<std::string> reconstructAndSaveUnits(
+    const std::string &Name, AcornSettings &settings,
+    const unsigned int &Units)
+{
+    const std::string rootName = purifyStr(Name);
+    const std::string headerName = rootName + ".h";
+    const std::string guard = rootName + "_H";
+
+    std::stringstream header, constructors;
+
+    header << "#ifndef " << guard << "\n#define " << guard
+           << "\n#include \"" << OAK_HEADER_PATH << "\"\n";
+
+    const SymbolSet reachable = getReachable(settings);
+
+    reconstructStructs(settings, header, constructors);
+    reconstructPrototypes(settings, reachable, header);
+
+    header << "#endif\n";
+
+    // Group definitions by the file they came from, in symbol
+    // table order
+    std::map<std::string, std::list<std::string>> groups;
+    unsigned long long total = 0;
+
+    for (const auto &entry : settings.table)
+    {
+        for (const MultiTableSymbol &s : entry.second)
+        {
+            if (reachable.count(&s) == 0)
+            {
+                continue;
+            }
+
+            std::string definition =
+                reconstructDefinition(entry.first, s, settings);
+
+            if (definition != "")
+            {
+                total += definition.size();
+                groups[s.sourceFilePath].push_back(definition);
+            }
+        }
+    }
+
+    // Split groups which would not fit in a single unit, then
+    // place the largest chunks first, each into the smallest
+    // unit so far
+    const unsigned long long target =
+        total / std::max(Units, 1u) + 1;
+    std::vector<std::pair<unsigned long long, std::string>>
+        chunks;
+
+    for (const auto &group : groups)
+    {
+        std::string chunk;
+        for (const auto &definition : group.second)
+        {
+            if (!chunk.empty() &&
+                chunk.size() + definition.size() > target)
+            {
+                chunks.push_back({chunk.size(), chunk});
+                chunk.clear();
+            }
+            chunk += definition;
+        }
+
+        if (!chunk.empty())
+        {
+            chunks.push_back({chunk.size(), chunk});
+        }
+    }
+
+    std::stable_sort(chunks.begin(), chunks.end(),
+                     [](const auto &a, const auto &b)
+                     { return a.first > b.first; });
+
+    std::vector<std::stringstream> bodies(
+        std::max<size_t>(1, std::min<size_t>(Units,
+                                             chunks.size())));
+    std::vector<unsigned long long> sizes(bodies.size(), 0);
+
+    for (const auto &chunk : chunks)
+    {
+        size_t smallest = 0;
+        for (size_t i = 1; i < sizes.size(); i++)
+        {
+            if (sizes[i] < sizes[smallest])
+            {
+                smallest = i;
+            }
+        }
+
+        bodies[smallest] << chunk.second;
+        sizes[smallest] += chunk.first;
+    }
+
+    // Enum constructors and the macro entry point go in the
+    // first unit
+    bodies[0] << constructors.str();
+
+    if (settings.isMacroCall &&
+        settings.table.count("main") != 0 &&
+        !settings.table["main"].empty())
+    {
+        bodies[0] << macroEntryToC(settings);
+    }
+
+    // Save
+    fs::create_directory(".oak_build");
+
+    std::list<std::string> out;
+    out.push_back(".oak_build/" + headerName);
+
+    std::ofstream headerFile(out.back());
+    if (!headerFile.is_open())
+    {
+        throw std::runtime_error("Failed to open file `" +
+                                 out.back() + "`");
+    }
+
+    headerFile << header.str();
+    headerFile.close();
+
+    for (size_t i = 0; i < bodies.size(); i++)
+    {
+        std::stringstream body;
+        body << "#include \"" << headerName << "\"\n"
+             << bodies[i].str();
+
+        out.push_back(
+            save(body, rootName + "_" + std::to_string(i)));
+    }
+
+    return out;
+}
+
+std::string macroEntryToC(AcornSettings &settings)
+{
+    Type &mainType = settings.table["main"].front().type;
+    bool hasArgs = !getArgs(mainType, settings).empty();
+    Type returnType = getReturnType(mainType, settings);
+    bool returnsVoid = returnType.size() != 0 &&
+                       returnType[0].info == atomic &&
+                       returnType[0].name == "void";
+
+    std::stringstream out;
+    out << "\nint " << MACRO_ENTRY_POINT
+        << "(int argc, char **argv)\n{\n"
+        << "int result = 0;\n";
+
+    if (!hasArgs)
+    {
+        out << "(void)argc;\n"
+            << "(void)argv;\n";
+    }
+
+    out << (returnsVoid ? "" : "result = ") << "main("
+        << (hasArgs ? "argc, (void *)argv" : "") << ");\n"
+        << "return result;\n"
+        << "}\n";
+
+    return out.str();
+}
+
 // Save reconstructed files and return name
 std::string save(const std::stringstream &body,
                  const std::string &Name)
@@ -313,7 +622,7 @@ std::string toStrCFunctionRef(const Type *What,
     // Then some number of args, possibly containing maps
     do
     {
-        TypeNode &cur = (*What)[i];
+        const TypeNode &cur = (*What)[i];
 
         if (cur.info == function)
         {
@@ -390,11 +699,13 @@ std::string toStrC(const Type *What, AcornSettings &settings,
                    const std::string &Name,
                    const unsigned int &pos)
 {
-    if (settings.toStrCTypeCache.count(
-            make_pair(What->ID, Name)) != 0)
+    // Only whole types are cached, since the key does not
+    // include `pos`
+    const auto key = std::make_pair(
+        What == nullptr ? 0ull : What->getID(), Name);
+    if (pos == 0 && settings.toStrCTypeCache.count(key) != 0)
     {
-        return settings
-            .toStrCTypeCache[make_pair(What->ID, Name)];
+        return settings.toStrCTypeCache[key];
     }
     if (settings.toStrCTypeCache.size() > 1000)
     {
@@ -408,8 +719,10 @@ std::string toStrC(const Type *What, AcornSettings &settings,
     if (What == nullptr || What->size() == 0 ||
         pos >= What->size())
     {
-        settings.toStrCTypeCache[make_pair(What->ID, Name)] =
-            "";
+        if (pos == 0)
+        {
+            settings.toStrCTypeCache[key] = "";
+        }
         return "";
     }
 
@@ -417,8 +730,10 @@ std::string toStrC(const Type *What, AcornSettings &settings,
         (*What)[pos + 1].info == function)
     {
         out = toStrCFunctionRef(What, settings, Name);
-        settings.toStrCTypeCache[make_pair(What->ID, Name)] =
-            out;
+        if (pos == 0)
+        {
+            settings.toStrCTypeCache[key] = out;
+        }
         return out;
     }
 
@@ -476,7 +791,10 @@ std::string toStrC(const Type *What, AcornSettings &settings,
         out += suffix;
     }
 
-    settings.toStrCTypeCache[make_pair(What->ID, Name)] = out;
+    if (pos == 0)
+    {
+        settings.toStrCTypeCache[key] = out;
+    }
 
     return out;
 }
@@ -489,6 +807,21 @@ std::string enumToC(const std::string &name,
         return settings.toStrCEnumCache[name];
     }
 
+    std::string out = enumTypeToC(name, settings) +
+                      enumConstructorsToC(name, settings);
+
+    if (settings.toStrCEnumCache.size() > 1000)
+    {
+        settings.toStrCEnumCache.clear();
+    }
+    settings.toStrCEnumCache[name] = out;
+
+    return out;
+}
+
+std::string enumTypeToC(const std::string &name,
+                        AcornSettings &settings)
+{
     // Basic error checking; Should NOT constitute the entirety
     // of safety checks!!! This just ensures a lack of internal
     // errors.
@@ -520,8 +853,14 @@ std::string enumToC(const std::string &name,
 
     out += "\n} __data;\n};\n";
 
-    // That's the end of the easy part.
-    // Now, it must generate constructors.
+    return out;
+}
+
+std::string enumConstructorsToC(const std::string &name,
+                                AcornSettings &settings)
+{
+    EnumLookupData &cur = settings.enumData[name];
+    std::string out;
 
     std::string enumTypeStr = name;
     for (auto optionName : cur.order)
@@ -561,11 +900,5 @@ std::string enumToC(const std::string &name,
         }
     }
 
-    if (settings.toStrCEnumCache.size() > 1000)
-    {
-        settings.toStrCEnumCache.clear();
-    }
-    settings.toStrCEnumCache[name] = out;
-
     return out;
 }
@@ -6,6 +6,7 @@ jdehmel@outlook.com
 
 #include "oakc_fns.hpp"
 #include "oakc_structs.hpp"
+#include <algorithm>
 
 #define rm_assert(expression, message)                         \
     ((bool)(expression)                                        \
@@ -17,7 +18,7 @@ jdehmel@outlook.com
 // I is the point in Lexed at which a macro name was found
 // CONSUMPTIVE!
 std::list<std::string> getMacroArgs(
-    std::list<Token> &lexed, std::list<Token>::iterator &it)
+    TokenList &lexed, TokenList::iterator &it)
 {
     std::list<std::string> out;
 
@@ -68,7 +69,8 @@ std::list<std::string> getMacroArgs(
     return out;
 }
 
-void doRules(std::list<Token> &From, AcornSettings &settings)
+void doRules(TokenList &From, AcornSettings &settings,
+             std::vector<TokenList::iterator> *macroCalls)
 {
     if (settings.doRuleLogFile)
     {
@@ -86,6 +88,13 @@ void doRules(std::list<Token> &From, AcornSettings &settings)
                              << " ///////////\n\n";
     }
 
+    RuleIndex index;
+    bool indexIsDirty = true;
+
+    // The number of tokens from `it` onwards which were output
+    // by rules, and so may hold new compiler macro calls
+    size_t rewrittenLeft = 0;
+
     for (auto it = From.begin(); it != From.end(); it++)
     {
         // Add a new rule to the list of all rules
@@ -142,6 +151,7 @@ void doRules(std::list<Token> &From, AcornSettings &settings)
             }
 
             settings.rules[name] = toAdd;
+            indexIsDirty = true;
         }
 
         // Use a rule that already exists
@@ -189,6 +199,8 @@ void doRules(std::list<Token> &From, AcornSettings &settings)
                     settings.activeRules.push_back(arg);
                 }
             }
+
+            indexIsDirty = true;
         }
 
         // Stop using a rule that is in use
@@ -235,6 +247,8 @@ void doRules(std::list<Token> &From, AcornSettings &settings)
                 rm_assert(found,
                           "Rule '" + arg + "' is not in use.");
             }
+
+            indexIsDirty = true;
         }
 
         // Bundle multiple rules into one
@@ -274,56 +288,21 @@ void doRules(std::list<Token> &From, AcornSettings &settings)
         }
 
         // Regular case; Non-rule-macro symbol. Check against
-        // active rules.
+        // active rules which could begin with this symbol.
         else
         {
-            int ruleIndex = 0;
-
-            // Special case for dialect-skipping files
-            if (settings.file_tags.count(settings.curFile) !=
-                    0 &&
-                settings.file_tags[settings.curFile].count(
-                    "no_dialect") != 0)
+            if (indexIsDirty)
             {
-                ruleIndex = settings.dialectRules.size();
+                buildRuleIndex(index, settings);
+                indexIsDirty = false;
             }
 
-            for (; ruleIndex < settings.dialectRules.size() +
-                                   settings.activeRules.size();
-                 ruleIndex++)
+            int ruleIndex = -1;
+            while (it != From.end() &&
+                   (ruleIndex = getNextRule(index, it->text,
+                                            ruleIndex)) != -1)
             {
-                Rule curRule;
-                if (ruleIndex < settings.dialectRules.size())
-                {
-                    if (settings.rules.count(
-                            settings.dialectRules[ruleIndex]) ==
-                        0)
-                    {
-                        continue;
-                    }
-
-                    curRule =
-                        settings.rules
-                            [settings.dialectRules[ruleIndex]];
-                }
-                else
-                {
-                    if (settings.rules.count(
-                            settings.activeRules
-                                [ruleIndex -
-                                 settings.dialectRules
-                                     .size()]) == 0)
-                    {
-                        continue;
-                    }
-
-                    curRule =
-                        settings
-                            .rules[settings.activeRules
-                                       [ruleIndex -
-                                        settings.dialectRules
-                                            .size()]];
-                }
+                Rule &curRule = *index.rules[ruleIndex];
 
                 if (!itIsInRange(From, it,
                                  curRule.inputPattern.size()))
@@ -331,10 +310,40 @@ void doRules(std::list<Token> &From, AcornSettings &settings)
                     continue;
                 }
 
+                // Statistics are only reported in debug mode,
+                // so are not kept otherwise
+                RuleStats *stats = nullptr;
+                if (settings.debug)
+                {
+                    const std::string &ruleName =
+                        index.names[ruleIndex];
+                    stats = &settings.ruleStats[ruleName];
+                    stats->attempts++;
+                }
+
                 // do rule here
                 if (curRule.engineName == "sapling")
                 {
-                    doRuleAcorn(From, it, curRule, settings);
+                    const size_t oldSize = From.size();
+                    size_t inserted = 0;
+                    if (doRuleAcorn(From, it, curRule, settings,
+                                    &inserted))
+                    {
+                        if (stats != nullptr)
+                        {
+                            stats->matches++;
+                        }
+
+                        // The output replaces the matched
+                        // tokens, starting at `it`
+                        size_t erased =
+                            oldSize + inserted - From.size();
+                        rewrittenLeft =
+                            (rewrittenLeft > erased
+                                 ? rewrittenLeft - erased
+                                 : 0) +
+                            inserted;
+                    }
                 }
                 else if (settings.engines.count(
                              curRule.engineName) == 0)
@@ -346,8 +355,29 @@ void doRules(std::list<Token> &From, AcornSettings &settings)
                 {
                     settings.engines[curRule.engineName](
                         From, it, curRule, settings);
+
+                    // Other engines do not say what they
+                    // rewrote
+                    rewrittenLeft = From.size();
                 }
             }
+
+            // A rule may have erased the remainder of the file
+            if (it == From.end())
+            {
+                break;
+            }
+        }
+
+        if (rewrittenLeft != 0 && it != From.end())
+        {
+            if (macroCalls != nullptr &&
+                COMPILER_MACROS.count(*it) != 0)
+            {
+                macroCalls->push_back(it);
+            }
+
+            rewrittenLeft--;
         }
     }
 
@@ -509,13 +539,13 @@ void loadDialectFile(const std::string &File,
     return;
 }
 
-void doRuleAcorn(std::list<Token> &Text,
-                 std::list<Token>::iterator &i, Rule &curRule,
-                 AcornSettings &settings)
+bool doRuleAcorn(TokenList &Text,
+                 TokenList::iterator &i, Rule &curRule,
+                 AcornSettings &settings, size_t *inserted)
 {
     auto posInText = i;
     std::list<std::string> memory;
-    std::map<std::string, std::list<Token>> ruleVars;
+    std::map<std::string, TokenList> ruleVars;
     bool isMatch = true;
 
     int k = 0;
@@ -952,7 +982,7 @@ void doRuleAcorn(std::list<Token> &Text,
         // Variable table is already built at this point
 
         // Get new contents
-        std::list<Token> newContents;
+        TokenList newContents;
 
         Token templ = *i;
         templ.text = "NULL";
@@ -1050,7 +1080,7 @@ void doRuleAcorn(std::list<Token> &Text,
         for (auto it = newContents.begin();
              it != newContents.end(); it++)
         {
-            it->file = templ.file;
+            it->file_id = templ.file_id;
             it->line = templ.line;
         }
 
@@ -1067,16 +1097,95 @@ void doRuleAcorn(std::list<Token> &Text,
         }
 
         // Insert new contents
+        if (inserted != nullptr)
+        {
+            *inserted = newContents.size();
+        }
+
         i = Text.insert(i, newContents.begin(),
                         newContents.end());
     }
 
-    ruleVars.clear();
+    return isMatch;
+}
+
+void buildRuleIndex(RuleIndex &index, AcornSettings &settings)
+{
+    index = RuleIndex();
+
+    // Special case for dialect-skipping files
+    bool skipDialect =
+        settings.file_tags.count(settings.curFile) != 0 &&
+        settings.file_tags[settings.curFile].count(
+            "no_dialect") != 0;
+
+    std::vector<std::string> names;
+    if (!skipDialect)
+    {
+        names = settings.dialectRules;
+    }
+    names.insert(names.end(), settings.activeRules.begin(),
+                 settings.activeRules.end());
+
+    for (const auto &name : names)
+    {
+        if (settings.rules.count(name) == 0)
+        {
+            continue;
+        }
+
+        Rule &rule = settings.rules[name];
+        int pos = index.rules.size();
+        index.names.push_back(name);
+        index.rules.push_back(&rule);
+
+        // Sapling literals must match verbatim, so the rule can
+        // only ever begin at that literal
+        if (rule.engineName == "sapling" &&
+            !rule.inputPattern.empty() &&
+            !rule.inputPattern.front().text.empty() &&
+            rule.inputPattern.front().text.front() != '$')
+        {
+            const auto &first = rule.inputPattern.front().text;
+            index.byLeadingLiteral[first].push_back(pos);
+        }
+        else
+        {
+            index.wildcards.push_back(pos);
+        }
+    }
+}
+
+int getNextRule(const RuleIndex &index, const std::string &text,
+                const int &last)
+{
+    int out = -1;
+
+    auto next = std::upper_bound(index.wildcards.begin(),
+                                 index.wildcards.end(), last);
+    if (next != index.wildcards.end())
+    {
+        out = *next;
+    }
+
+    auto literal = index.byLeadingLiteral.find(text);
+    if (literal != index.byLeadingLiteral.end())
+    {
+        next = std::upper_bound(literal->second.begin(),
+                                literal->second.end(), last);
+        if (next != literal->second.end() &&
+            (out == -1 || *next < out))
+        {
+            out = *next;
+        }
+    }
+
+    return out;
 }
 
 void addEngine(const std::string &name,
-               void (*hook)(std::list<Token> &,
-                            std::list<Token>::iterator &,
+               void (*hook)(TokenList &,
+                            TokenList::iterator &,
                             Rule &, AcornSettings &),
                AcornSettings &settings)
 {
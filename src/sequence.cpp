@@ -12,17 +12,17 @@ GPLv3 held by author
 
 // Internal consumptive version: Erases from std::list, so not
 // safe for frontend
-ASTNode __createSequence(std::list<Token> &From,
+ASTNode __createSequence(TokenList &From,
                          AcornSettings &settings);
 
-ASTNode createSequence(const std::list<Token> &From,
+ASTNode createSequence(const TokenList &From,
                        AcornSettings &settings)
 {
     // Clone to feed into the consumptive version
-    std::list<Token> temp;
+    TokenList temp;
     temp.assign(From.begin(), From.end());
 
-    std::list<ASTNode> out;
+    ASTList out;
 
     // Feed to consumptive version
     while (!temp.empty())
@@ -59,7 +59,7 @@ ASTNode createSequence(const std::list<Token> &From,
 
 // Internal consumptive version: Erases from std::list, so not
 // safe for frontend
-ASTNode __createSequence(std::list<Token> &From,
+ASTNode __createSequence(TokenList &From,
                          AcornSettings &settings)
 {
     ASTNode out;
@@ -109,7 +109,7 @@ ASTNode __createSequence(std::list<Token> &From,
         sm_assert(!From.empty(),
                   "'let' must be followed by something.");
 
-        std::list<Token> names = {From.front()};
+        TokenList names = {From.front()};
 
         sm_assert(!From.empty(),
                   "Cannot pop from front of empty list.");
@@ -177,7 +177,7 @@ ASTNode __createSequence(std::list<Token> &From,
                 // definition, from let to end curly bracket. So
                 // we must first parse this.
 
-                std::list<Token> toAdd = {Token("let"),
+                TokenList toAdd = {Token("let"),
                                           Token("NAME_HERE")};
 
                 // Add generics back in here
@@ -238,7 +238,8 @@ ASTNode __createSequence(std::list<Token> &From,
                 {
                     for (auto name : names)
                     {
-                        std::next(toAdd.begin())->text = name;
+                        std::next(toAdd.begin())->text =
+                            name.text;
                         if (front == "struct")
                         {
                             // Non-templated struct
@@ -254,7 +255,7 @@ ASTNode __createSequence(std::list<Token> &From,
                 else
                 {
                     // Check for needs / inst block here
-                    std::list<Token> preBlock, postBlock;
+                    TokenList preBlock, postBlock;
 
                     while (!From.empty() &&
                            (From.front() == "pre" ||
@@ -340,7 +341,8 @@ ASTNode __createSequence(std::list<Token> &From,
 
                     for (auto name : names)
                     {
-                        std::next(toAdd.begin())->text = name;
+                        std::next(toAdd.begin())->text =
+                            name.text;
                         addGeneric(toAdd, name, generics,
                                    {front}, preBlock, postBlock,
                                    settings);
@@ -363,7 +365,7 @@ ASTNode __createSequence(std::list<Token> &From,
                           "templated.");
 
                 // Scrape entire definition for this
-                std::list<Token> toAdd = {
+                TokenList toAdd = {
                     Token("let"),
                     Token("NAME_HERE"),
                     Token(":"),
@@ -377,7 +379,7 @@ ASTNode __createSequence(std::list<Token> &From,
 
                         // Scrape entire type!(what) call to a
                         // std::list
-                        std::list<Token> toAnalyze;
+                        TokenList toAnalyze;
                         int count = 0;
 
                         From.pop_front();
@@ -414,7 +416,7 @@ ASTNode __createSequence(std::list<Token> &From,
 
                         // Convert type to lexed std::string vec
                         Lexer dfa_lexer;
-                        std::list<Token> lexedType =
+                        TokenList lexedType =
                             dfa_lexer.lex_list(toStr(&type));
 
                         // Push lexed vec to front of From
@@ -470,18 +472,20 @@ ASTNode __createSequence(std::list<Token> &From,
                               "literal.");
 
                     out.items.push_back(ASTNode{
-                        nullType, std::list<ASTNode>(), atom,
+                        nullType, ASTList(), atom,
                         toStrC(&type, settings, name)});
                     out.items.push_back(
-                        ASTNode{nullType, std::list<ASTNode>(),
+                        ASTNode{nullType, ASTList(),
                                 atom, ";"});
 
                     // Insert into table
-                    settings.table[name].push_back(
+                    addScopedSymbol(
+                        name,
                         MultiTableSymbol{
-                            ASTNode{type, std::list<ASTNode>(),
+                            ASTNode{type, ASTList(),
                                     atom, ""},
-                            type, false, settings.curFile});
+                            type, false, settings.curFile},
+                        settings);
 
                     // Call constructor (pointers do not get
                     // constructors)
@@ -491,10 +495,10 @@ ASTNode __createSequence(std::list<Token> &From,
                     {
                         // Syntactically necessary
                         out.items.push_back(ASTNode{
-                            nullType, std::list<ASTNode>(),
+                            nullType, ASTList(),
                             atom, ";"});
 
-                        std::list<Token> newCall = {
+                        TokenList newCall = {
                             Token("New"), Token("("),
                             Token("@"), Token(name),
                             Token(")")};
@@ -510,7 +514,7 @@ ASTNode __createSequence(std::list<Token> &From,
 
                         // Syntactically necessary
                         out.items.push_back(ASTNode{
-                            nullType, std::list<ASTNode>(),
+                            nullType, ASTList(),
                             atom, ";"});
                     }
                     else if (type[0].info != sarr)
@@ -549,7 +553,7 @@ ASTNode __createSequence(std::list<Token> &From,
             if (generics.size() == 0)
             {
                 // Arguments
-                std::list<Token> argList;
+                TokenList argList;
                 do
                 {
                     argList.push_back(From.front());
@@ -562,16 +566,19 @@ ASTNode __createSequence(std::list<Token> &From,
 
                 auto type = toType(argList, settings);
 
-                auto oldTable = settings.table;
+                const auto scopeMarker =
+                    openSymbolScope(settings);
 
                 auto argsWithType = getArgs(type, settings);
                 for (std::pair<std::string, Type> p :
                      argsWithType)
                 {
-                    settings.table[p.first].push_back(
+                    addScopedSymbol(
+                        p.first,
                         MultiTableSymbol{ASTNode(), p.second,
                                          false,
-                                         settings.curFile});
+                                         settings.curFile},
+                        settings);
                     settings.table[p.first].back().tags.insert(
                         "arg");
                 }
@@ -586,7 +593,7 @@ ASTNode __createSequence(std::list<Token> &From,
 
                 // Scrape contents
                 int count = 0;
-                std::list<Token> toAdd;
+                TokenList toAdd;
 
                 if (From.front() != ";")
                 {
@@ -785,7 +792,7 @@ ASTNode __createSequence(std::list<Token> &From,
                                     .seq.items
                                     .push_back(ASTNode{
                                         nullType,
-                                        std::list<ASTNode>(),
+                                        ASTList(),
                                         atom, ";"});
 
                                 ASTNode toAppend;
@@ -807,7 +814,7 @@ ASTNode __createSequence(std::list<Token> &From,
                         }
 
                         settings.depth++;
-                        std::list<Token> temp;
+                        TokenList temp;
                         temp.assign(toAdd.begin(), toAdd.end());
                         settings.table[name].back().seq =
                             __createSequence(temp, settings);
@@ -845,7 +852,7 @@ ASTNode __createSequence(std::list<Token> &From,
                                     .seq.items
                                     .push_back(ASTNode{
                                         nullType,
-                                        std::list<ASTNode>(),
+                                        ASTList(),
                                         atom, ";"});
 
                                 ASTNode toAppend;
@@ -883,8 +890,7 @@ ASTNode __createSequence(std::list<Token> &From,
                                              settings.curFile});
                     }
 
-                    auto destructors = restoreSymbolTable(
-                        oldTable, settings.table);
+                    closeSymbolScope(scopeMarker, settings);
 
                     settings.currentReturnType = nullType;
                 }
@@ -893,7 +899,7 @@ ASTNode __createSequence(std::list<Token> &From,
             {
                 // Templated function definition
 
-                std::list<Token> returnType,
+                TokenList returnType,
                     toAdd = {Token("let"), Token("NAME_HERE")};
                 std::list<std::string> typeVec;
 
@@ -953,7 +959,7 @@ ASTNode __createSequence(std::list<Token> &From,
                           "template definition.");
 
                 // Check for needs / inst block here
-                std::list<Token> preBlock, postBlock;
+                TokenList preBlock, postBlock;
 
                 while (!From.empty() &&
                        (From.front() == "pre" ||
@@ -1039,7 +1045,7 @@ ASTNode __createSequence(std::list<Token> &From,
                 // Insert templated function
                 for (auto name : names)
                 {
-                    std::next(toAdd.begin())->text = name;
+                    std::next(toAdd.begin())->text = name.text;
                     addGeneric(toAdd, name, generics, typeVec,
                                preBlock, postBlock, settings);
                 }
@@ -1129,6 +1135,8 @@ ASTNode __createSequence(std::list<Token> &From,
                         std::next(settings.table[symb].begin())
                             ->erased = true;
                     }
+
+                    invalidateOverloads(symb, settings);
                 }
 
                 if (!didErase)
@@ -1333,7 +1341,7 @@ ASTNode __createSequence(std::list<Token> &From,
             sm_assert(!From.empty(),
                       "Cannot pop from front of empty list.");
             From.pop_front();
-            std::list<Token> contents;
+            TokenList contents;
 
             do
             {
@@ -1379,7 +1387,9 @@ ASTNode __createSequence(std::list<Token> &From,
                       "'alloc!' received a malformed first "
                       "argument.");
 
-            temp.type.pop_front();
+            Type pointee = temp.type;
+            pointee.pop_front();
+            temp.type = pointee;
 
             if (numType == nullType)
             {
@@ -1401,7 +1411,7 @@ ASTNode __createSequence(std::list<Token> &From,
                       "'alloc!' takes 'u128', not '" +
                           toStr(&numType) + "'.");
 
-            out = getAllocSequence(temp.type, name, settings,
+            out = getAllocSequence(pointee, name, settings,
                                    num);
 
             return out;
@@ -1412,7 +1422,7 @@ ASTNode __createSequence(std::list<Token> &From,
             sm_assert(!From.empty(),
                       "Cannot pop from front of empty list.");
             From.pop_front();
-            std::list<Token> contents;
+            TokenList contents;
 
             do
             {
@@ -1445,7 +1455,6 @@ ASTNode __createSequence(std::list<Token> &From,
                 tempType[0].info == arr ||
                     tempType[0].info == pointer,
                 "'free!' takes an unsized array or pointer.");
-            temp.type.pop_front();
 
             out = getFreeSequence(name, settings);
 
@@ -1457,7 +1466,7 @@ ASTNode __createSequence(std::list<Token> &From,
             sm_assert(!From.empty(),
                       "Cannot pop from front of empty list.");
             From.pop_front();
-            std::list<Token> contents;
+            TokenList contents;
 
             do
             {
@@ -1510,7 +1519,7 @@ ASTNode __createSequence(std::list<Token> &From,
             out.items.clear();
 
             out.items.push_back(
-                ASTNode{nullType, std::list<ASTNode>(), atom,
+                ASTNode{nullType, ASTList(), atom,
                         lhs + " = (void*)(" + rhs + ")"});
 
             return out;
@@ -1521,7 +1530,7 @@ ASTNode __createSequence(std::list<Token> &From,
             sm_assert(!From.empty(),
                       "Cannot pop from front of empty list.");
             From.pop_front();
-            std::list<Token> contents;
+            TokenList contents;
 
             do
             {
@@ -1578,7 +1587,7 @@ ASTNode __createSequence(std::list<Token> &From,
                 throw sequencing_error(
                     "Second argument of ptrarr! must be an "
                     "integer, not " +
-                    toStr(&rhsSeq.type));
+                    toStr(&rhsSeq.type.get()));
             }
 
             out.info = atom;
@@ -1625,7 +1634,7 @@ ASTNode __createSequence(std::list<Token> &From,
                     out.items.front().type[0].name) != 0,
             out.raw +
                 " statement argument must be enum. Instead, '" +
-                toStr(&out.items.front().type) + "'");
+                toStr(&out.items.front().type.get()) + "'");
         sm_assert(!From.empty(),
                   "Missing statement after " + out.raw + "");
 
@@ -1690,7 +1699,7 @@ ASTNode __createSequence(std::list<Token> &From,
         sm_assert(!From.empty(), "'case' must be followed by "
                                  "enumeration option name.");
         out.items.push_back(ASTNode{nullType,
-                                    std::list<ASTNode>{}, atom,
+                                    ASTList{}, atom,
                                     From.front()});
         std::string optionName = From.front();
 
@@ -1715,7 +1724,7 @@ ASTNode __createSequence(std::list<Token> &From,
         {
             captureName = From.front();
             out.items.push_back(ASTNode{nullType,
-                                        std::list<ASTNode>{},
+                                        ASTList{},
                                         atom, From.front()});
             From.pop_front();
 
@@ -1731,7 +1740,7 @@ ASTNode __createSequence(std::list<Token> &From,
             // Padding so that this spot will always refer to
             // the capture variable
             out.items.push_back(ASTNode{
-                nullType, std::list<ASTNode>{}, atom, "NULL"});
+                nullType, ASTList{}, atom, "NULL"});
         }
 
         sm_assert(!From.empty() && From.front() == ")",
@@ -1749,6 +1758,7 @@ ASTNode __createSequence(std::list<Token> &From,
         if (captureName != "NULL")
         {
             settings.table[captureName].pop_back();
+            invalidateOverloads(captureName, settings);
         }
 
         return out;
@@ -1792,7 +1802,8 @@ ASTNode __createSequence(std::list<Token> &From,
                   out.raw +
                       " statement argument must be boolean. "
                       "Instead, '" +
-                      toStr(&out.items.front().type) + "'");
+                      toStr(&out.items.front().type.get()) +
+                      "'");
         sm_assert(!From.empty(),
                   "Missing statement after " + out.raw + "");
 
@@ -1806,7 +1817,7 @@ ASTNode __createSequence(std::list<Token> &From,
         else if (out.items.back().info == code_line)
         {
             out.items.back().items.push_back(ASTNode{
-                nullType, std::list<ASTNode>(), atom, ";"});
+                nullType, ASTList(), atom, ";"});
         }
 
         return out;
@@ -1832,7 +1843,7 @@ ASTNode __createSequence(std::list<Token> &From,
         out.info = code_line;
         out.type = nullType;
         out.items.push_back(ASTNode{
-            nullType, std::list<ASTNode>(), keyword, "return"});
+            nullType, ASTList(), keyword, "return"});
 
         sm_assert(!From.empty(),
                   "Cannot pop from front of empty list.");
@@ -1844,10 +1855,11 @@ ASTNode __createSequence(std::list<Token> &From,
                   "return (void returns are not legal).");
         out.items.push_back(__createSequence(From, settings));
 
-        sm_assert(typesAreSameExact(&settings.currentReturnType,
-                                    &out.items.back().type),
+        sm_assert(typesAreSameExact(
+                      &settings.currentReturnType,
+                      &out.items.back().type.get()),
                   "Cannot return '" +
-                      toStr(&out.items.back().type) +
+                      toStr(&out.items.back().type.get()) +
                       "' from a function w/ return type '" +
                       toStr(&settings.currentReturnType) + "'");
 
@@ -1860,14 +1872,14 @@ ASTNode __createSequence(std::list<Token> &From,
                   "Cannot pop from front of empty list.");
         From.pop_front();
 
-        // Save symbol table for later restoration
-        auto oldTable = settings.table;
+        // Mark symbol table for later restoration
+        const auto scopeMarker = openSymbolScope(settings);
 
         out.info = code_scope;
 
         // Code scope.
         int count = 1;
-        std::list<Token> curVec;
+        TokenList curVec;
         while (true)
         {
             if (From.empty())
@@ -1933,7 +1945,7 @@ ASTNode __createSequence(std::list<Token> &From,
 
         // Fetch destructors
         auto destructors =
-            restoreSymbolTable(oldTable, settings.table);
+            closeSymbolScope(scopeMarker, settings);
         insertDestructors(out, destructors, settings);
 
         // If a void function, call all destructors
@@ -1944,15 +1956,16 @@ ASTNode __createSequence(std::list<Token> &From,
             for (const auto &p : destructors)
             {
                 out.items.push_back(
-                    ASTNode{nullType, std::list<ASTNode>(),
+                    ASTNode{nullType, ASTList(),
                             atom, p.second + ";"});
             }
         }
 
         // Check if/else validity
-        for (auto i = std::next(out.items.begin());
-             i != out.items.end(); i++)
+        for (size_t k = 1; k < out.items.size(); k++)
         {
+            auto i = out.items.begin() + k;
+
             if (i->info == keyword && i->raw == "else")
             {
                 if (std::prev(i)->items.size() != 0 &&
@@ -1971,10 +1984,11 @@ ASTNode __createSequence(std::list<Token> &From,
 
             if (i->type != nullType)
             {
+                const Type &itemType = i->type.get();
                 sm_assert(
                     typesAreSameExact(
-                        &i->type, &settings.currentReturnType),
-                    "Cannot return '" + toStr(&i->type) +
+                        &itemType, &settings.currentReturnType),
+                    "Cannot return '" + toStr(&itemType) +
                         "' from a function w/ return type '" +
                         toStr(&settings.currentReturnType) +
                         "'");
@@ -1991,7 +2005,7 @@ ASTNode __createSequence(std::list<Token> &From,
     ASTNode temp;
     temp.info = atom;
 
-    std::list<Token> tempVec;
+    TokenList tempVec;
     for (auto i : From)
     {
         tempVec.push_back(i);
@@ -2022,11 +2036,127 @@ ASTNode __createSequence(std::list<Token> &From,
     return out;
 } // __createSequence
 
+// Returns the overload of `name` which a call with the given
+// argument types resolves to, or throws if there is none. A
+// call with the same argument types always resolves the same
+// way, so each is only resolved once.
+static const MultiTableSymbol &resolveOverload(
+    const std::string &name, const std::list<Type> &argTypes,
+    AcornSettings &settings)
+{
+    OverloadSet &overloads = getOverloads(name, settings);
+    std::vector<unsigned long long> key;
+    for (const auto &argType : argTypes)
+    {
+        key.push_back(argType.getID());
+    }
+
+    auto memo = overloads.resolved.find(key);
+    if (memo != overloads.resolved.end())
+    {
+        settings.overloadMemoHits++;
+        return *overloads.symbols[memo->second];
+    }
+
+    settings.overloadMemoMisses++;
+
+    // Only overloads of the right arity can match, and only
+    // those with the same leading argument type can match
+    // exactly
+    static const std::vector<int> none;
+    auto arity = overloads.byArity.find(argTypes.size());
+    const std::vector<int> &sameArity =
+        arity == overloads.byArity.end() ? none : arity->second;
+    const std::vector<int> *sameLeading = &sameArity;
+
+    if (!argTypes.empty())
+    {
+        auto leading = overloads.byLeadingType.find(
+            {argTypes.size(), argTypes.front().getExactID()});
+        sameLeading = leading == overloads.byLeadingType.end()
+                          ? &none
+                          : &leading->second;
+    }
+
+    std::list<int> validCandidates;
+
+    // Do stages of candidacy
+    settings.overloadsChecked += sameLeading->size();
+    validCandidates = getExactCandidates(
+        overloads.args, *sameLeading, argTypes);
+
+    if (validCandidates.size() == 0)
+    {
+        settings.overloadsChecked += sameArity.size();
+        validCandidates = getReferenceCandidates(
+            overloads.args, sameArity, argTypes);
+
+        if (validCandidates.size() != 1)
+        {
+            // This also does references
+            settings.overloadsChecked += sameArity.size();
+            validCandidates = getCastingCandidates(
+                overloads.args, sameArity, argTypes);
+        }
+    }
+    else if (validCandidates.size() > 1)
+    {
+        // Ambiguous candidates
+
+        std::cout << tags::red_bold
+                  << "Error: Cannot override function call '"
+                  << name << "' on return type alone.\n"
+                  << tags::reset;
+
+        printCandidateErrors({settings.table[name].begin(),
+                              settings.table[name].end()},
+                             argTypes, name, settings);
+
+        throw sequencing_error(
+            "Cannot override function call '" + name +
+            "' on return type alone");
+    }
+
+    // Remove any erased symbols
+    for (auto item = validCandidates.begin();
+         item != validCandidates.end(); item++)
+    {
+        if (overloads.symbols[*item]->erased)
+        {
+            item = validCandidates.erase(item);
+        }
+    }
+
+    // Error checking
+    if (validCandidates.size() == 0)
+    {
+        // No viable candidates
+
+        std::cout << tags::red_bold
+                  << "Error: No viable candidates for function "
+                     "call '"
+                  << name << "'.\n"
+                  << tags::reset;
+
+        printCandidateErrors({settings.table[name].begin(),
+                              settings.table[name].end()},
+                             argTypes, name, settings);
+
+        throw sequencing_error(
+            "No viable candidates for function call '" + name +
+            "'");
+    }
+
+    // Use candidate at front; This is highest-priority one
+    overloads.resolved[key] = validCandidates.front();
+    return *overloads.symbols[validCandidates.front()];
+}
+
 // This should only be called after method replacement
 // I know I wrote this, but it still feels like black magic and
 // I don't really understand it
-Type resolveFunctionInternal(std::list<Token> &What,
-                             std::list<Token>::iterator &start,
+Type resolveFunctionInternal(TokenList &What,
+                             TokenList::iterator &start,
                              std::list<std::string> &c,
                              AcornSettings &settings)
 {
@@ -2044,6 +2174,7 @@ Type resolveFunctionInternal(std::list<Token> &What,
         std::string name = *start;
 
         if (settings.table.count(name) != 0 &&
+            !settings.table[name].empty() &&
             settings.table[name].front().tags.count("arg") !=
                 0 &&
             *std::next(start) != ".")
@@ -2109,7 +2240,7 @@ Type resolveFunctionInternal(std::list<Token> &What,
     // Parenthesis
     if (*start == "(")
     {
-        std::list<Token> toUse;
+        TokenList toUse;
         int count = 0;
         do
         {
@@ -2227,14 +2358,14 @@ Type resolveFunctionInternal(std::list<Token> &What,
         auto oldDepth = settings.depth;
         settings.depth = 1;
 
-        auto backup = settings.table;
+        const auto scopeMarker = openSymbolScope(settings);
 
         std::string result = instantiateGeneric(
             name, generics, typeVec, settings);
 
         settings.depth = oldDepth;
 
-        restoreSymbolTable(backup, settings.table);
+        closeSymbolScope(scopeMarker, settings);
 
         settings.currentReturnType = oldType;
 
@@ -2280,7 +2411,7 @@ Type resolveFunctionInternal(std::list<Token> &What,
         // Case for size!() macro
 
         // Scrape entire size!(what) call to a std::list
-        std::list<Token> toAnalyze;
+        TokenList toAnalyze;
         int count = 0;
 
         start++;
@@ -2325,7 +2456,7 @@ Type resolveFunctionInternal(std::list<Token> &What,
         // Otherwise unspecified macro
 
         // Scrape entire call to a std::list
-        std::list<Token> toAnalyze = {Token(*start),
+        TokenList toAnalyze = {Token(*start),
                                       Token("(")};
         int count = 0;
 
@@ -2363,8 +2494,8 @@ Type resolveFunctionInternal(std::list<Token> &What,
     if (itCmp(What, start, 1, "("))
     {
         // get args within parenthesis
-        std::list<Token> curArg;
-        std::list<std::list<Token>> args;
+        TokenList curArg;
+        std::list<TokenList> args;
 
         int count = 0, templCount = 0;
         start++;
@@ -2428,7 +2559,7 @@ Type resolveFunctionInternal(std::list<Token> &What,
 
         std::list<Type> argTypes;
         std::vector<std::string> argStrs;
-        for (std::list<Token> arg : args)
+        for (TokenList arg : args)
         {
             std::string cur;
             auto trash = arg.begin();
@@ -2481,145 +2612,32 @@ Type resolveFunctionInternal(std::list<Token> &What,
                       "Function call '" + name +
                           "' has no registered symbols.");
 
-            std::vector<MultiTableSymbol> candidates = {
-                settings.table[name].begin(),
-                settings.table[name].end()};
-
-            // Construct candArgs
-            std::list<std::list<Type>> candArgs;
-            for (auto item : candidates)
-            {
-                Type curType = item.type;
-                while (curType != nullType &&
-                       curType[0].info == pointer)
-                {
-                    curType.pop_front();
-                }
-
-                auto args = getArgs(item.type, settings);
-                candArgs.push_back(std::list<Type>());
-
-                for (auto arg : args)
-                {
-                    if (arg.second == nullType)
-                    {
-                        continue;
-                    }
-
-                    candArgs.back().push_back(arg.second);
-                }
-            }
-
-            std::list<int> validCandidates;
-
-            // Do stages of candidacy
-            validCandidates =
-                getExactCandidates(candArgs, argTypes);
-
-            if (validCandidates.size() == 0)
-            {
-                validCandidates =
-                    getReferenceCandidates(candArgs, argTypes);
-
-                if (validCandidates.size() != 1)
-                {
-                    // This also does references
-                    validCandidates = getCastingCandidates(
-                        candArgs, argTypes);
-                }
-            }
-            else if (validCandidates.size() > 1)
-            {
-                // Ambiguous candidates
-
-                std::cout
-                    << tags::red_bold
-                    << "Error: Cannot override function call '"
-                    << name << "' on return type alone.\n"
-                    << tags::reset;
-
-                printCandidateErrors(candidates, argTypes, name,
-                                     settings);
-
-                throw sequencing_error(
-                    "Cannot override function call '" + name +
-                    "' on return type alone");
-            }
-
-            // Remove any erased symbols
-            for (auto item = validCandidates.begin();
-                 item != validCandidates.end(); item++)
-            {
-                if (candidates[*item].erased)
-                {
-                    item = validCandidates.erase(item);
-                }
-            }
-
-            // Error checking
-            if (validCandidates.size() == 0)
-            {
-                // No viable candidates
-
-                std::cout << tags::red_bold
-                          << "Error: No viable candidates for "
-                             "function call '"
-                          << name << "'.\n"
-                          << tags::reset;
+            const MultiTableSymbol &chosen =
+                resolveOverload(name, argTypes, settings);
 
-                printCandidateErrors(candidates, argTypes, name,
-                                     settings);
+            Type chosenType = chosen.type;
+            type = getReturnType(chosenType, settings);
+            auto candArgsList = getArgs(chosenType, settings);
+            std::vector<std::pair<std::string, Type>>
+                candArgs = {candArgsList.begin(),
+                            candArgsList.end()};
 
-                throw sequencing_error(
-                    "No viable candidates for function call '" +
-                    name + "'");
-            }
-
-            // Use candidate at front; This is highest-priority
-            // one
-            type = getReturnType(
-                candidates[validCandidates.front()].type,
-                settings);
-
-            if (candidates[validCandidates.front()]
-                    .type[0]
-                    .info == pointer)
-            {
-                c.push_back(name);
-                c.push_back("(");
-            }
-            else
-            {
-                c.push_back(mangleSymb(
-                    name,
-                    mangleType(
-                        candidates[validCandidates.front()]
-                            .type)));
-                c.push_back("(");
-            }
+            // The C text of each argument, including any
+            // automatic referencing or dereferencing
+            std::vector<std::string> argC;
 
             int j_ind = -1;
 
             for (auto &j : argTypes)
             {
                 j_ind++;
-                if (j_ind != 0)
-                {
-                    c.push_back(", ");
-                }
+                argC.push_back("");
 
                 // do referencing stuff here for each argument
 
                 int numDeref = 0;
                 // determine actual number here
 
-                auto candArgsList = getArgs(
-                    candidates[validCandidates.front()].type,
-                    settings);
-                std::vector<std::pair<std::string, Type>>
-                    candArgs = {candArgsList.begin(),
-                                candArgsList.end()};
-
                 int candCursor = 0, argCursor = 0;
 
                 while (argCursor < j.size() &&
@@ -2675,13 +2693,15 @@ Type resolveFunctionInternal(std::list<Token> &What,
                 {
                     for (int k = 0; k < numDeref; k++)
                     {
-                        c.push_back("*");
+                        argC.back() += "*";
                     }
                 }
                 else if (numDeref == -1)
                 {
                     if (settings.table.count(argStrs[j_ind]) !=
                             0 &&
+                        !settings.table[argStrs[j_ind]]
+                             .empty() &&
                         settings.table[argStrs[j_ind]]
                                 .front()
                                 .tags.count("arg") != 0)
@@ -2692,12 +2712,13 @@ Type resolveFunctionInternal(std::list<Token> &What,
                             argStrs[j_ind] + "`.");
                     }
 
-                    c.push_back("&");
+                    argC.back() += "&";
                 }
                 else if (numDeref != 0)
                 {
                     std::cout << "With candidates:\n";
-                    for (auto item : candidates)
+                    for (const auto &item :
+                         settings.table[name])
                     {
                         std::cout
                             << std::left << name
@@ -2715,11 +2736,43 @@ Type resolveFunctionInternal(std::list<Token> &What,
                         "is allowed).");
                 }
 
+                argC.back() += "(" + argStrs[j_ind] + ")";
+            }
+
+            std::string nativeC;
+
+            if (chosen.type[0].info == pointer)
+            {
+                // Function pointer call
+                c.push_back(name);
+            }
+            else if (getAtomicOperatorC(name, chosen, argTypes,
+                                        argC, nativeC,
+                                        settings))
+            {
+                // Builtin operator on atomics; No call needed
+                c.push_back(nativeC);
+                argC.clear();
+            }
+            else
+            {
+                c.push_back(
+                    mangleSymb(name, mangleType(chosen.type)));
+            }
+
+            if (nativeC.empty())
+            {
                 c.push_back("(");
-                c.push_back(argStrs[j_ind]);
+                for (size_t k = 0; k < argC.size(); k++)
+                {
+                    if (k != 0)
+                    {
+                        c.push_back(", ");
+                    }
+                    c.push_back(argC[k]);
+                }
                 c.push_back(")");
             }
-            c.push_back(")");
         }
 
         start--;
@@ -2751,7 +2804,7 @@ Type resolveFunctionInternal(std::list<Token> &What,
             sm_assert(settings.table.count(*start) != 0,
                       "No definitions exist for symbol '" +
                           start->text + "'.");
-            auto candidates = settings.table[*start];
+            const auto &candidates = settings.table[*start];
             sm_assert(candidates.size() != 0,
                       "No definitions exist for symbol '" +
                           start->text + "'.");
@@ -2898,8 +2951,8 @@ Type resolveFunctionInternal(std::list<Token> &What,
     return type;
 }
 
-Type resolveFunction(std::list<Token> &What,
-                     std::list<Token>::iterator &start,
+Type resolveFunction(TokenList &What,
+                     TokenList::iterator &start,
                      std::string &c, AcornSettings &settings)
 {
     std::list<std::string> cVec;
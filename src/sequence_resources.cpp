@@ -24,12 +24,12 @@ Type toType(const std::list<std::string> &What,
             AcornSettings &settings)
 {
     Token templ;
-    templ.file = settings.curFile;
+    templ.file_id = intern_file(settings.curFile);
     templ.line = settings.curLine;
     templ.pos = 0;
     templ.state = alpha_state;
 
-    std::list<Token> temp;
+    TokenList temp;
 
     for (const auto &item : What)
     {
@@ -40,7 +40,7 @@ Type toType(const std::list<std::string> &What,
 }
 
 // Converts lexed symbols into a type
-Type toType(const std::list<Token> &WhatIn,
+Type toType(const TokenList &WhatIn,
             AcornSettings &settings)
 {
     if (WhatIn.size() == 0)
@@ -48,7 +48,7 @@ Type toType(const std::list<Token> &WhatIn,
         return Type(atomic, "NULL");
     }
 
-    std::list<Token> What;
+    TokenList What;
     for (Token s : WhatIn)
     {
         What.push_back(s);
@@ -83,7 +83,7 @@ Type toType(const std::list<Token> &WhatIn,
             // Case for type!() macro
 
             // Scrape entire type!(what) call to a std::list
-            std::list<Token> toAnalyze;
+            TokenList toAnalyze;
             int count = 0;
 
             it = What.erase(it);
@@ -118,7 +118,7 @@ Type toType(const std::list<Token> &WhatIn,
 
             // Convert type to lexed std::string vec
             Lexer dfa_lexer;
-            std::list<Token> lexedType =
+            TokenList lexedType =
                 dfa_lexer.lex_list(toStr(&type));
 
             // Push lexed vec to front of From
@@ -191,9 +191,10 @@ Type toType(const std::list<Token> &WhatIn,
             std::list<std::string> temp;
             temp.push_back("struct");
 
-            out[out.size() - 1].name =
-                instantiateGeneric(out[out.size() - 1].name,
-                                   generics, temp, settings);
+            const TypeNode &last = out[out.size() - 1];
+            out.set(out.size() - 1, last.info,
+                    instantiateGeneric(last.name, generics,
+                                       temp, settings));
         }
         else if (cur == ",")
         {
@@ -222,7 +223,7 @@ Type toType(const std::list<Token> &WhatIn,
             try
             {
                 long long result =
-                    stoi(itGet(What, it, 1).text);
+                    std::stoi(itGet(What, it, 1).text);
                 sm_assert(result > 0, "");
             }
             catch (...)
@@ -265,7 +266,7 @@ Type toType(const std::list<Token> &WhatIn,
         }
     }
 
-    for (const auto &what : out.internal)
+    for (const auto &what : out)
     {
         if (what.info == atomic)
         {
@@ -361,7 +362,7 @@ void toCInternal(const ASTNode &What,
         out.push_back(What.raw);
         out.push_back(" ");
 
-        for (auto child : What.items)
+        for (const auto &child : What.items)
         {
             toCInternal(child, out, settings);
             out.push_back(" ");
@@ -403,7 +404,7 @@ void toCInternal(const ASTNode &What,
             // COSTLY CALL:
             int max =
                 std::next(What.items.begin())->items.size();
-            while (max >= 0 &&
+            while (max > 0 &&
                    std::next(std::next(What.items.begin())
                                  ->items.begin(),
                              max - 1)
@@ -441,8 +442,6 @@ void toCInternal(const ASTNode &What,
                     std::string captureName =
                         std::next(cur.items.begin())->raw;
 
-                    auto backupTable = settings.table;
-
                     if (i != 0)
                     {
                         out.push_back("else ");
@@ -559,7 +558,7 @@ void toCInternal(const ASTNode &What,
         {
             out.push_back(What.raw);
             out.push_back(" ");
-            for (auto child : What.items)
+            for (const auto &child : What.items)
             {
                 toCInternal(child, out, settings);
                 out.push_back(" ");
@@ -597,9 +596,10 @@ std::string toC(const ASTNode &What, AcornSettings &settings)
 // Get the return type from a Type (of a function signature)
 Type getReturnType(const Type &T, AcornSettings &settings)
 {
-    if (settings.getReturnTypeCache.count(T.ID) != 0)
+    const unsigned long long id = T.getID();
+    if (settings.getReturnTypeCache.count(id) != 0)
     {
-        return settings.getReturnTypeCache[T.ID];
+        return settings.getReturnTypeCache[id];
     }
 
     Type temp(T);
@@ -620,7 +620,7 @@ Type getReturnType(const Type &T, AcornSettings &settings)
             {
                 Type out(temp, cur + 1);
 
-                settings.getReturnTypeCache[T.ID] = out;
+                settings.getReturnTypeCache[id] = out;
 
                 return out;
             }
@@ -632,7 +632,7 @@ Type getReturnType(const Type &T, AcornSettings &settings)
         settings.getReturnTypeCache.clear();
     }
 
-    settings.getReturnTypeCache[T.ID] = T;
+    settings.getReturnTypeCache[id] = T;
 
     return T;
 }
@@ -641,9 +641,10 @@ std::list<std::pair<std::string, Type>> getArgs(
     Type &type, AcornSettings &settings)
 {
     // Check cache for existing value
-    if (settings.cache.count(type.ID) != 0)
+    const unsigned long long id = type.getID();
+    if (settings.cache.count(id) != 0)
     {
-        return settings.cache[type.ID];
+        return settings.cache[id];
     }
 
     // Get everything between final function and maps
@@ -755,14 +756,14 @@ std::list<std::pair<std::string, Type>> getArgs(
         settings.cache.clear();
     }
 
-    settings.cache[type.ID] = out;
+    settings.cache[id] = out;
 
     // Return
     return out;
 }
 
 // Can throw errors (IE malformed definitions)
-void addStruct(const std::list<Token> &From,
+void addStruct(const TokenList &From,
                AcornSettings &settings)
 {
     // Assert the expression can be properly-formed
@@ -893,7 +894,7 @@ void addStruct(const std::list<Token> &From,
             // name : type ,
             // name , name2 , name3 : type < std::string , hi >
             // , name4 : type2 ,
-            std::list<Token> names, lexedType;
+            TokenList names, lexedType;
 
             while (std::next(it) != From.end() &&
                    *std::next(it) == ",")
@@ -967,7 +968,7 @@ void addStruct(const std::list<Token> &From,
                 settings.table["New"]
                     .back()
                     .seq.items.push_back(
-                        ASTNode{nullType, std::list<ASTNode>(),
+                        ASTNode{nullType, ASTList(),
                                 atom, ";"});
 
                 ASTNode toAppend;
@@ -992,7 +993,7 @@ void addStruct(const std::list<Token> &From,
 }
 
 // Can throw errors (IE malformed definitions)
-void addEnum(const std::list<Token> &From,
+void addEnum(const TokenList &From,
              AcornSettings &settings)
 {
     // Assert the expression can be properly-formed
@@ -1093,7 +1094,7 @@ void addEnum(const std::list<Token> &From,
             // name , name2 , name3 : type < string , hi > ,
             // name4 : type2 ,
             std::list<std::string> names;
-            std::list<Token> lexedType;
+            TokenList lexedType;
 
             while (std::next(i) != From.end() &&
                    *std::next(i) == ",")
@@ -1219,10 +1220,10 @@ void addEnum(const std::list<Token> &From,
 }
 
 // Dump data to file
-void dump(const std::list<Token> &Lexed,
+void dump(const TokenList &Lexed,
           const std::string &Where, const std::string &FileName,
           const int &Line, const ASTNode &FileSeq,
-          const std::list<Token> LexedBackup,
+          const TokenList LexedBackup,
           const std::string &ErrorMsg, AcornSettings &settings)
 {
     std::string sep;
@@ -1421,19 +1422,39 @@ void dump(const std::list<Token> &Lexed,
 
 ////////////////////////////////////////////////////////////////
 
+// Returns the indices of all of the given candidates.
+static std::vector<int> getAllIndices(const size_t &size)
+{
+    std::vector<int> out(size);
+    for (size_t i = 0; i < size; i++)
+    {
+        out[i] = i;
+    }
+    return out;
+}
+
 // Get all candidates which match exactly.
 std::list<int> getExactCandidates(
     const std::list<std::list<Type>> &candArgs,
     const std::list<Type> &argTypes)
+{
+    return getExactCandidates(
+        {candArgs.begin(), candArgs.end()},
+        getAllIndices(candArgs.size()), argTypes);
+}
+
+std::list<int> getExactCandidates(
+    const std::vector<std::list<Type>> &candArgs,
+    const std::vector<int> &among,
+    const std::list<Type> &argTypes)
 {
     std::list<int> out;
     bool isMatch;
 
     // Check for exact match for each candidate
-    int j_ind = -1;
-    for (auto &j : candArgs)
+    for (const int &j_ind : among)
     {
-        j_ind++;
+        const auto &j = candArgs[j_ind];
 
         if (j.size() != argTypes.size())
         {
@@ -1472,6 +1493,16 @@ std::list<int> getExactCandidates(
 std::list<int> getCastingCandidates(
     const std::list<std::list<Type>> &candArgs,
     const std::list<Type> &argTypes)
+{
+    return getCastingCandidates(
+        {candArgs.begin(), candArgs.end()},
+        getAllIndices(candArgs.size()), argTypes);
+}
+
+std::list<int> getCastingCandidates(
+    const std::vector<std::list<Type>> &candArgs,
+    const std::vector<int> &among,
+    const std::list<Type> &argTypes)
 {
     std::list<int> out;
     bool isMatch;
@@ -1481,10 +1512,9 @@ std::list<int> getCastingCandidates(
     auto minIter = out.end();
 
     // Check for exact match for each candidate
-    int j_ind = -1;
-    for (auto j = candArgs.begin(); j != candArgs.end(); j++)
+    for (const int &j_ind : among)
     {
-        j_ind++;
+        auto j = candArgs.begin() + j_ind;
 
         if (j->size() != argTypes.size())
         {
@@ -1538,6 +1568,16 @@ std::list<int> getCastingCandidates(
 std::list<int> getReferenceCandidates(
     const std::list<std::list<Type>> &candArgs,
     const std::list<Type> &argTypes)
+{
+    return getReferenceCandidates(
+        {candArgs.begin(), candArgs.end()},
+        getAllIndices(candArgs.size()), argTypes);
+}
+
+std::list<int> getReferenceCandidates(
+    const std::vector<std::list<Type>> &candArgs,
+    const std::vector<int> &among,
+    const std::list<Type> &argTypes)
 {
     std::list<int> out;
     bool isMatch;
@@ -1545,10 +1585,9 @@ std::list<int> getReferenceCandidates(
     auto minIter = out.end();
 
     // Check for exact match for each candidate
-    int j_ind = -1;
-    for (auto &j : candArgs)
+    for (const int &j_ind : among)
     {
-        j_ind++;
+        const auto &j = candArgs[j_ind];
 
         if (j.size() != argTypes.size())
         {
@@ -1597,6 +1636,209 @@ std::list<int> getReferenceCandidates(
     return out;
 }
 
+OverloadSet &getOverloads(const std::string &name,
+                          AcornSettings &settings)
+{
+    const std::list<MultiTableSymbol> &entries =
+        settings.table.at(name);
+    OverloadSet &out = settings.overloads[name];
+
+    if (out.list == &entries && out.size == entries.size())
+    {
+        return out;
+    }
+
+    out = OverloadSet();
+    out.list = &entries;
+    out.size = entries.size();
+
+    for (const MultiTableSymbol &item : entries)
+    {
+        const int index = out.symbols.size();
+        out.symbols.push_back(&item);
+        out.args.push_back(std::list<Type>());
+
+        Type type = item.type;
+        for (const auto &arg : getArgs(type, settings))
+        {
+            if (arg.second != nullType)
+            {
+                out.args.back().push_back(arg.second);
+            }
+        }
+
+        const std::list<Type> &args = out.args.back();
+        out.byArity[args.size()].push_back(index);
+
+        if (!args.empty())
+        {
+            out.byLeadingType[{args.size(),
+                               args.front().getExactID()}]
+                .push_back(index);
+        }
+    }
+
+    return out;
+}
+
+void invalidateOverloads(const std::string &name,
+                         AcornSettings &settings)
+{
+    settings.overloads.erase(name);
+}
+
+////////////////////////////////////////////////////////////////
+
+// Lowers operator calls on numeric and boolean atomics to
+// native `C` operators, so that they can be inlined by the `C`
+// compiler instead of being calls into `std/atom_math.o`. Only
+// the declarations in `std/atom_math.oak` are lowered.
+bool getAtomicOperatorC(const std::string &name,
+                        const MultiTableSymbol &candidate,
+                        const std::list<Type> &argTypes,
+                        const std::vector<std::string> &argC,
+                        std::string &out,
+                        AcornSettings &settings)
+{
+    out.clear();
+
+    // Only bodiless (externally linked) definitions are
+    // builtin; Anything with an `Oak` body is called as normal.
+    if (!candidate.seq.items.empty())
+    {
+        return false;
+    }
+
+    // Symbol paths are canonical, so this one must be too
+    static const std::string builtinFile =
+        fs::weakly_canonical(ATOMIC_OPERATORS_FILE).string();
+    if (candidate.sourceFilePath != builtinFile)
+    {
+        return false;
+    }
+
+    std::string op;
+    size_t expectedArgs;
+    bool isBinary = false, isAssignment = false;
+
+    if (ATOMIC_BINARY_OPERATORS.count(name) != 0)
+    {
+        op = ATOMIC_BINARY_OPERATORS.at(name);
+        expectedArgs = 2;
+        isBinary = true;
+    }
+    else if (ATOMIC_ASSIGNMENT_OPERATORS.count(name) != 0)
+    {
+        op = ATOMIC_ASSIGNMENT_OPERATORS.at(name);
+        expectedArgs = 2;
+        isAssignment = true;
+    }
+    else if (ATOMIC_UNARY_OPERATORS.count(name) != 0)
+    {
+        op = ATOMIC_UNARY_OPERATORS.at(name);
+        expectedArgs = 1;
+    }
+    else
+    {
+        return false;
+    }
+
+    Type candType = candidate.type;
+    auto candArgs = getArgs(candType, settings);
+    Type returnType = getReturnType(candType, settings);
+
+    if (candArgs.size() != expectedArgs ||
+        argC.size() != expectedArgs ||
+        argTypes.size() != expectedArgs ||
+        returnType.size() != 1 || returnType[0].info != atomic)
+    {
+        return false;
+    }
+
+    // Build the operands, ensuring all are builtin atomics
+    std::vector<std::string> operands;
+    auto argType = argTypes.begin();
+    auto argText = argC.begin();
+    for (const auto &candArg : candArgs)
+    {
+        Type paramType = candArg.second;
+        bool isPointer = false;
+
+        if (paramType.size() == 2 &&
+            paramType[0].info == pointer)
+        {
+            paramType = Type(paramType, 1);
+            isPointer = true;
+        }
+
+        if (paramType.size() != 1 ||
+            paramType[0].info != atomic ||
+            ATOMICS.count(paramType[0].name) == 0 ||
+            paramType[0].name == "str" ||
+            paramType[0].name == "void" ||
+            paramType[0].name == "struct" ||
+            paramType[0].name == "enum")
+        {
+            return false;
+        }
+
+        // Assignment, increment and decrement need an lvalue
+        if ((isAssignment || (!isBinary && op != "!")) &&
+            operands.empty() && !isPointer)
+        {
+            return false;
+        }
+
+        if (isPointer)
+        {
+            // `&(x)` becomes `(x)`, anything else is dereffed
+            if (!argText->empty() && argText->front() == '&')
+            {
+                operands.push_back(argText->substr(1));
+            }
+            else
+            {
+                operands.push_back("(*" + *argText + ")");
+            }
+        }
+        else if (!typesAreSameExact(&*argType, &paramType))
+        {
+            // Literal casting; Convert as the call would have
+            operands.push_back("((" + paramType[0].name + ")" +
+                               *argText + ")");
+        }
+        else
+        {
+            operands.push_back(*argText);
+        }
+
+        argType++;
+        argText++;
+    }
+
+    if (isAssignment)
+    {
+        out = "(" + operands[0] + op + operands[1] + ")";
+    }
+    else if (isBinary)
+    {
+        // Cast back down, since `C` promotes small integers
+        out = "((" + returnType[0].name + ")(" + operands[0] +
+              op + operands[1] + "))";
+    }
+    else if (op == "!")
+    {
+        out = "((" + returnType[0].name + ")(!" + operands[0] +
+              "))";
+    }
+    else
+    {
+        out = "(" + op + operands[0] + ")";
+    }
+
+    return true;
+}
+
 ////////////////////////////////////////////////////////////////
 
 // Prints the reason why each candidate was rejected
@@ -1787,6 +2029,7 @@ void destroyUnits(const std::string &name, const Type &type,
                          "//AUTOGEN"))
                 {
                     i = settings.table[name].erase(i);
+                    invalidateOverloads(name, settings);
                 }
 
                 // Else if doThrow, throw redef error
@@ -1833,8 +2076,8 @@ void debugPrint(const ASTNode &What, int spaces,
     }
 
     to << " w/ raw " << What.raw << ", type "
-       << toStr(&What.type) << ":\n";
-    for (auto s : What.items)
+       << toStr(&What.type.get()) << ":\n";
+    for (const auto &s : What.items)
     {
         debugPrint(s, spaces + 1, to);
     }
@@ -1854,8 +2097,8 @@ std::string getMemberNew(const std::string &selfName,
 
         // Ensure function exists
         bool isValid = false;
-        auto candidates = settings.table["New"];
-        for (auto candidate : candidates)
+        const auto &candidates = settings.table["New"];
+        for (const auto &candidate : candidates)
         {
             if (candidate.type[0].info != function ||
                 candidate.type.size() < 4 ||
@@ -1907,8 +2150,8 @@ std::string getMemberDel(const std::string &selfName,
 
         // Ensure function exists
         bool isValid = false;
-        auto candidates = settings.table["Del"];
-        for (auto candidate : candidates)
+        const auto &candidates = settings.table["Del"];
+        for (const auto &candidate : candidates)
         {
             if (candidate.type[0].info != function ||
                 candidate.type.size() < 4 ||
@@ -2016,7 +2259,7 @@ std::string insertDestructorsRecursive(
                 // Insert the thing returned
 
                 i = what.items.insert(
-                    i, ASTNode{nullType, std::list<ASTNode>(),
+                    i, ASTNode{nullType, ASTList(),
                                atom, out});
                 i++;
             }
@@ -0,0 +1,510 @@
+/*
+A persistent compile server. `acorn --server` warms up once
+(reading every installed package's snapshot into memory, and
+processing each file which may be included from a package) and
+then handles each compile request on a UNIX socket in a process
+forked from that warm state. Every compile gets a fresh fork
+with the client's working directory, environment and standard
+streams, so its results are those of a cold `acorn` run with the
+same arguments. The exceptions are the server's own limits and
+credentials, such as its resource limits and umask. `acorn
+--client` is the thin client, which passes all of the above to
+the server.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "oakc_fns.hpp"
+#include "options.hpp"
+#include "tags.hpp"
+#include <cerrno>
+#include <csignal>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// Sent to the client in place of an exit status if the server
+// cannot compile for it.
+const static int32_t SERVER_REFUSED = -1;
+
+// The number of clients which may wait to be accepted.
+const static int SERVER_BACKLOG = 64;
+
+std::string getServerSocketPath()
+{
+    const char *dir = getenv("XDG_RUNTIME_DIR");
+    return std::string(dir != nullptr ? dir : "/tmp") +
+           "/acorn_" + std::to_string(getuid()) + ".sock";
+}
+
+// Fills in the address of the given socket path. Returns false
+// if the path is too long for one.
+static bool getAddress(const std::string &path,
+                       sockaddr_un &address)
+{
+    memset(&address, 0, sizeof(address));
+    address.sun_family = AF_UNIX;
+
+    if (path.size() >= sizeof(address.sun_path))
+    {
+        return false;
+    }
+
+    memcpy(address.sun_path, path.c_str(), path.size());
+    return true;
+}
+
+// Reads exactly `size` bytes. Returns false on failure.
+static bool readAll(const int &fd, void *into, size_t size)
+{
+    char *pos = (char *)into;
+    while (size > 0)
+    {
+        ssize_t got = read(fd, pos, size);
+        if (got < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (got <= 0)
+        {
+            return false;
+        }
+
+        pos += got;
+        size -= got;
+    }
+
+    return true;
+}
+
+// Sends exactly `size` bytes over a socket. Returns false on
+// failure, including if the other end has gone away.
+static bool sendAll(const int &fd, const void *from,
+                    size_t size)
+{
+    const char *pos = (const char *)from;
+    while (size > 0)
+    {
+        ssize_t sent = send(fd, pos, size, MSG_NOSIGNAL);
+        if (sent < 0 && errno == EINTR)
+        {
+            continue;
+        }
+        else if (sent <= 0)
+        {
+            return false;
+        }
+
+        pos += sent;
+        size -= sent;
+    }
+
+    return true;
+}
+
+// Handles a single connection, in a process of its own. The
+// request is its length (sent alongside the client's standard
+// streams), then the client's compiler stamp, working
+// directory, number of environment variables, environment
+// variables and arguments, each null-terminated. The reply is
+// the exit status of the compile.
+static void handleRequest(const int &connection,
+                          int (*compile)(const int,
+                                         const char *[]))
+{
+    // Only the user who started the server may use it
+    ucred credentials;
+    socklen_t length = sizeof(credentials);
+    if (getsockopt(connection, SOL_SOCKET, SO_PEERCRED,
+                   &credentials, &length) != 0 ||
+        credentials.uid != getuid())
+    {
+        return;
+    }
+
+    uint64_t size = 0;
+    int fds[3];
+    char control[CMSG_SPACE(sizeof(fds))];
+    iovec data = {&size, sizeof(size)};
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    if (recvmsg(connection, &message, MSG_WAITALL) !=
+        sizeof(size))
+    {
+        return;
+    }
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    if (header == nullptr || header->cmsg_type != SCM_RIGHTS ||
+        header->cmsg_len != CMSG_LEN(sizeof(fds)))
+    {
+        return;
+    }
+    memcpy(fds, CMSG_DATA(header), sizeof(fds));
+
+    std::string request(size, '\0');
+    std::vector<std::string> fields;
+    if (!readAll(connection, &request[0], size))
+    {
+        return;
+    }
+
+    for (size_t start = 0; start < request.size();)
+    {
+        size_t end = request.find('\0', start);
+        if (end == std::string::npos)
+        {
+            end = request.size();
+        }
+
+        fields.push_back(request.substr(start, end - start));
+        start = end + 1;
+    }
+
+    // A client of another compiler must compile on its own.
+    // The compile writes a byte to `replied` once it has sent
+    // the status, so that exactly one reply is ever sent.
+    size_t envCount = 0;
+    if (fields.size() >= 3)
+    {
+        envCount = strtoull(fields[2].c_str(), nullptr, 10);
+    }
+
+    int32_t status = SERVER_REFUSED;
+    pid_t pid = -1;
+    int replied[2] = {-1, -1};
+    if (fields.size() >= 3 && envCount <= fields.size() - 3 &&
+        fields[0] == std::to_string(getCompilerStamp()) &&
+        pipe2(replied, O_CLOEXEC) == 0)
+    {
+        pid = fork();
+    }
+
+    if (pid == 0)
+    {
+        close(replied[0]);
+
+        // Files loaded from here on only need to outlive this
+        // compile, so may be mapped again
+        set_source_mapping(true);
+
+        for (int i = 0; i < 3; i++)
+        {
+            dup2(fds[i], i);
+            close(fds[i]);
+        }
+
+        if (chdir(fields[1].c_str()) != 0)
+        {
+            std::cerr << "Cannot enter directory '"
+                      << fields[1] << "'\n";
+            _exit(1);
+        }
+
+        // Compiles as if run from the client's environment.
+        // The fields outlive the compile, so may be used as is.
+        clearenv();
+        for (size_t i = 3; i < 3 + envCount; i++)
+        {
+            putenv(&fields[i][0]);
+        }
+
+        std::vector<const char *> argv = {"acorn"};
+        for (size_t i = 3 + envCount; i < fields.size(); i++)
+        {
+            argv.push_back(fields[i].c_str());
+        }
+
+        // A new thread gets its own malloc arena and stack, so
+        // the compile does not copy the warm state's pages
+        int code = 0;
+        std::thread worker([&]()
+                           { code = compile(argv.size(),
+                                            argv.data()); });
+        worker.join();
+
+        // Replies before exiting, since tearing down the copied
+        // address space is slow. Skips the destructors of the
+        // warm state, which would only copy its pages to free
+        // them. The parent only replies if the compile crashed
+        // or exited on its own.
+        std::cout.flush();
+        std::cerr.flush();
+        fflush(nullptr);
+        status = code;
+        if (sendAll(connection, &status, sizeof(status)))
+        {
+            char done = 1;
+            while (write(replied[1], &done, 1) < 0 &&
+                   errno == EINTR)
+            {
+            }
+        }
+        _exit(code);
+    }
+
+    for (int i = 0; i < 3; i++)
+    {
+        close(fds[i]);
+    }
+
+    if (replied[1] != -1)
+    {
+        close(replied[1]);
+    }
+
+    if (pid > 0)
+    {
+        int result = 0;
+        while (waitpid(pid, &result, 0) < 0 && errno == EINTR)
+        {
+        }
+
+        // The child's end is closed now, so this cannot block
+        char done = 0;
+        ssize_t got;
+        while ((got = read(replied[0], &done, 1)) < 0 &&
+               errno == EINTR)
+        {
+        }
+
+        if (got == 1)
+        {
+            close(replied[0]);
+            return;
+        }
+
+        status = WIFEXITED(result) ? WEXITSTATUS(result)
+                                   : 128 + WTERMSIG(result);
+    }
+
+    if (replied[0] != -1)
+    {
+        close(replied[0]);
+    }
+
+    sendAll(connection, &status, sizeof(status));
+}
+
+int serveCompiles(const std::string &path,
+                  int (*compile)(const int, const char *[]))
+{
+    sockaddr_un address;
+    if (!getAddress(path, address))
+    {
+        std::cout << tags::red_bold << "Socket path '" << path
+                  << "' is too long.\n"
+                  << tags::reset;
+        return 1;
+    }
+
+    // A socket file may be left behind by a server which was
+    // killed, but a live one must not be replaced
+    int listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listener >= 0 &&
+        connect(listener, (sockaddr *)&address,
+                sizeof(address)) == 0)
+    {
+        std::cout << tags::red_bold
+                  << "A server is already running on '" << path
+                  << "'.\n"
+                  << tags::reset;
+        close(listener);
+        return 1;
+    }
+    close(listener);
+    unlink(path.c_str());
+
+    // Other users may not connect
+    listener = socket(AF_UNIX, SOCK_STREAM, 0);
+    mode_t oldMask = umask(0077);
+    bool isBound = listener >= 0 &&
+                   bind(listener, (sockaddr *)&address,
+                        sizeof(address)) == 0 &&
+                   listen(listener, SERVER_BACKLOG) == 0;
+    umask(oldMask);
+
+    if (!isBound)
+    {
+        std::cout << tags::red_bold << "Failed to serve on '"
+                  << path << "': " << strerror(errno) << '\n'
+                  << tags::reset;
+        return 1;
+    }
+
+    // The warm state outlives any one request, so must not map
+    // files which may be truncated while it is kept
+    set_source_mapping(false);
+
+    // Warm up
+    unsigned int resident = 0, included = 0;
+    if (fs::is_directory(PACKAGE_INCLUDE_PATH))
+    {
+        for (const auto &entry :
+             fs::directory_iterator(PACKAGE_INCLUDE_PATH))
+        {
+            const std::string name =
+                entry.path().filename().string();
+            if (!fs::exists(entry.path() / SNAPSHOT_FILE))
+            {
+                continue;
+            }
+
+            // Stale snapshots are rebuilt once here, instead
+            // of by every request
+            if (!keepPackageSnapshot(name))
+            {
+                try
+                {
+                    AcornSettings settings;
+                    buildPackageSnapshot(name, settings);
+                }
+                catch (...)
+                {
+                    continue;
+                }
+            }
+
+            if (keepPackageSnapshot(name))
+            {
+                resident++;
+            }
+        }
+
+        // Each file a program may include from a package is
+        // then processed once, so that requests which include
+        // it into an empty state start from the result
+        for (const auto &entry :
+             fs::directory_iterator(PACKAGE_INCLUDE_PATH))
+        {
+            if (!entry.is_directory())
+            {
+                continue;
+            }
+
+            for (const auto &file :
+                 fs::directory_iterator(entry.path()))
+            {
+                if (file.path().extension() == ".oak" &&
+                    keepIncludeState(file.path().string()))
+                {
+                    included++;
+                }
+            }
+        }
+    }
+
+    std::cout << tags::green_bold << "Serving compiles on '"
+              << path << "' with " << resident
+              << " package snapshot(s) and " << included
+              << " included file(s) resident.\n"
+              << tags::reset << std::flush;
+
+    // Connections are handled by processes of their own, which
+    // are reaped automatically. This process never compiles
+    // again, so what it has interned is bounded by the warm up.
+    signal(SIGCHLD, SIG_IGN);
+    while (true)
+    {
+        int connection = accept(listener, nullptr, nullptr);
+        if (connection < 0)
+        {
+            continue;
+        }
+
+        if (fork() == 0)
+        {
+            close(listener);
+            signal(SIGCHLD, SIG_DFL);
+            handleRequest(connection, compile);
+            _exit(0);
+        }
+
+        close(connection);
+    }
+}
+
+int requestCompile(const std::string &path,
+                   const std::vector<std::string> &args)
+{
+    sockaddr_un address;
+    if (!getAddress(path, address))
+    {
+        return SERVER_REFUSED;
+    }
+
+    int connection = socket(AF_UNIX, SOCK_STREAM, 0);
+    if (connection < 0)
+    {
+        return SERVER_REFUSED;
+    }
+    else if (connect(connection, (sockaddr *)&address,
+                     sizeof(address)) != 0)
+    {
+        close(connection);
+        return SERVER_REFUSED;
+    }
+
+    std::string request = std::to_string(getCompilerStamp()) +
+                          '\0' + fs::current_path().string() +
+                          '\0';
+
+    size_t envCount = 0;
+    std::string env;
+    for (char **var = environ; *var != nullptr; var++)
+    {
+        env += std::string(*var) + '\0';
+        envCount++;
+    }
+    request += std::to_string(envCount) + '\0' + env;
+
+    for (const auto &arg : args)
+    {
+        request += arg + '\0';
+    }
+
+    // The length goes along with this process' standard streams
+    uint64_t size = request.size();
+    int fds[3] = {STDIN_FILENO, STDOUT_FILENO, STDERR_FILENO};
+    char control[CMSG_SPACE(sizeof(fds))];
+    memset(control, 0, sizeof(control));
+    iovec data = {&size, sizeof(size)};
+    msghdr message;
+    memset(&message, 0, sizeof(message));
+    message.msg_iov = &data;
+    message.msg_iovlen = 1;
+    message.msg_control = control;
+    message.msg_controllen = sizeof(control);
+
+    cmsghdr *header = CMSG_FIRSTHDR(&message);
+    header->cmsg_level = SOL_SOCKET;
+    header->cmsg_type = SCM_RIGHTS;
+    header->cmsg_len = CMSG_LEN(sizeof(fds));
+    memcpy(CMSG_DATA(header), fds, sizeof(fds));
+
+    int32_t status = SERVER_REFUSED;
+    if (sendmsg(connection, &message, MSG_NOSIGNAL) !=
+            sizeof(size) ||
+        !sendAll(connection, request.data(), request.size()) ||
+        !readAll(connection, &status, sizeof(status)))
+    {
+        status = SERVER_REFUSED;
+    }
+
+    close(connection);
+    return status;
+}
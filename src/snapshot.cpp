@@ -0,0 +1,1052 @@
+/*
+Precompiled package snapshots. When a package is loaded into an
+otherwise empty compiler state, everything it added to that
+state is saved in a versioned binary file within the package's
+install directory. Later loads restore the state directly
+instead of lexing, preprocessing and sequencing every file of
+the package again. A snapshot is only used while the package's
+files and the compiler itself are unchanged.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "oakc_fns.hpp"
+#include "oakc_structs.hpp"
+#include "options.hpp"
+#include "tags.hpp"
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+// Identifies a package snapshot file.
+const static std::string SNAPSHOT_MAGIC = "OAKSNAP";
+
+// Returns the path of the given package's snapshot.
+static std::string getSnapshotPath(const std::string &Name)
+{
+    return PACKAGE_INCLUDE_PATH + Name + "/" + SNAPSHOT_FILE;
+}
+
+// Preprocessor definitions which `doFile` sets itself. Each
+// file redefines these before use, so they are not saved.
+const static std::set<std::string> BUILTIN_DEFINES = {
+    "prev_file!", "file!", "comp_time!",
+    "oak_version!", "sys!", "line!"};
+
+// Returns true if loading a package into the given state is
+// equivalent to merging the package's snapshot into it. This
+// is the case iff nothing which could affect the processing of
+// the package has been loaded yet.
+static bool isPristine(const AcornSettings &settings)
+{
+    for (const auto &p : settings.preprocDefines)
+    {
+        if (BUILTIN_DEFINES.count(p.first) == 0)
+        {
+            return false;
+        }
+    }
+
+    return settings.table.empty() &&
+           settings.structData.empty() &&
+           settings.enumData.empty() &&
+           settings.structOrder.empty() &&
+           settings.generics.empty() &&
+           settings.rules.empty() && settings.bundles.empty() &&
+           settings.macros.empty() &&
+           !settings.ignoreSyntaxErrors;
+}
+
+////////////////////////////////////////////////////////////////
+// Serialization. Integers are stored in host byte order: Like
+// a precompiled header, a snapshot is only meant for the
+// machine which made it.
+////////////////////////////////////////////////////////////////
+
+// A position within a snapshot being read.
+struct SnapshotReader
+{
+    const std::string &data;
+    size_t pos = 0;
+};
+
+static void putInt(std::string &to,
+                   const unsigned long long &what)
+{
+    to.append((const char *)&what, sizeof(what));
+}
+
+static unsigned long long getInt(SnapshotReader &from)
+{
+    unsigned long long out;
+    if (from.pos + sizeof(out) > from.data.size())
+    {
+        throw package_error("Truncated package snapshot");
+    }
+
+    memcpy(&out, from.data.data() + from.pos, sizeof(out));
+    from.pos += sizeof(out);
+    return out;
+}
+
+static void put(std::string &to, const std::string &what)
+{
+    putInt(to, what.size());
+    to.append(what);
+}
+
+static void get(SnapshotReader &from, std::string &into)
+{
+    unsigned long long size = getInt(from);
+    if (from.pos + size > from.data.size())
+    {
+        throw package_error("Truncated package snapshot");
+    }
+
+    into.assign(from.data, from.pos, size);
+    from.pos += size;
+}
+
+static void put(std::string &to, const bool &what)
+{
+    putInt(to, what);
+}
+
+static void get(SnapshotReader &from, bool &into)
+{
+    into = getInt(from) != 0;
+}
+
+static void put(std::string &to, const unsigned long long &what)
+{
+    putInt(to, what);
+}
+
+static void get(SnapshotReader &from, unsigned long long &into)
+{
+    into = getInt(from);
+}
+
+// Compound types may nest one another, so they are all declared
+// up front.
+static void put(std::string &to, const Token &what);
+static void get(SnapshotReader &from, Token &into);
+static void put(std::string &to, const Type &what);
+static void get(SnapshotReader &from, Type &into);
+static void put(std::string &to, const ASTNode &what);
+static void get(SnapshotReader &from, ASTNode &into);
+static void put(std::string &to, const MultiTableSymbol &what);
+static void get(SnapshotReader &from, MultiTableSymbol &into);
+static void put(std::string &to, const StructLookupData &what);
+static void get(SnapshotReader &from, StructLookupData &into);
+static void put(std::string &to, const EnumLookupData &what);
+static void get(SnapshotReader &from, EnumLookupData &into);
+static void put(std::string &to, const GenericInfo &what);
+static void get(SnapshotReader &from, GenericInfo &into);
+static void put(std::string &to, const Rule &what);
+static void get(SnapshotReader &from, Rule &into);
+static void put(std::string &to, const PackageInfo &what);
+static void get(SnapshotReader &from, PackageInfo &into);
+
+template <typename T, typename A>
+static void put(std::string &to, const std::list<T, A> &what);
+template <typename T, typename A>
+static void get(SnapshotReader &from, std::list<T, A> &into);
+template <typename T>
+static void put(std::string &to, const std::vector<T> &what);
+template <typename T>
+static void get(SnapshotReader &from, std::vector<T> &into);
+template <typename T>
+static void put(std::string &to, const std::set<T> &what);
+template <typename T>
+static void get(SnapshotReader &from, std::set<T> &into);
+template <typename K, typename V>
+static void put(std::string &to, const std::map<K, V> &what);
+template <typename K, typename V>
+static void get(SnapshotReader &from, std::map<K, V> &into);
+
+template <typename T, typename A>
+static void put(std::string &to, const std::list<T, A> &what)
+{
+    putInt(to, what.size());
+    for (const auto &item : what)
+    {
+        put(to, item);
+    }
+}
+
+template <typename T, typename A>
+static void get(SnapshotReader &from, std::list<T, A> &into)
+{
+    into.clear();
+    for (unsigned long long i = getInt(from); i > 0; i--)
+    {
+        into.emplace_back();
+        get(from, into.back());
+    }
+}
+
+template <typename T>
+static void put(std::string &to, const std::vector<T> &what)
+{
+    putInt(to, what.size());
+    for (const auto &item : what)
+    {
+        put(to, item);
+    }
+}
+
+template <typename T>
+static void get(SnapshotReader &from, std::vector<T> &into)
+{
+    into.clear();
+    for (unsigned long long i = getInt(from); i > 0; i--)
+    {
+        into.emplace_back();
+        get(from, into.back());
+    }
+}
+
+template <typename T>
+static void put(std::string &to, const std::set<T> &what)
+{
+    putInt(to, what.size());
+    for (const auto &item : what)
+    {
+        put(to, item);
+    }
+}
+
+template <typename T>
+static void get(SnapshotReader &from, std::set<T> &into)
+{
+    into.clear();
+    for (unsigned long long i = getInt(from); i > 0; i--)
+    {
+        T item;
+        get(from, item);
+        into.insert(item);
+    }
+}
+
+template <typename K, typename V>
+static void put(std::string &to, const std::map<K, V> &what)
+{
+    putInt(to, what.size());
+    for (const auto &item : what)
+    {
+        put(to, item.first);
+        put(to, item.second);
+    }
+}
+
+template <typename K, typename V>
+static void get(SnapshotReader &from, std::map<K, V> &into)
+{
+    into.clear();
+    for (unsigned long long i = getInt(from); i > 0; i--)
+    {
+        K key;
+        get(from, key);
+        get(from, into[key]);
+    }
+}
+
+static void put(std::string &to, const Token &what)
+{
+    put(to, what.text);
+    putInt(to, what.state);
+    putInt(to, what.line);
+    putInt(to, what.pos);
+    put(to, what.file());
+}
+
+static void get(SnapshotReader &from, Token &into)
+{
+    std::string text, file;
+
+    get(from, text);
+    into.text = text;
+    into.state = (LexerState)getInt(from);
+    into.line = getInt(from);
+    into.pos = getInt(from);
+    get(from, file);
+    into.file_id = intern_file(file);
+}
+
+static void put(std::string &to, const Type &what)
+{
+    putInt(to, what.size());
+    for (const auto &node : what)
+    {
+        putInt(to, node.info);
+        put(to, node.name);
+    }
+}
+
+static void get(SnapshotReader &from, Type &into)
+{
+    // Rebuilt via the member functions so that the interned IDs
+    // are recomputed for this process
+    Type out;
+    out.pop_front();
+
+    std::string name;
+    for (unsigned long long i = getInt(from); i > 0; i--)
+    {
+        TypeInfo info = (TypeInfo)getInt(from);
+        get(from, name);
+        out.append(info, name);
+    }
+
+    into = out;
+}
+
+static void put(std::string &to, const ASTNode &what)
+{
+    put(to, what.type.get());
+    put(to, what.items);
+    putInt(to, what.info);
+    put(to, what.raw);
+}
+
+static void get(SnapshotReader &from, ASTNode &into)
+{
+    Type type;
+    get(from, type);
+    into.type = type;
+    get(from, into.items);
+    into.info = (SequenceInfo)getInt(from);
+    get(from, into.raw);
+}
+
+static void put(std::string &to, const MultiTableSymbol &what)
+{
+    put(to, what.seq);
+    put(to, what.type);
+    put(to, what.erased);
+    put(to, what.sourceFilePath);
+    put(to, what.line);
+    put(to, what.tags);
+}
+
+static void get(SnapshotReader &from, MultiTableSymbol &into)
+{
+    get(from, into.seq);
+    get(from, into.type);
+    get(from, into.erased);
+    get(from, into.sourceFilePath);
+    get(from, into.line);
+    get(from, into.tags);
+}
+
+static void put(std::string &to, const StructLookupData &what)
+{
+    put(to, what.members);
+    put(to, what.order);
+    put(to, what.erased);
+}
+
+static void get(SnapshotReader &from, StructLookupData &into)
+{
+    get(from, into.members);
+    get(from, into.order);
+    get(from, into.erased);
+}
+
+static void put(std::string &to, const EnumLookupData &what)
+{
+    put(to, what.options);
+    put(to, what.order);
+    put(to, what.erased);
+}
+
+static void get(SnapshotReader &from, EnumLookupData &into)
+{
+    get(from, into.options);
+    get(from, into.order);
+    get(from, into.erased);
+}
+
+static void put(std::string &to, const GenericInfo &what)
+{
+    put(to, what.typeVec);
+    put(to, what.originFile);
+    put(to, what.symbols);
+    put(to, what.preBlock);
+    put(to, what.postBlock);
+    put(to, what.genericNames);
+    put(to, what.instances);
+}
+
+static void get(SnapshotReader &from, GenericInfo &into)
+{
+    get(from, into.typeVec);
+    get(from, into.originFile);
+    get(from, into.symbols);
+    get(from, into.preBlock);
+    get(from, into.postBlock);
+    get(from, into.genericNames);
+    get(from, into.instances);
+}
+
+static void put(std::string &to, const Rule &what)
+{
+    put(to, what.inputPattern);
+    put(to, what.outputPattern);
+    put(to, what.engineName);
+}
+
+static void get(SnapshotReader &from, Rule &into)
+{
+    get(from, into.inputPattern);
+    get(from, into.outputPattern);
+    get(from, into.engineName);
+}
+
+static void put(std::string &to, const PackageInfo &what)
+{
+    for (const std::string *field :
+         {&what.name, &what.version, &what.license, &what.date,
+          &what.author, &what.email, &what.source, &what.path,
+          &what.about, &what.toInclude, &what.sysDeps,
+          &what.oakDeps})
+    {
+        put(to, *field);
+    }
+}
+
+static void get(SnapshotReader &from, PackageInfo &into)
+{
+    for (std::string *field :
+         {&into.name, &into.version, &into.license, &into.date,
+          &into.author, &into.email, &into.source, &into.path,
+          &into.about, &into.toInclude, &into.sysDeps,
+          &into.oakDeps})
+    {
+        get(from, *field);
+    }
+}
+
+////////////////////////////////////////////////////////////////
+
+// Everything a package load adds to the compiler state. Mirrors
+// the relevant members of `AcornSettings`.
+struct PackageState
+{
+    MultiSymbolTable table;
+    std::map<std::string, StructLookupData> structData;
+    std::map<std::string, EnumLookupData> enumData;
+    std::list<std::string> structOrder;
+    std::map<std::string, std::list<GenericInfo>> generics;
+    std::map<std::string, Rule> rules;
+    std::map<std::string, std::list<std::string>> bundles;
+    std::vector<std::string> activeRules;
+    std::map<std::string, std::string> macros;
+    std::map<std::string, std::string> macroSourceFiles;
+    std::map<std::string, std::string> preprocDefines;
+    std::set<std::string> objects;
+    std::set<std::string> cflags;
+    std::map<std::string, std::map<std::string, std::string>>
+        file_tags;
+    std::set<std::string> visitedFiles;
+    std::map<std::string, PackageInfo> packages;
+    std::string prevMatchTypeStr;
+};
+
+static void put(std::string &to, const PackageState &what)
+{
+    put(to, what.table);
+    put(to, what.structData);
+    put(to, what.enumData);
+    put(to, what.structOrder);
+    put(to, what.generics);
+    put(to, what.rules);
+    put(to, what.bundles);
+    put(to, what.activeRules);
+    put(to, what.macros);
+    put(to, what.macroSourceFiles);
+    put(to, what.preprocDefines);
+    put(to, what.objects);
+    put(to, what.cflags);
+    put(to, what.file_tags);
+    put(to, what.visitedFiles);
+    put(to, what.packages);
+    put(to, what.prevMatchTypeStr);
+}
+
+static void get(SnapshotReader &from, PackageState &into)
+{
+    get(from, into.table);
+    get(from, into.structData);
+    get(from, into.enumData);
+    get(from, into.structOrder);
+    get(from, into.generics);
+    get(from, into.rules);
+    get(from, into.bundles);
+    get(from, into.activeRules);
+    get(from, into.macros);
+    get(from, into.macroSourceFiles);
+    get(from, into.preprocDefines);
+    get(from, into.objects);
+    get(from, into.cflags);
+    get(from, into.file_tags);
+    get(from, into.visitedFiles);
+    get(from, into.packages);
+    get(from, into.prevMatchTypeStr);
+}
+
+// The members of `AcornSettings` which a package load may have
+// already-populated entries in, as they were before the load.
+struct PackageLoadBase
+{
+    std::set<std::string> objects;
+    std::set<std::string> cflags;
+    std::set<std::string> taggedFiles;
+    std::set<fs::path> visitedFiles;
+    std::set<std::string> packages;
+};
+
+// Records the given pristine state, so that whatever a load
+// adds to it can be told apart afterwards.
+static PackageLoadBase getLoadBase(
+    const AcornSettings &settings)
+{
+    PackageLoadBase base;
+    for (const auto &p : settings.visitedFiles)
+    {
+        base.visitedFiles.insert(p.first);
+    }
+
+    base.objects = settings.objects;
+    base.cflags = settings.cflags;
+    for (const auto &p : settings.file_tags)
+    {
+        base.taggedFiles.insert(p.first);
+    }
+    for (const auto &p : settings.packages)
+    {
+        base.packages.insert(p.first);
+    }
+
+    return base;
+}
+
+// Collects everything which was added to `settings` since
+// `base`. Returns false if the result would depend on the
+// working directory.
+static bool getAddedState(const PackageLoadBase &base,
+                          const AcornSettings &settings,
+                          PackageState &state)
+{
+    // The state was pristine, so these are entirely new
+    state.table = settings.table;
+    state.structData = settings.structData;
+    state.enumData = settings.enumData;
+    state.structOrder = settings.structOrder;
+    state.generics = settings.generics;
+    state.rules = settings.rules;
+    state.bundles = settings.bundles;
+    state.activeRules = settings.activeRules;
+    state.macros = settings.macros;
+    state.macroSourceFiles = settings.macroSourceFiles;
+    state.prevMatchTypeStr = settings.prevMatchTypeStr;
+
+    // These may have had entries already
+    for (const auto &p : settings.preprocDefines)
+    {
+        if (BUILTIN_DEFINES.count(p.first) == 0)
+        {
+            state.preprocDefines.insert(p);
+        }
+    }
+
+    for (const auto &o : settings.objects)
+    {
+        if (base.objects.count(o) == 0)
+        {
+            // Relative objects depend on the working directory
+            if (o[0] != '/' && o[0] != '-')
+            {
+                return false;
+            }
+
+            state.objects.insert(o);
+        }
+    }
+
+    for (const auto &f : settings.cflags)
+    {
+        if (base.cflags.count(f) == 0)
+        {
+            state.cflags.insert(f);
+        }
+    }
+
+    for (const auto &p : settings.file_tags)
+    {
+        if (base.taggedFiles.count(p.first) == 0)
+        {
+            state.file_tags.insert(p);
+        }
+    }
+
+    for (const auto &p : settings.visitedFiles)
+    {
+        if (base.visitedFiles.count(p.first) == 0)
+        {
+            state.visitedFiles.insert(p.first.string());
+        }
+    }
+
+    for (const auto &p : settings.packages)
+    {
+        if (base.packages.count(p.first) == 0)
+        {
+            state.packages.insert(p);
+        }
+    }
+
+    return true;
+}
+
+// Returns the files which the given state is only valid for
+// the current versions of.
+static std::set<std::string> getStateDeps(
+    const PackageState &state)
+{
+    std::set<std::string> deps;
+    for (const auto &f : state.visitedFiles)
+    {
+        if (fs::exists(f))
+        {
+            deps.insert(fs::canonical(f).string());
+        }
+    }
+
+    return deps;
+}
+
+// Saves everything which was added to `settings` since `base`
+// as the given package's snapshot.
+static void savePackageSnapshot(const std::string &Name,
+                                const PackageLoadBase &base,
+                                const AcornSettings &settings)
+{
+    PackageState state;
+    if (!getAddedState(base, settings, state))
+    {
+        return;
+    }
+
+    std::set<std::string> deps = getStateDeps(state);
+    deps.insert(PACKAGE_INCLUDE_PATH + Name + "/" + INFO_FILE);
+
+    std::string out = SNAPSHOT_MAGIC;
+    putInt(out, SNAPSHOT_VERSION);
+    put(out, VERSION);
+    putInt(out, getCompilerStamp());
+
+    putInt(out, deps.size());
+    for (const auto &dep : deps)
+    {
+        auto stamp = getFileStamp(dep);
+        put(out, dep);
+        putInt(out, stamp.first);
+        putInt(out, stamp.second);
+    }
+
+    put(out, state);
+
+    // Renamed into place, so concurrent loads never see a
+    // partial file
+    std::string path = getSnapshotPath(Name);
+    std::string temp = path + "." + std::to_string(getpid());
+
+    std::ofstream file(temp, std::ios::binary);
+    if (!file.is_open())
+    {
+        return;
+    }
+
+    file.write(out.data(), out.size());
+    file.close();
+
+    if (file.fail())
+    {
+        fs::remove(temp);
+        return;
+    }
+
+    fs::rename(temp, path);
+
+    if (settings.debug)
+    {
+        std::cout << settings.debugTreePrefix
+                  << "Saved snapshot of package '" << Name
+                  << "' (" << out.size() << " bytes)\n";
+    }
+}
+
+// A snapshot read from disk: The files it depends upon, with
+// their stamps when it was saved, and the state itself.
+struct PackageSnapshot
+{
+    std::list<std::pair<
+        std::string, std::pair<long long, unsigned long long>>>
+        deps;
+    PackageState state;
+};
+
+// Snapshots kept in memory by a compile server, so that the
+// processes it forks need not read them again.
+static std::map<std::string, PackageSnapshot> residentSnapshots;
+
+// The states which included files produced when processed on
+// their own, kept in memory by a compile server and keyed by
+// canonical path.
+static std::map<std::string, PackageSnapshot> residentIncludes;
+
+// Reads the named package's snapshot. Returns false if there is
+// none, or if it was saved by another version of the compiler.
+static bool readPackageSnapshot(const std::string &Name,
+                                PackageSnapshot &into)
+{
+    std::ifstream file(getSnapshotPath(Name), std::ios::binary);
+    if (!file.is_open())
+    {
+        return false;
+    }
+
+    std::stringstream contents;
+    contents << file.rdbuf();
+    file.close();
+
+    const std::string data = contents.str();
+    SnapshotReader reader{data};
+
+    try
+    {
+        if (data.compare(0, SNAPSHOT_MAGIC.size(),
+                         SNAPSHOT_MAGIC) != 0)
+        {
+            return false;
+        }
+        reader.pos = SNAPSHOT_MAGIC.size();
+
+        std::string version;
+        if (getInt(reader) != SNAPSHOT_VERSION)
+        {
+            return false;
+        }
+
+        get(reader, version);
+        if (version != VERSION ||
+            (long long)getInt(reader) != getCompilerStamp())
+        {
+            return false;
+        }
+
+        for (unsigned long long i = getInt(reader); i > 0; i--)
+        {
+            std::string dep;
+            get(reader, dep);
+            long long time = getInt(reader);
+            unsigned long long size = getInt(reader);
+            into.deps.push_back({dep, {time, size}});
+        }
+
+        get(reader, into.state);
+    }
+    catch (package_error &e)
+    {
+        return false;
+    }
+
+    return true;
+}
+
+// Returns true if the snapshot's package is unchanged, and
+// processing it now would not have skipped any of its files.
+static bool isApplicable(const PackageSnapshot &snapshot,
+                         const AcornSettings &settings)
+{
+    for (const auto &dep : snapshot.deps)
+    {
+        if (getFileStamp(dep.first) != dep.second ||
+            settings.visitedFiles.count(dep.first) != 0)
+        {
+            return false;
+        }
+    }
+
+    return true;
+}
+
+// Merges the state of a snapshot into `settings`.
+static void applyPackageState(PackageState state,
+                              AcornSettings &settings)
+{
+    settings.table = std::move(state.table);
+    settings.overloads.clear();
+    settings.structData = std::move(state.structData);
+    settings.enumData = std::move(state.enumData);
+    settings.structOrder = std::move(state.structOrder);
+    settings.generics = std::move(state.generics);
+    settings.rules = std::move(state.rules);
+    settings.bundles = std::move(state.bundles);
+    settings.activeRules = std::move(state.activeRules);
+    settings.macros = std::move(state.macros);
+    settings.macroSourceFiles =
+        std::move(state.macroSourceFiles);
+    settings.prevMatchTypeStr = state.prevMatchTypeStr;
+
+    for (const auto &p : state.preprocDefines)
+    {
+        settings.preprocDefines[p.first] = p.second;
+    }
+
+    settings.objects.insert(state.objects.begin(),
+                            state.objects.end());
+    settings.cflags.insert(state.cflags.begin(),
+                           state.cflags.end());
+
+    for (const auto &p : state.file_tags)
+    {
+        settings.file_tags[p.first] = p.second;
+    }
+
+    for (const auto &f : state.visitedFiles)
+    {
+        settings.visitedFiles[f] = 0;
+    }
+
+    for (const auto &p : state.packages)
+    {
+        settings.packages[p.first] = p.second;
+    }
+}
+
+bool loadPackageSnapshot(const std::string &Name,
+                         AcornSettings &settings)
+{
+    if (!isPristine(settings))
+    {
+        return false;
+    }
+
+    // A resident snapshot is moved rather than read again. This
+    // leaves the pages it is in shared with the server.
+    auto resident = residentSnapshots.find(Name);
+    if (resident != residentSnapshots.end() &&
+        isApplicable(resident->second, settings))
+    {
+        applyPackageState(std::move(resident->second.state),
+                          settings);
+        residentSnapshots.erase(resident);
+    }
+    else
+    {
+        PackageSnapshot snapshot;
+        if (!readPackageSnapshot(Name, snapshot) ||
+            !isApplicable(snapshot, settings))
+        {
+            return false;
+        }
+
+        applyPackageState(std::move(snapshot.state), settings);
+    }
+
+    if (settings.debug)
+    {
+        std::cout << settings.debugTreePrefix
+                  << "Loaded snapshot of package '" << Name
+                  << "'\n";
+    }
+
+    return true;
+}
+
+bool keepPackageSnapshot(const std::string &Name)
+{
+    PackageSnapshot snapshot;
+    if (!readPackageSnapshot(Name, snapshot))
+    {
+        return false;
+    }
+
+    residentSnapshots[Name] = std::move(snapshot);
+    return true;
+}
+
+bool keepIncludeState(const std::string &Path)
+{
+    AcornSettings fresh;
+    PackageLoadBase base = getLoadBase(fresh);
+
+    // Processed from scratch, so that the files it includes do
+    // not use up their own kept states
+    std::map<std::string, PackageSnapshot> kept;
+    std::swap(kept, residentIncludes);
+
+    try
+    {
+        doFile(Path, fresh);
+    }
+    catch (...)
+    {
+        std::swap(kept, residentIncludes);
+        return false;
+    }
+
+    std::swap(kept, residentIncludes);
+
+    // The outputs of impure macros may change at any time
+    PackageSnapshot snapshot;
+    if (fresh.impureMacroCalled ||
+        !getAddedState(base, fresh, snapshot.state))
+    {
+        return false;
+    }
+
+    for (const auto &dep : getStateDeps(snapshot.state))
+    {
+        snapshot.deps.push_back({dep, getFileStamp(dep)});
+    }
+
+    residentIncludes[fs::weakly_canonical(Path).string()] =
+        std::move(snapshot);
+    return true;
+}
+
+bool loadIncludeState(const std::string &Path,
+                      AcornSettings &settings)
+{
+    if (residentIncludes.empty() || !isPristine(settings) ||
+        !settings.dialectRules.empty())
+    {
+        return false;
+    }
+
+    const std::string key = fs::weakly_canonical(Path).string();
+    auto resident = residentIncludes.find(key);
+    if (resident == residentIncludes.end() ||
+        !isApplicable(resident->second, settings))
+    {
+        return false;
+    }
+
+    applyPackageState(std::move(resident->second.state),
+                      settings);
+    residentIncludes.erase(resident);
+
+    if (settings.debug)
+    {
+        std::cout << settings.debugTreePrefix
+                  << "Loaded resident state of '" << Path
+                  << "'\n";
+    }
+
+    return true;
+}
+
+void loadPackage(const std::string &Name,
+                 AcornSettings &settings)
+{
+    std::list<std::string> files =
+        getPackageFiles(Name, settings);
+
+    if (loadPackageSnapshot(Name, settings))
+    {
+        return;
+    }
+
+    // A load into a pristine state can be snapshotted, as long
+    // as none of the package's files were already visited
+    bool canSnapshot = isPristine(settings);
+    PackageLoadBase base;
+
+    if (canSnapshot)
+    {
+        const std::string packageDir =
+            fs::weakly_canonical(PACKAGE_INCLUDE_PATH + Name)
+                .string() +
+            "/";
+
+        for (const auto &p : settings.visitedFiles)
+        {
+            if (p.first.string().compare(0, packageDir.size(),
+                                         packageDir) == 0)
+            {
+                canSnapshot = false;
+            }
+        }
+
+        base = getLoadBase(settings);
+        base.packages.erase(Name);
+    }
+
+    // Whether an impure macro was called during this load in
+    // particular
+    const bool wasImpure = settings.impureMacroCalled;
+    settings.impureMacroCalled = false;
+
+    for (std::string f : files)
+    {
+        if (settings.debug)
+        {
+            std::cout << settings.debugTreePrefix
+                      << "Loading package file '" << f
+                      << "'...\n";
+        }
+
+        // Backup dialect rules
+        std::vector<std::string> backupDialectRules =
+            settings.dialectRules;
+        settings.dialectRules.clear();
+
+        doFile(f, settings);
+
+        settings.dialectRules = backupDialectRules;
+    }
+
+    // The outputs of impure macros may change at any time, so
+    // they must not be replayed from a snapshot
+    if (settings.impureMacroCalled)
+    {
+        canSnapshot = false;
+    }
+    settings.impureMacroCalled |= wasImpure;
+
+    if (canSnapshot)
+    {
+        // Snapshots are an optimization: Failing to save one
+        // (for instance, without write access to the package)
+        // is not an error.
+        try
+        {
+            savePackageSnapshot(Name, base, settings);
+        }
+        catch (std::runtime_error &e)
+        {
+            if (settings.debug)
+            {
+                std::cout << settings.debugTreePrefix
+                          << "Failed to save snapshot of "
+                             "package '"
+                          << Name << "': " << e.what() << '\n';
+            }
+        }
+    }
+}
+
+void buildPackageSnapshot(const std::string &Name,
+                          AcornSettings &settings)
+{
+    AcornSettings fresh;
+    fresh.debug = settings.debug;
+
+    fs::remove(getSnapshotPath(Name));
+    loadPackage(Name, fresh);
+}
@@ -0,0 +1,167 @@
+/*
+The process-wide cache of source files behind `load_source`.
+Files are mapped read-only rather than read line by line, so
+that the lexer and syntax checker work directly on the page
+cache, and a file included by several compilation units is only
+loaded once.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "lexer.hpp"
+#include <fcntl.h>
+#include <filesystem>
+#include <map>
+#include <memory>
+#include <stdexcept>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+// A single loaded source file. Unmaps itself once replaced.
+class SourceFile
+{
+  public:
+    SourceFile() = default;
+    SourceFile(const SourceFile &other) = delete;
+    SourceFile &operator=(const SourceFile &other) = delete;
+
+    ~SourceFile()
+    {
+        if (mapped != nullptr)
+        {
+            munmap(mapped, size);
+        }
+    }
+
+    // The modification time (in nanoseconds) and size of the
+    // file when it was loaded
+    long long time = 0;
+    unsigned long long size = 0;
+
+    // The file's mapping, if it could be used as is
+    void *mapped = nullptr;
+
+    // Otherwise, a copy of its text
+    std::string copy;
+
+    std::string_view text;
+};
+
+// Keyed by canonical path
+static std::map<std::string, std::unique_ptr<SourceFile>> &
+source_files()
+{
+    static std::map<std::string, std::unique_ptr<SourceFile>>
+        files;
+    return files;
+}
+
+// Whether files may be mapped rather than copied
+static bool map_sources = true;
+
+void set_source_mapping(const bool &enabled)
+{
+    map_sources = enabled;
+}
+
+static long long get_time(const struct stat &info)
+{
+#if defined(__APPLE__)
+    const struct timespec &time = info.st_mtimespec;
+#else
+    const struct timespec &time = info.st_mtim;
+#endif
+
+    return time.tv_sec * 1000000000ll + time.tv_nsec;
+}
+
+std::string_view load_source(const std::string &filepath)
+{
+    std::error_code ec;
+    const std::string path =
+        std::filesystem::canonical(filepath, ec).string();
+
+    struct stat info;
+    if (ec || stat(path.c_str(), &info) != 0)
+    {
+        throw std::runtime_error("Failed to open file '" +
+                                 filepath + "'");
+    }
+
+    auto &slot = source_files()[path];
+    if (slot != nullptr && slot->time == get_time(info) &&
+        slot->size == (unsigned long long)info.st_size)
+    {
+        return slot->text;
+    }
+
+    const int fd = open(path.c_str(), O_RDONLY);
+    if (fd < 0 || fstat(fd, &info) != 0)
+    {
+        if (fd >= 0)
+        {
+            close(fd);
+        }
+
+        throw std::runtime_error("Failed to open file '" +
+                                 filepath + "'");
+    }
+
+    auto loaded = std::make_unique<SourceFile>();
+    loaded->time = get_time(info);
+    loaded->size = info.st_size;
+
+    // Empty files cannot be mapped
+    void *mapped = MAP_FAILED;
+    if (map_sources && loaded->size != 0)
+    {
+        mapped = mmap(nullptr, loaded->size, PROT_READ,
+                      MAP_PRIVATE, fd, 0);
+    }
+
+    if (mapped != MAP_FAILED)
+    {
+        const char *data = static_cast<const char *>(mapped);
+
+        // Text read by lines always ends in a newline. Files
+        // which do not must be copied to add one.
+        if (data[loaded->size - 1] == '\n')
+        {
+            loaded->mapped = mapped;
+            loaded->text = std::string_view(data, loaded->size);
+        }
+        else
+        {
+            loaded->copy.assign(data, loaded->size);
+            loaded->copy.push_back('\n');
+            munmap(mapped, loaded->size);
+        }
+    }
+    else
+    {
+        char buffer[4096];
+        ssize_t count;
+        while ((count = read(fd, buffer, sizeof(buffer))) > 0)
+        {
+            loaded->copy.append(buffer, count);
+        }
+
+        if (!loaded->copy.empty() &&
+            loaded->copy.back() != '\n')
+        {
+            loaded->copy.push_back('\n');
+        }
+    }
+
+    close(fd);
+
+    if (loaded->mapped == nullptr)
+    {
+        loaded->text = loaded->copy;
+    }
+
+    slot = std::move(loaded);
+    return slot->text;
+}
@@ -0,0 +1,373 @@
+/*
+The test suite runner behind `acorn -T`. Each test is compiled
+(and run, if requested) by a compiler process of its own in a
+build directory of its own, so that tests can run concurrently
+without overwriting each other's outputs. The wall time, CPU
+time and peak memory of each are recorded. A test which passed
+last time is skipped for as long as its build manifest shows
+its inputs to be unchanged.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "oakc_fns.hpp"
+#include "oakc_structs.hpp"
+#include "options.hpp"
+#include "tags.hpp"
+#include <algorithm>
+#include <atomic>
+#include <cerrno>
+#include <chrono>
+#include <fcntl.h>
+#include <fstream>
+#include <iomanip>
+#include <mutex>
+#include <sstream>
+#include <sys/resource.h>
+#include <sys/wait.h>
+#include <thread>
+#include <unistd.h>
+
+// Within a test's build directory, the file recording the mode
+// in which it last passed.
+const static std::string TEST_PASS_FILE = "passed";
+
+std::string getTestDir(const std::string &test)
+{
+    return COMPILED_PATH + "tests/" + purifyStr(test) + "/";
+}
+
+std::vector<std::string> getTestArgs(
+    const std::string &test, const size_t &workers,
+    const AcornSettings &settings)
+{
+    // The job budget is split between the tests running at
+    // once, so that each does not start a job per core
+    const size_t jobs =
+        std::max<size_t>(1, getJobCount(settings) /
+                                std::max<size_t>(workers, 1));
+
+    std::vector<std::string> out = {"-o", "a.out", "--jobs",
+                                    std::to_string(jobs)};
+    if (settings.execute)
+    {
+        out.push_back("--execute");
+    }
+    out.push_back(fs::absolute(test).string());
+
+    return out;
+}
+
+bool isTestCurrent(const std::string &test,
+                   const std::vector<std::string> &args,
+                   const std::string &mode)
+{
+    const std::string dir = getTestDir(test);
+
+    std::ifstream passFile(dir + TEST_PASS_FILE);
+    std::string passedMode;
+    if (!(passFile >> passedMode) || passedMode != mode)
+    {
+        return false;
+    }
+
+    // Build keys depend on the working directory
+    const fs::path original = fs::current_path();
+    fs::current_path(dir);
+    bool out = isUpToDate(loadManifest("a.out"),
+                          getBuildKey(args));
+    fs::current_path(original);
+
+    return out;
+}
+
+// Runs `acorn` with the given arguments in the test's build
+// directory, logging its output there.
+static TestResult runTest(const std::string &test,
+                          const std::vector<std::string> &args,
+                          const bool &keepStdin)
+{
+    TestResult out;
+    out.file = test;
+    out.log = getTestDir(test) + "test.log";
+
+    // Everything the child needs is prepared before forking,
+    // since other threads may hold locks it would need
+    const std::string dir = getTestDir(test);
+    std::vector<const char *> argv = {"acorn"};
+    for (const auto &arg : args)
+    {
+        argv.push_back(arg.c_str());
+    }
+    argv.push_back(nullptr);
+
+    int logFd = open(out.log.c_str(),
+                     O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC,
+                     0644);
+
+    auto start = std::chrono::high_resolution_clock::now();
+    pid_t pid = logFd < 0 ? -1 : fork();
+    if (pid == 0)
+    {
+        if (chdir(dir.c_str()) != 0)
+        {
+            _exit(127);
+        }
+
+        dup2(logFd, STDOUT_FILENO);
+        dup2(logFd, STDERR_FILENO);
+
+        // Concurrent tests cannot share a terminal
+        if (!keepStdin)
+        {
+            int nullFd = open("/dev/null", O_RDONLY);
+            dup2(nullFd, STDIN_FILENO);
+        }
+
+        execvp(argv[0], (char *const *)argv.data());
+        _exit(127);
+    }
+
+    if (logFd >= 0)
+    {
+        close(logFd);
+    }
+
+    // The usage of a waited-for child includes that of all of
+    // the children it waited for in turn
+    int status = 0;
+    rusage usage;
+    pid_t waited = -1;
+    while (pid > 0 &&
+           (waited = wait4(pid, &status, 0, &usage)) < 0 &&
+           errno == EINTR)
+    {
+    }
+
+    if (waited < 0)
+    {
+        out.result = -1;
+        return out;
+    }
+
+    auto end = std::chrono::high_resolution_clock::now();
+    out.wallMs = std::chrono::duration_cast<
+                     std::chrono::milliseconds>(end - start)
+                     .count();
+    out.cpuMs = usage.ru_utime.tv_sec * 1000 +
+                usage.ru_utime.tv_usec / 1000 +
+                usage.ru_stime.tv_sec * 1000 +
+                usage.ru_stime.tv_usec / 1000;
+    out.peakKb = usage.ru_maxrss;
+    out.result = WIFEXITED(status) ? WEXITSTATUS(status)
+                                   : 128 + WTERMSIG(status);
+
+    return out;
+}
+
+std::vector<TestResult> runTests(
+    const std::vector<std::string> &tests,
+    AcornSettings &settings)
+{
+    const std::string mode =
+        settings.execute ? "execute" : "compile";
+    const size_t jobs =
+        std::min<size_t>(getJobCount(settings), tests.size());
+
+    std::vector<TestResult> results(tests.size());
+    std::vector<std::vector<std::string>> args(tests.size());
+    std::vector<bool> isDone(tests.size(), false);
+    std::mutex lock;
+    size_t finished = 0;
+
+    // Reports a result as soon as it is known
+    auto report = [&](const size_t &i)
+    {
+        const TestResult &r = results[i];
+        std::lock_guard<std::mutex> guard(lock);
+        finished++;
+        isDone[i] = true;
+
+        std::cout << "[" << finished << "/" << tests.size()
+                  << "]\t[";
+        if (r.skipped)
+        {
+            std::cout << tags::green << "skip";
+        }
+        else
+        {
+            std::cout << (r.result == 0 ? tags::green
+                                        : tags::red)
+                      << std::left << std::setw(4) << r.result;
+        }
+
+        std::cout << tags::reset << "]" << std::right
+                  << std::setw(8) << r.wallMs << " ms"
+                  << std::setw(8) << r.cpuMs << " cpu ms"
+                  << std::setw(8) << r.peakKb << " KB\t"
+                  << std::left << r.file << "\n"
+                  << std::right << std::flush;
+    };
+
+    // Skipping is decided up front, as it changes directory
+    std::vector<size_t> toRun;
+    for (size_t i = 0; i < tests.size(); i++)
+    {
+        args[i] = getTestArgs(tests[i], jobs, settings);
+
+        fs::create_directories(getTestDir(tests[i]));
+        if (isTestCurrent(tests[i], args[i], mode))
+        {
+            results[i].file = tests[i];
+            results[i].skipped = true;
+            results[i].log = getTestDir(tests[i]) + "test.log";
+            report(i);
+        }
+        else
+        {
+            fs::remove(getTestDir(tests[i]) + TEST_PASS_FILE);
+            toRun.push_back(i);
+        }
+    }
+
+    std::atomic<size_t> next(0);
+    std::atomic<bool> hasFailed(false);
+    auto worker = [&]()
+    {
+        for (size_t j = next++; j < toRun.size(); j = next++)
+        {
+            // With `-TT`, no more are started after a failure
+            if (settings.testFail && hasFailed)
+            {
+                break;
+            }
+
+            const size_t i = toRun[j];
+            results[i] = runTest(tests[i], args[i], jobs <= 1);
+
+            if (results[i].result == 0)
+            {
+                std::ofstream(getTestDir(tests[i]) +
+                              TEST_PASS_FILE)
+                    << mode << '\n';
+            }
+            else
+            {
+                hasFailed = true;
+            }
+
+            report(i);
+        }
+    };
+
+    std::vector<std::thread> workers;
+    for (size_t i = 1; i < jobs; i++)
+    {
+        workers.emplace_back(worker);
+    }
+
+    // This thread is a worker too
+    worker();
+
+    for (auto &w : workers)
+    {
+        w.join();
+    }
+
+    std::vector<TestResult> out;
+    for (size_t i = 0; i < tests.size(); i++)
+    {
+        if (isDone[i])
+        {
+            out.push_back(results[i]);
+        }
+    }
+
+    return out;
+}
+
+std::string toJsonString(const std::string &what)
+{
+    std::string out = "\"";
+    for (const char &c : what)
+    {
+        if (c == '"' || c == '\\')
+        {
+            out += '\\';
+            out += c;
+        }
+        else if ((unsigned char)c < 0x20)
+        {
+            std::stringstream escaped;
+            escaped << "\\u" << std::hex << std::setw(4)
+                    << std::setfill('0') << (int)c;
+            out += escaped.str();
+        }
+        else
+        {
+            out += c;
+        }
+    }
+
+    return out + "\"";
+}
+
+void saveTestReport(const std::vector<TestResult> &results,
+                    const unsigned long long &wallMs,
+                    const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open file '" +
+                                 path + "'");
+    }
+
+    file << "{\n  \"wall_ms\": " << wallMs
+         << ",\n  \"tests\": [";
+
+    for (size_t i = 0; i < results.size(); i++)
+    {
+        const TestResult &r = results[i];
+        file << (i == 0 ? "\n" : ",\n") << "    {\"file\": "
+             << toJsonString(r.file)
+             << ", \"result\": " << r.result
+             << ", \"skipped\": "
+             << (r.skipped ? "true" : "false")
+             << ", \"wall_ms\": " << r.wallMs
+             << ", \"cpu_ms\": " << r.cpuMs
+             << ", \"peak_rss_kb\": " << r.peakKb << "}";
+    }
+
+    file << "\n  ]\n}\n";
+}
+
+void saveTestLog(const std::vector<TestResult> &results,
+                 const std::string &path)
+{
+    std::ofstream file(path);
+    if (!file.is_open())
+    {
+        throw std::runtime_error("Failed to open file '" +
+                                 path + "'");
+    }
+
+    for (const auto &r : results)
+    {
+        file << r.file << '\n';
+
+        if (r.skipped)
+        {
+            file << "(Skipped: Unchanged since last pass)\n";
+            continue;
+        }
+
+        // Copying an empty log would fail the whole file
+        std::ifstream log(r.log);
+        if (log.is_open() && log.peek() != EOF)
+        {
+            file << log.rdbuf();
+        }
+    }
+}
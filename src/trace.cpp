@@ -0,0 +1,151 @@
+/*
+Records where the compiler spends its time for `acorn --trace`,
+as nested spans saved in the trace event format which Chrome's
+`about:tracing` and Perfetto can load. The same spans mark the
+phases of `acorn --memory`. Spans are recorded only when one of
+these was requested, so that this costs nothing otherwise.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "oakc_fns.hpp"
+#include "oakc_structs.hpp"
+#include "options.hpp"
+#include "tags.hpp"
+#include <fstream>
+#include <unistd.h>
+
+unsigned long long getTraceTime(const AcornSettings &settings)
+{
+    return std::chrono::duration_cast<
+               std::chrono::microseconds>(
+               std::chrono::steady_clock::now() -
+               settings.traceStart)
+        .count();
+}
+
+void beginTrace(const std::string &name,
+                const std::string &category,
+                AcornSettings &settings)
+{
+    if (settings.tracePath == "" && settings.memoryPath == "")
+    {
+        return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.start = getTraceTime(settings);
+    if (settings.memoryPath != "" && category == "phase")
+    {
+        event.startKb = getPeakKb();
+    }
+    settings.openTraces.push_back(event);
+}
+
+void endTrace(AcornSettings &settings)
+{
+    if (settings.openTraces.empty())
+    {
+        return;
+    }
+
+    TraceEvent event = settings.openTraces.back();
+    settings.openTraces.pop_back();
+    event.duration = getTraceTime(settings) - event.start;
+
+    if (settings.memoryPath != "" && event.category == "phase")
+    {
+        PhaseMemory &memory = settings.phaseMemory[event.name];
+        memory.calls++;
+        memory.peakKb = getPeakKb();
+        memory.growthKb += memory.peakKb - event.startKb;
+    }
+
+    if (settings.tracePath != "")
+    {
+        settings.traceEvents.push_back(event);
+    }
+}
+
+void addTrace(const std::string &name,
+              const std::string &category,
+              const unsigned long long &start,
+              const unsigned long long &end,
+              const unsigned int &lane,
+              AcornSettings &settings)
+{
+    if (settings.tracePath == "")
+    {
+        return;
+    }
+
+    TraceEvent event;
+    event.name = name;
+    event.category = category;
+    event.start = start;
+    event.duration = end - start;
+    event.lane = lane;
+    settings.traceEvents.push_back(event);
+}
+
+TraceSpan::TraceSpan(const std::string &name,
+                     const std::string &category,
+                     AcornSettings &settings)
+    : settings(settings), depth(settings.openTraces.size())
+{
+    beginTrace(name, category, settings);
+}
+
+TraceSpan::~TraceSpan()
+{
+    while (settings.openTraces.size() > depth)
+    {
+        endTrace(settings);
+    }
+}
+
+void saveTrace(AcornSettings &settings)
+{
+    if (settings.tracePath == "")
+    {
+        return;
+    }
+
+    // Spans left open by an error end here
+    while (!settings.openTraces.empty())
+    {
+        endTrace(settings);
+    }
+
+    // A failed trace should not fail the build, nor hide the
+    // error which ended it
+    std::ofstream file(settings.tracePath);
+    if (!file.is_open())
+    {
+        std::cout << tags::yellow_bold
+                  << "Warning: Failed to save trace '"
+                  << settings.tracePath << "'\n"
+                  << tags::reset;
+        return;
+    }
+
+    const pid_t pid = getpid();
+
+    file << "{\"displayTimeUnit\": \"ms\", \"traceEvents\": [";
+    for (size_t i = 0; i < settings.traceEvents.size(); i++)
+    {
+        const TraceEvent &e = settings.traceEvents[i];
+        file << (i == 0 ? "\n" : ",\n") << "  {\"name\": "
+             << toJsonString(e.name)
+             << ", \"cat\": " << toJsonString(e.category)
+             << ", \"ph\": \"X\", \"ts\": " << e.start
+             << ", \"dur\": " << e.duration
+             << ", \"pid\": " << pid << ", \"tid\": " << e.lane
+             << "}";
+    }
+
+    file << "\n]}\n";
+}
@@ -7,9 +7,29 @@ jdehmel@outlook.com
 #include "oakc_fns.hpp"
 #include "oakc_structs.hpp"
 #include "options.hpp"
+#include <deque>
 #include <string>
+#include <unordered_map>
 
-static unsigned long long currentID = 1;
+// Returns the interned ID of the given type key. IDs are never
+// reused, so they remain stable for the life of the process.
+static unsigned long long internTypeKey(const std::string &key)
+{
+    // Function-local to avoid static initialization order
+    // issues with the `nullType`s of other translation units.
+    static std::unordered_map<std::string, unsigned long long>
+        internedKeys;
+
+    auto iter = internedKeys.find(key);
+    if (iter != internedKeys.end())
+    {
+        return iter->second;
+    }
+
+    unsigned long long id = internedKeys.size() + 1;
+    internedKeys.emplace(key, id);
+    return id;
+}
 
 TypeNode &TypeNode::operator=(const TypeNode &other)
 {
@@ -36,9 +56,7 @@ bool TypeNode::operator==(const TypeNode &other) const
 
 Type::Type(const TypeInfo &Info, const std::string &Name)
 {
-    internal.clear();
     internal.push_back({Info, Name});
-    ID = currentID++;
     return;
 }
 
@@ -48,49 +66,143 @@ const size_t Type::size() const
 }
 
 Type::Type(const Type &What)
+    : internal(What.internal), ID(What.ID),
+      structuralID(What.structuralID), exactID(What.exactID)
 {
-    internal.clear();
-    for (const auto &i : What.internal)
-    {
-        internal.push_back(i);
-    }
-    ID = currentID++;
-
     return;
 }
 
 Type::Type(const Type &What, const int &startingAt)
 {
-    internal.clear();
-    int i = 0;
-    for (const auto &item : What.internal)
+    if (startingAt >= 0 &&
+        (size_t)startingAt < What.internal.size())
     {
-        if (i >= startingAt)
-        {
-            internal.push_back(item);
-        }
-        i++;
+        internal.assign(
+            std::next(What.internal.begin(), startingAt),
+            What.internal.end());
     }
-    ID = currentID++;
 
     return;
 }
 
 Type::Type()
 {
-    internal.clear();
     internal.push_back(
         TypeNode{nullType.internal.front().info,
                  nullType.internal.front().name});
-    ID = currentID++;
     return;
 }
 
+void Type::invalidate()
+{
+    ID = structuralID = exactID = 0;
+    return;
+}
+
+unsigned long long Type::getID() const
+{
+    if (ID == 0)
+    {
+        std::string key = "F";
+        for (const auto &node : internal)
+        {
+            key += (char)('a' + node.info);
+            key += node.name;
+            key += '\0';
+        }
+
+        ID = internTypeKey(key);
+    }
+
+    return ID;
+}
+
+unsigned long long Type::getStructuralID() const
+{
+    if (structuralID == 0)
+    {
+        // Must agree with TypeNode::operator==
+        std::string key = "S";
+        for (const auto &node : internal)
+        {
+            key += (char)('a' + node.info);
+            if (node.info == atomic)
+            {
+                key += node.name;
+            }
+            key += '\0';
+        }
+
+        structuralID = internTypeKey(key);
+    }
+
+    return structuralID;
+}
+
+unsigned long long Type::getExactID() const
+{
+    if (exactID == 0)
+    {
+        // Must agree with typesAreSameExact
+        std::string key = "E";
+        for (const auto &node : internal)
+        {
+            if (node.info == var_name)
+            {
+                continue;
+            }
+
+            const TypeInfo info =
+                node.info == sarr ? arr : node.info;
+            key += (char)('a' + info);
+            if (node.info == atomic)
+            {
+                key += node.name;
+            }
+            key += '\0';
+        }
+
+        exactID = internTypeKey(key);
+    }
+
+    return exactID;
+}
+
+// Returns the single stored copy of the given type.
+static const Type *internType(const Type &what)
+{
+    // The deque allocates in large blocks and never moves its
+    // items, so references into it never dangle. It is freed in
+    // one go when the process, and thus the unit, ends.
+    static std::deque<Type> stored;
+    static std::unordered_map<unsigned long long, const Type *>
+        types;
+
+    const unsigned long long id = what.getID();
+    auto iter = types.find(id);
+    if (iter != types.end())
+    {
+        return iter->second;
+    }
+
+    const Type *out = &stored.emplace_back(what);
+    types.emplace(id, out);
+    return out;
+}
+
+TypeRef::TypeRef() : type(internType(Type()))
+{
+}
+
+TypeRef::TypeRef(const Type &what) : type(internType(what))
+{
+}
+
 void Type::prepend(const TypeInfo &Info,
                    const std::string &Name)
 {
     internal.insert(internal.begin(), {Info, Name});
-    ID = currentID++;
+    invalidate();
     return;
 }
 
@@ -107,7 +219,7 @@ void Type::append(const TypeInfo &Info, const std::string &Name)
     {
         internal.push_back({Info, Name});
     }
-    ID = currentID++;
+    invalidate();
 
     return;
 }
@@ -122,19 +234,17 @@ void Type::append(const Type &Other)
     }
     else
     {
-        for (const auto &i : Other.internal)
-        {
-            internal.push_back(i);
-        }
+        internal.insert(internal.end(), Other.internal.begin(),
+                        Other.internal.end());
     }
-    ID = currentID++;
+    invalidate();
 
     return;
 }
 
 bool Type::operator==(const Type &Other) const
 {
-    return internal == Other.internal;
+    return getStructuralID() == Other.getStructuralID();
 }
 
 bool Type::operator!=(const Type &Other) const
@@ -144,12 +254,10 @@ bool Type::operator!=(const Type &Other) const
 
 Type &Type::operator=(const Type &Other)
 {
-    internal.clear();
-    for (const auto &i : Other.internal)
-    {
-        internal.push_back(i);
-    }
-    ID = currentID++;
+    internal = Other.internal;
+    ID = Other.ID;
+    structuralID = Other.structuralID;
+    exactID = Other.exactID;
     return *this;
 }
 
@@ -157,15 +265,15 @@ Type &Type::operator=(const TypeNode &Other)
 {
     internal.clear();
     internal.push_back(Other);
-    ID = currentID++;
+    invalidate();
     return *this;
 }
 
 void toStr(const Type *const What,
-           const std::list<TypeNode>::const_iterator &pos,
+           const std::vector<TypeNode>::const_iterator &pos,
            std::list<std::string> &builder)
 {
-    if (What == nullptr || pos == What->internal.end())
+    if (What == nullptr || pos == What->end())
     {
         return;
     }
@@ -201,7 +309,7 @@ void toStr(const Type *const What,
         break;
     }
 
-    if (std::next(pos) != What->internal.end())
+    if (std::next(pos) != What->end())
     {
         if (std::next(pos)->info != function &&
             std::next(pos)->info != pointer &&
@@ -227,7 +335,7 @@ std::string toStr(const Type *const what)
 {
     std::list<std::string> builder;
 
-    toStr(what, what->internal.begin(), builder);
+    toStr(what, what->begin(), builder);
 
     std::string out;
     size_t size = 0;
@@ -249,14 +357,14 @@ std::string toStr(const Type *const what)
 void Type::pop_front()
 {
     internal.erase(internal.begin());
-    ID = currentID++;
+    invalidate();
     return;
 }
 
 void Type::pop_back()
 {
     internal.pop_back();
-    ID = currentID++;
+    invalidate();
     return;
 }
 
@@ -266,14 +374,14 @@ void Type::pop_back()
 bool typesAreSame(const Type *const A, const Type *const B,
                   int &changes)
 {
-    auto left = A->internal.begin();
-    auto right = B->internal.begin();
+    auto left = A->begin();
+    auto right = B->begin();
 
-    while (left != A->internal.end() &&
-           right != B->internal.end())
+    while (left != A->end() &&
+           right != B->end())
     {
         while (
-            left != A->internal.end() &&
+            left != A->end() &&
             (left->info == var_name || left->info == pointer))
         {
             if (left->info == pointer)
@@ -285,7 +393,7 @@ bool typesAreSame(const Type *const A, const Type *const B,
         }
 
         while (
-            right != B->internal.end() &&
+            right != B->end() &&
             (right->info == var_name || right->info == pointer))
         {
             if (right->info == pointer)
@@ -296,8 +404,8 @@ bool typesAreSame(const Type *const A, const Type *const B,
             right++;
         }
 
-        if (left == A->internal.end() ||
-            right == B->internal.end())
+        if (left == A->end() ||
+            right == B->end())
         {
             break;
         }
@@ -324,10 +432,10 @@ bool typesAreSame(const Type *const A, const Type *const B,
         right++;
     }
 
-    if (left == A->internal.end() || right == B->internal.end())
+    if (left == A->end() || right == B->end())
     {
-        if (!(left == A->internal.end() &&
-              right == B->internal.end()))
+        if (!(left == A->end() &&
+              right == B->end()))
         {
             return false;
         }
@@ -340,62 +448,17 @@ bool typesAreSame(const Type *const A, const Type *const B,
 // dereferencing
 bool typesAreSameExact(const Type *const A, const Type *const B)
 {
-    auto left = A->internal.begin();
-    auto right = B->internal.begin();
-
-    while (left != A->internal.end() &&
-           right != B->internal.end())
-    {
-        while (left != A->internal.end() &&
-               left->info == var_name)
-        {
-            left++;
-        }
-
-        while (right != B->internal.end() &&
-               right->info == var_name)
-        {
-            right++;
-        }
-
-        if (left == A->internal.end() ||
-            right == B->internal.end())
-        {
-            return false;
-        }
-
-        if (left->info != right->info &&
-            !(left->info == sarr && right->info == arr) &&
-            !(left->info == arr && right->info == sarr))
-        {
-            // Failure
-            return false;
-        }
-        else
-        {
-            if (left->info == atomic &&
-                left->name != right->name)
-            {
-                // Failure
-                return false;
-            }
-        }
-
-        // Success; Move on
-        left++;
-        right++;
-    }
-
-    if (left == A->internal.end() || right == B->internal.end())
+    // Trailing variable names never match (this is a holdover
+    // from the old node-walking comparison)
+    if ((A->size() != 0 &&
+         (*A)[A->size() - 1].info == var_name) ||
+        (B->size() != 0 &&
+         (*B)[B->size() - 1].info == var_name))
     {
-        if (!(left == A->internal.end() &&
-              right == B->internal.end()))
-        {
-            return false;
-        }
+        return false;
     }
 
-    return true;
+    return A->getExactID() == B->getExactID();
 }
 
 /*
@@ -410,14 +473,14 @@ bool typesAreSameCast(const Type *const passed,
 {
     bool castIsLegal = true;
 
-    auto left = passed->internal.begin();
-    auto right = candidate->internal.begin();
+    auto left = passed->begin();
+    auto right = candidate->begin();
 
-    while (left != passed->internal.end() &&
-           right != candidate->internal.end())
+    while (left != passed->end() &&
+           right != candidate->end())
     {
         while (
-            left != passed->internal.end() &&
+            left != passed->end() &&
             (left->info == var_name || left->info == pointer))
         {
             if (left->info == pointer)
@@ -434,7 +497,7 @@ bool typesAreSameCast(const Type *const passed,
         }
 
         while (
-            right != candidate->internal.end() &&
+            right != candidate->end() &&
             (right->info == var_name || right->info == pointer))
         {
             if (right->info == pointer)
@@ -450,8 +513,8 @@ bool typesAreSameCast(const Type *const passed,
             right++;
         }
 
-        if (left == passed->internal.end() ||
-            right == candidate->internal.end())
+        if (left == passed->end() ||
+            right == candidate->end())
         {
             break;
         }
@@ -508,11 +571,11 @@ bool typesAreSameCast(const Type *const passed,
         right++;
     }
 
-    if (left == passed->internal.end() ||
-        right == candidate->internal.end())
+    if (left == passed->end() ||
+        right == candidate->end())
     {
-        if (!(left == passed->internal.end() &&
-              right == candidate->internal.end()))
+        if (!(left == passed->end() &&
+              right == candidate->end()))
         {
             return false;
         }
@@ -814,8 +877,24 @@ Type checkLiteral(const std::string &From)
     return nullType;
 }
 
-// Costly! Beware!
-TypeNode &Type::operator[](const int &Index) const
+const TypeNode &Type::operator[](const int &Index) const
+{
+    return internal[Index];
+}
+
+void Type::set(const int &Index, const TypeInfo &Info,
+               const std::string &Name)
+{
+    internal[Index] = TypeNode{Info, Name};
+    invalidate();
+}
+
+std::vector<TypeNode>::const_iterator Type::begin() const
+{
+    return internal.begin();
+}
+
+std::vector<TypeNode>::const_iterator Type::end() const
 {
-    return (TypeNode &)*std::next(internal.begin(), Index);
+    return internal.end();
 }
@@ -0,0 +1,123 @@
+/*
+Lexer throughput benchmark for Oak. Lexes the standard library
+(or the files given as arguments) with the original multipass
+lexer over the plain DFA, then with the fused lexer in each scan
+mode this machine supports, and reports each in MB/s. Run via
+`make bench`.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "../lexer.hpp"
+#include "test.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <vector>
+
+// The number of times each file is lexed by each lexer
+const static int BENCH_REPEATS = 20;
+
+// Lexes every text with the given lexer, returning the time
+// taken in seconds. Any warnings the lexer prints are dropped.
+template <typename F>
+double time_lexer(const std::vector<std::string> &texts,
+                  std::vector<TokenList> &out, F lex)
+{
+    std::stringstream sink;
+    auto old = std::cout.rdbuf(sink.rdbuf());
+
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_REPEATS; i++)
+    {
+        out.clear();
+        for (const auto &text : texts)
+        {
+            out.push_back(lex(text));
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    std::cout.rdbuf(old);
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        paths.push_back(argv[i]);
+    }
+
+    if (paths.empty())
+    {
+        for (const auto &entry :
+             std::filesystem::directory_iterator("../../std"))
+        {
+            if (entry.path().extension() == ".oak")
+            {
+                paths.push_back(entry.path().string());
+            }
+        }
+    }
+
+    std::vector<std::string> texts;
+    double megabytes = 0.0;
+    for (const auto &path : paths)
+    {
+        std::ifstream file(path);
+        std::stringstream contents;
+        contents << file.rdbuf();
+        texts.push_back(contents.str());
+        megabytes += texts.back().size();
+    }
+    megabytes *= BENCH_REPEATS / (1024.0 * 1024.0);
+
+    Lexer l;
+    std::vector<TokenList> fused, multi;
+
+    std::cout << "Lexed " << texts.size() << " files, "
+              << megabytes / BENCH_REPEATS << " MB, "
+              << BENCH_REPEATS << " times\n";
+
+    fakeAssert(set_scan_mode(scan_none));
+    const double multi_s = time_lexer(
+        texts, multi, [&](const std::string &text)
+        { return l.lex_list_multipass(text); });
+    std::cout << "multipass:       " << megabytes / multi_s
+              << " MB/s\n";
+
+    const std::vector<std::pair<LexerScanMode, std::string>>
+        modes = {{scan_none, "fused:          "},
+                 {scan_scalar, "fused (scalar): "},
+                 {scan_sse2, "fused (SSE2):   "},
+                 {scan_avx2, "fused (AVX2):   "}};
+
+    for (const auto &mode : modes)
+    {
+        if (!set_scan_mode(mode.first))
+        {
+            continue;
+        }
+
+        const double fused_s = time_lexer(
+            texts, fused, [&](const std::string &text)
+            { return l.lex_list(text); });
+
+        // All must yield the same tokens
+        fakeAssert(fused.size() == multi.size());
+        for (size_t i = 0; i < fused.size(); i++)
+        {
+            fakeAssert(fused[i] == multi[i]);
+        }
+
+        std::cout << mode.second << megabytes / fused_s
+                  << " MB/s\n";
+    }
+
+    return 0;
+}
@@ -0,0 +1,146 @@
+/*
+Source loading benchmark for Oak. Compares reading the given
+files line by line, as sources used to be read, with mapping
+them via `load_source` both uncached and cached. Without
+arguments, a large generated source file is used instead. Run
+via `make bench`.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "../lexer.hpp"
+#include "test.hpp"
+#include <chrono>
+#include <filesystem>
+#include <fstream>
+#include <iostream>
+#include <vector>
+
+// The number of times each file is loaded each way
+const static int BENCH_REPEATS = 10;
+
+// The size of the generated source file, in MB
+const static int BENCH_GENERATED_MB = 64;
+
+// Reads the file line by line, as sources used to be read
+std::string read_lines(const std::string &path)
+{
+    std::ifstream file(path, std::ios::in | std::ios::ate);
+    fakeAssert(file.is_open());
+
+    long long size = file.tellg();
+    file.seekg(0, std::ios::beg);
+
+    std::string text, line;
+    text.reserve(size);
+    while (getline(file, line))
+    {
+        text.append(line);
+        text.push_back('\n');
+    }
+
+    return text;
+}
+
+// Reads every byte, so that mapped pages are really loaded
+unsigned long long touch(const std::string_view &text)
+{
+    unsigned long long out = 0;
+    for (const char &c : text)
+    {
+        out += (unsigned char)c;
+    }
+    return out;
+}
+
+// Loads every file with the given function, returning the time
+// taken in seconds
+template <typename F>
+double time_loads(const std::vector<std::string> &paths, F load)
+{
+    auto start = std::chrono::steady_clock::now();
+    for (int i = 0; i < BENCH_REPEATS; i++)
+    {
+        for (const auto &path : paths)
+        {
+            load(path);
+        }
+    }
+    auto end = std::chrono::steady_clock::now();
+
+    return std::chrono::duration<double>(end - start).count();
+}
+
+int main(int argc, char *argv[])
+{
+    std::vector<std::string> paths;
+    for (int i = 1; i < argc; i++)
+    {
+        paths.push_back(argv[i]);
+    }
+
+    const auto generated =
+        std::filesystem::temp_directory_path() /
+        "oak_bench_sources.oak";
+    if (paths.empty())
+    {
+        std::ofstream file(generated);
+        const std::string row =
+            "    0x12345678, 0x9abcdef0, 0x0fedcba9, 0x8765432,"
+            " // data\n";
+        for (size_t written = 0;
+             written < BENCH_GENERATED_MB * 1024 * 1024;
+             written += row.size())
+        {
+            file << row;
+        }
+        paths.push_back(generated.string());
+    }
+
+    double megabytes = 0.0;
+    for (const auto &path : paths)
+    {
+        megabytes += std::filesystem::file_size(path);
+    }
+    megabytes *= BENCH_REPEATS / (1024.0 * 1024.0);
+
+    // All ways must give the same text
+    unsigned long long expected = 0, cold = 0, cached = 0;
+
+    const double lines_s =
+        time_loads(paths, [&](const std::string &path)
+                   { expected += touch(read_lines(path)); });
+
+    // Changing the modification time forces a reload
+    const double cold_s = time_loads(
+        paths,
+        [&](const std::string &path)
+        {
+            std::filesystem::last_write_time(
+                path, std::filesystem::last_write_time(path) +
+                          std::chrono::seconds(1));
+            cold += touch(load_source(path));
+        });
+
+    const double cached_s =
+        time_loads(paths, [&](const std::string &path)
+                   { cached += touch(load_source(path)); });
+
+    fakeAssert(cold == expected);
+    fakeAssert(cached == expected);
+
+    std::cout << "Loaded " << paths.size() << " files, "
+              << megabytes / BENCH_REPEATS << " MB, "
+              << BENCH_REPEATS << " times\n"
+              << "by lines:        " << megabytes / lines_s
+              << " MB/s\n"
+              << "mapped:          " << megabytes / cold_s
+              << " MB/s\n"
+              << "mapped (cached): " << megabytes / cached_s
+              << " MB/s\n";
+
+    std::filesystem::remove(generated);
+
+    return 0;
+}
@@ -6,6 +6,7 @@ jdehmel@outlook.com
 */
 
 #include "../oakc_fns.hpp"
+#include "test.hpp"
 
 #warning "File is unimplemented!"
 
@@ -17,6 +18,43 @@ void testDoFile()
 {
 }
 
+/*
+void insertDefinitions(TokenList &lexed,
+                       AcornSettings &settings)
+*/
+void testInsertDefinitions()
+{
+    AcornSettings settings;
+    settings.preprocDefines["a!"] = "1 + b!";
+    settings.preprocDefines["b!"] = "2";
+
+    // Definitions within definitions are inserted too, and the
+    // same definition may be used several times
+    Lexer l;
+    TokenList lexed =
+        l.lex_list("x = a! * a!;\ny = line! + f!(z);\n");
+    insertDefinitions(lexed, settings);
+
+    const std::vector<std::string> expected = {
+        "x", "=", "1", "+", "2", "*", "1", "+", "2", ";",
+        "y", "=", "2", "+", "f!", "(", "z", ")", ";"};
+    fakeAssert(lexed.size() == expected.size());
+    fakeAssert(std::equal(lexed.begin(), lexed.end(),
+                          expected.begin()));
+    fakeAssert(settings.preprocDefines["line!"] == "2");
+
+    // Unknown definitions are errors, but macro calls are not
+    lexed = l.lex_list("x = c!;\n");
+    try
+    {
+        insertDefinitions(lexed, settings);
+        fakeAssert(false);
+    }
+    catch (sequencing_error &e)
+    {
+    }
+}
+
 void testMakePackage()
 {
 }
@@ -33,6 +71,7 @@ int main()
 {
     testGetDiskUsage();
     testDoFile();
+    testInsertDefinitions();
     testMakePackage();
     testPrintSyntaxError();
     testEnsureSyntax();
@@ -18,9 +18,7 @@ void generate(const std::list<std::string> &Files, const
 std::string &Output) ASTNode getAllocSequence(Type &type, const
 std::string &name, AcornSettings &settings, const std::string
 &num) ASTNode getFreeSequence(const std::string &name,
-AcornSettings &settings) std::list<std::pair<std::string,
-std::string>> restoreSymbolTable(MultiSymbolTable &backup,
-MultiSymbolTable &realTable)
+AcornSettings &settings)
 */
 void testMisc()
 {
@@ -40,17 +38,17 @@ void testMisc()
 }
 
 /*
-bool itCmp(const std::list<Token> &inside, const
-std::list<Token>::iterator &it, const int &offset, const Token
-&compareTo) noexcept bool itIsInRange(const std::list<Token>
-&inside, const std::list<Token>::iterator &it, const int
-&offset) noexcept Token itGet(const std::list<Token> &inside,
-const std::list<Token>::iterator &it, const int &offset)
+bool itCmp(const TokenList &inside, const
+TokenList::iterator &it, const int &offset, const Token
+&compareTo) noexcept bool itIsInRange(const TokenList
+&inside, const TokenList::iterator &it, const int
+&offset) noexcept Token itGet(const TokenList &inside,
+const TokenList::iterator &it, const int &offset)
 noexcept
 */
 void testIteratorOperations()
 {
-    std::list<Token> l = {Token("foo"), Token("bar"),
+    TokenList l = {Token("foo"), Token("bar"),
                           Token("foobar"), Token("fizz"),
                           Token("buzz")};
 
@@ -95,6 +93,26 @@ void testMacros()
 
     std::string results = callMacro("foo!", {"hi"}, s);
     fakeAssert(results == "hi");
+
+    // Repeated calls are memoized, unless marked impure
+    auto hits = s.macroMemoHits;
+    fakeAssert(callMacro("foo!", {"hi"}, s) == "hi");
+    fakeAssert(s.macroMemoHits == hits + 1);
+    fakeAssert(!s.impureMacroCalled);
+
+    std::string file = s.macroSourceFiles["foo!"];
+    s.file_tags[file]["impure_macros"] = "";
+    fakeAssert(callMacro("foo!", {"hi"}, s) == "hi");
+    fakeAssert(s.macroMemoHits == hits + 1);
+    fakeAssert(s.impureMacroCalled);
+
+    // Cache keys depend only on content
+    addMacro("bar!", contents, s);
+    addMacro("baz!", contents + " ", s);
+    fakeAssert(getMacroCacheKey("foo!", s) ==
+               getMacroCacheKey("bar!", s));
+    fakeAssert(getMacroCacheKey("foo!", s) !=
+               getMacroCacheKey("baz!", s));
 }
 
 /*
@@ -134,6 +152,47 @@ void testSystem()
     execute("rm foo.txt bar.txt");
 }
 
+/*
+void addScopedSymbol(const std::string &name, const
+MultiTableSymbol &symbol, AcornSettings &settings) size_t
+openSymbolScope(AcornSettings &settings)
+std::list<std::pair<std::string, std::string>>
+closeSymbolScope(const size_t &marker, AcornSettings &settings)
+*/
+void testSymbolScopes()
+{
+    AcornSettings s;
+    MultiTableSymbol i32Symb{ASTNode(), Type(atomic, "i32")};
+    MultiTableSymbol fooSymb{ASTNode(), Type(atomic, "foo")};
+
+    addScopedSymbol("a", i32Symb, s);
+    auto outer = openSymbolScope(s);
+
+    addScopedSymbol("b", fooSymb, s);
+    auto inner = openSymbolScope(s);
+
+    // Shadows `a` with the same type, and `b` with a new one
+    addScopedSymbol("a", i32Symb, s);
+    addScopedSymbol("b", i32Symb, s);
+    addScopedSymbol("c", fooSymb, s);
+
+    auto destructors = closeSymbolScope(inner, s);
+    fakeAssert(destructors.size() == 1);
+    fakeAssert(destructors.front().first == "c");
+    fakeAssert(s.table.count("c") == 0);
+    fakeAssert(s.table["a"].size() == 2);
+    fakeAssert(s.table["b"].size() == 1);
+
+    // `b` falls out of scope here, but the shadowing `a` still
+    // matches the original's type
+    destructors = closeSymbolScope(outer, s);
+    fakeAssert(destructors.size() == 1);
+    fakeAssert(destructors.front().second ==
+               "Del_FN_PTR_foo_MAPS_void(&b);");
+    fakeAssert(s.table.count("b") == 0);
+    fakeAssert(s.table["a"].size() == 2);
+}
+
 ////////////////////////////////////////////////////////////////
 // Main function
 
@@ -145,6 +204,7 @@ int main()
     testMacros();
     testMangler();
     testSystem();
+    testSymbolScopes();
 
     return 0;
 }
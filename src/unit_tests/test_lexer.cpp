@@ -7,6 +7,9 @@ jdehmel@outlook.com
 
 #include "../lexer.hpp"
 #include "test.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
 
 void assert_lex_match(const std::string &_inp,
                       const std::list<std::string> &_exp)
@@ -34,9 +37,383 @@ void test_lexer()
         {"let", "main", "(", ")", "->", "i32", "{", "0", "}"});
 }
 
+void test_token_files()
+{
+    Lexer l;
+
+    auto lexed = l.lex_list("a b", "foo.oak");
+    fakeAssert(lexed.front().file() == "foo.oak");
+    fakeAssert(lexed.front().file_id == lexed.back().file_id);
+    fakeAssert(lexed.front().file_id == intern_file("foo.oak"));
+    fakeAssert(intern_file("bar.oak") !=
+               intern_file("foo.oak"));
+
+    Token t("c");
+    fakeAssert(t.file() == "NULL");
+}
+
+void assert_tokens_equal(const TokenList &a, const TokenList &b)
+{
+    fakeAssert(a.size() == b.size());
+
+    auto i = a.begin();
+    auto j = b.begin();
+    for (; i != a.end() && j != b.end(); ++i, ++j)
+    {
+        fakeAssert(i->text == j->text);
+        fakeAssert(i->state == j->state);
+        fakeAssert(i->line == j->line);
+        fakeAssert(i->pos == j->pos);
+        fakeAssert(i->file_id == j->file_id);
+    }
+}
+
+// Asserts that the fused lexer agrees with the original passes
+// run over the plain DFA, in every supported scan mode
+void assert_lex_equivalent(const std::string &_inp)
+{
+    Lexer l;
+    const LexerScanMode old_mode = get_scan_mode();
+
+    fakeAssert(set_scan_mode(scan_none));
+    auto expected = l.lex_list_multipass(_inp, "fused.oak");
+
+    for (auto mode :
+         {scan_none, scan_scalar, scan_sse2, scan_avx2})
+    {
+        if (!set_scan_mode(mode))
+        {
+            continue;
+        }
+
+        assert_tokens_equal(l.lex_list(_inp, "fused.oak"),
+                            expected);
+        assert_tokens_equal(
+            l.lex_list_multipass(_inp, "fused.oak"), expected);
+    }
+
+    fakeAssert(set_scan_mode(old_mode));
+}
+
+void test_fused_lexer()
+{
+    assert_lex_equivalent("");
+    assert_lex_equivalent("a // c\nb /* c /* d */ */ e\n");
+    assert_lex_equivalent("# comment\nlet x: i32 = 5i32;\n");
+    assert_lex_equivalent("std::io::print(1.5 f64 + 2);\n");
+    assert_lex_equivalent(":: a :: :: b ::");
+    assert_lex_equivalent("\"a\" \"b\"\n'c' 'd' \"e\" 'f'");
+    assert_lex_equivalent("a << b >> c; x < y; z > w");
+    assert_lex_equivalent("let v: a<b<i32>> = f<i32>(a << 2);");
+    assert_lex_equivalent("a < b < c >> d >");
+    assert_lex_equivalent("a <");
+    assert_lex_equivalent("12 34 i128 5");
+
+    // Fast paths, and where they must stop
+    assert_lex_equivalent("a\n\n  \t  \n\t\tb \\ c\n \\\nd");
+    assert_lex_equivalent("\n\n// it's\na // x\\\nb\n");
+    assert_lex_equivalent("// $a\\ c\n");
+    assert_lex_equivalent("/* a\n b */ c /* d /* e */\n*/ f");
+    assert_lex_equivalent("/** g */ h */ i");
+    assert_lex_equivalent("/* it's\n x=*/ y */ z // w */\nv");
+    assert_lex_equivalent("/* $a*/ b */ c /*\\*/ d */ e */ f");
+    assert_lex_equivalent("'ab\\'c' \"g'h\\\"i\n\" \"j\\\nk\"");
+    assert_lex_equivalent("\"" + std::string(100, 'x') + "\n" +
+                          std::string(100, ' ') + "// " +
+                          std::string(100, 'y') + "\n*/");
+
+    for (const auto &entry :
+         std::filesystem::directory_iterator("../../std"))
+    {
+        if (entry.path().extension() != ".oak")
+        {
+            continue;
+        }
+
+        std::ifstream file(entry.path());
+        std::stringstream contents;
+        contents << file.rdbuf();
+        assert_lex_equivalent(contents.str());
+    }
+}
+
+// The lexer DFA as it was built at runtime, before being moved
+// to compile time. Its table was one byte too narrow, so had no
+// entry for byte 255.
+void build_runtime_dfa(LexerState dfa[number_states][UCHAR_MAX])
+{
+    const char *alpha = "abcdefghijklmnopqrstuvwxyz_"
+                        "ABCDEFGHIJKLMNOPQRSTUVWXYZ`";
+    const char *numer = "0123456789";
+    const char *oper = "!%&*=+|/~[]";
+    const char *singletons = "^@#(){};,?";
+    const char *whitespace = " \t\n";
+    const int number_chars = UCHAR_MAX;
+
+    for (int i = 0; i < number_states; i++)
+    {
+        // Set default to deliminator state
+        for (int j = 0; j < number_chars; j++)
+        {
+            dfa[i][j] = delim_state;
+        }
+    }
+
+    // Alphabetic stuff
+    for (const char *i = &alpha[0]; *i != '\0'; i++)
+    {
+        dfa[delim_state][(unsigned int)*i] = alpha_state;
+        dfa[numerical_state][(unsigned int)*i] =
+            numerical_state;
+        dfa[alpha_state][(unsigned int)*i] = alpha_state;
+        dfa[string_literal_state_single][(unsigned int)*i] =
+            string_literal_state_single;
+        dfa[string_literal_state_double][(unsigned int)*i] =
+            string_literal_state_double;
+        dfa[whitespace_state][(unsigned int)*i] = delim_state;
+    }
+
+    // Non-ascii alphabetic stuff
+    for (int i = 1; i < number_chars; i++)
+    {
+        if (i > 31 && i < 128)
+        {
+            continue;
+        }
+        else if (i == '\t' || i == '\n')
+        {
+            continue;
+        }
+
+        dfa[delim_state][i] = alpha_state;
+        dfa[numerical_state][i] = numerical_state;
+        dfa[alpha_state][i] = alpha_state;
+        dfa[string_literal_state_single][i] =
+            string_literal_state_single;
+        dfa[string_literal_state_double][i] =
+            string_literal_state_double;
+        dfa[whitespace_state][i] = delim_state;
+    }
+
+    // Numerical stuff
+    for (const char *i = &numer[0]; *i != '\0'; i++)
+    {
+        dfa[delim_state][(unsigned int)*i] = numerical_state;
+        dfa[numerical_state][(unsigned int)*i] =
+            numerical_state;
+        dfa[alpha_state][(unsigned int)*i] = alpha_state;
+        dfa[dot_state][(unsigned int)*i] = numerical_state;
+        dfa[string_literal_state_single][(unsigned int)*i] =
+            string_literal_state_single;
+        dfa[string_literal_state_double][(unsigned int)*i] =
+            string_literal_state_double;
+        dfa[dash_state][(unsigned int)*i] = numerical_state;
+    }
+
+    // Dot stuff
+    dfa[delim_state][(unsigned int)'.'] = dot_state;
+    dfa[numerical_state][(unsigned int)'.'] = numerical_state;
+    dfa[string_literal_state_single][(unsigned int)'.'] =
+        string_literal_state_single;
+    dfa[string_literal_state_double][(unsigned int)'.'] =
+        string_literal_state_double;
+
+    // Singleton stuff
+    for (const char *i = &singletons[0]; *i != '\0'; i++)
+    {
+        dfa[delim_state][(unsigned int)*i] = singleton_state;
+    }
+
+    // Square bracket stuff
+    dfa[delim_state][(unsigned int)'<'] =
+        open_square_bracket_state;
+    dfa[delim_state][(unsigned int)'>'] =
+        close_square_bracket_state;
+    dfa[open_square_bracket_state][(unsigned int)'='] =
+        operator_state;
+    dfa[close_square_bracket_state][(unsigned int)'='] =
+        operator_state;
+
+    // Dash stuff
+    dfa[delim_state][(unsigned int)'-'] = dash_state;
+    dfa[dash_state][(unsigned int)'-'] = dash_state;
+    dfa[dash_state][(unsigned int)'>'] = operator_state;
+
+    // Operator stuff
+    for (const char *i = &oper[0]; *i != '\0'; i++)
+    {
+        dfa[delim_state][(unsigned int)*i] = operator_state;
+        dfa[operator_state][(unsigned int)*i] = operator_state;
+        dfa[string_literal_state_single][(unsigned int)*i] =
+            string_literal_state_single;
+        dfa[string_literal_state_double][(unsigned int)*i] =
+            string_literal_state_double;
+        dfa[dash_state][(unsigned int)*i] = operator_state;
+    }
+    dfa[operator_state][(unsigned int)'['] = delim_state;
+
+    // String literal stuff
+    for (int i = 0; i < number_chars; i++)
+    {
+        dfa[string_literal_state_single][i] =
+            string_literal_state_single;
+        dfa[string_literal_state_double][i] =
+            string_literal_state_double;
+    }
+
+    dfa[delim_state][(unsigned int)'\''] =
+        string_literal_state_single;
+    dfa[delim_state][(unsigned int)'"'] =
+        string_literal_state_double;
+    dfa[delim_state][(unsigned int)':'] = colon_state;
+    dfa[string_literal_state_single][(unsigned int)'\''] =
+        delim_state;
+    dfa[string_literal_state_double][(unsigned int)'"'] =
+        delim_state;
+
+    for (int i = 1; i < number_states; i++)
+    {
+        if (i != string_literal_state_double)
+        {
+            dfa[(LexerState)i][(unsigned int)'\''] =
+                delim_state;
+        }
+        if (i != string_literal_state_single)
+        {
+            dfa[(LexerState)i][(unsigned int)'"'] = delim_state;
+        }
+    }
+
+    // Whitespace stuff
+    for (const char *i = &whitespace[0]; *i != '\0'; i++)
+    {
+        dfa[delim_state][(unsigned int)*i] = whitespace_state;
+        dfa[string_literal_state_single][(unsigned int)*i] =
+            string_literal_state_single;
+        dfa[string_literal_state_double][(unsigned int)*i] =
+            string_literal_state_double;
+    }
+
+    dfa[string_literal_state_single][(unsigned int)'\n'] =
+        delim_state;
+    dfa[string_literal_state_double][(unsigned int)'\n'] =
+        delim_state;
+
+    // Misc
+    dfa[alpha_state][(unsigned int)'!'] = alpha_state;
+
+    for (int i = 0; i < number_states; i++)
+    {
+        if (i == string_literal_state_single ||
+            i == string_literal_state_double ||
+            i == whitespace_state)
+        {
+            continue;
+        }
+
+        dfa[i][(unsigned int)'$'] = dollar_sign_state;
+    }
+    for (int i = 0; i < number_chars; i++)
+    {
+        dfa[dollar_sign_state][i] = dollar_sign_state;
+        dfa[colon_state][i] = delim_state;
+    }
+
+    dfa[dollar_sign_state][(unsigned int)' '] = delim_state;
+    dfa[dollar_sign_state][(unsigned int)'\t'] = delim_state;
+    dfa[dollar_sign_state][(unsigned int)'\n'] = delim_state;
+    dfa[colon_state][(unsigned int)':'] = colon_state;
+}
+
+void test_dfa_table()
+{
+    static LexerState expected[number_states][UCHAR_MAX];
+    build_runtime_dfa(expected);
+
+    for (int i = 0; i < number_states; i++)
+    {
+        for (int c = 0; c < UCHAR_MAX; c++)
+        {
+            fakeAssert(lexer_transition((LexerState)i, c) ==
+                       expected[i][c]);
+        }
+
+        // Byte 255 is non-ASCII like any other
+        fakeAssert(lexer_transition((LexerState)i, 255) ==
+                   expected[i][254]);
+    }
+}
+
+// Writes the given text to the given file
+void write_file(const std::string &path,
+                const std::string &text)
+{
+    std::ofstream file(path);
+    file << text;
+}
+
+void test_load_source()
+{
+    auto dir = std::filesystem::temp_directory_path() /
+               "oak_test_load_source";
+    std::filesystem::create_directories(dir);
+    const std::string a = (dir / "a.oak").string(),
+                      b = (dir / "b.oak").string(),
+                      c = (dir / "c.oak").string();
+
+    // Text is as if read by lines
+    write_file(a, "let a: i32;\n");
+    write_file(b, "let b: i32;");
+    write_file(c, "");
+    fakeAssert(load_source(a) == "let a: i32;\n");
+    fakeAssert(load_source(b) == "let b: i32;\n");
+    fakeAssert(load_source(c) == "");
+
+    // Loaded once per path, however it is named
+    const std::string same = (dir / "." / "a.oak").string();
+    fakeAssert(load_source(a).data() ==
+               load_source(same).data());
+
+    // Reloaded once changed
+    write_file(a, "let a: u64;\nlet d: i32;\n");
+    fakeAssert(load_source(a) == "let a: u64;\nlet d: i32;\n");
+
+    Lexer l;
+    l.file(a);
+    fakeAssert(l.single() == "let");
+
+    // Copies outlive their files being truncated, which would
+    // raise SIGBUS on reading a mapping
+    const std::string e = (dir / "e.oak").string();
+    write_file(e, "let e: i32;\n");
+    set_source_mapping(false);
+    const std::string_view copied = load_source(e);
+    set_source_mapping(true);
+    write_file(e, "");
+    fakeAssert(copied == "let e: i32;\n");
+    fakeAssert(load_source(e) == "");
+
+    bool threw = false;
+    try
+    {
+        load_source((dir / "missing.oak").string());
+    }
+    catch (std::runtime_error &e)
+    {
+        threw = true;
+    }
+    fakeAssert(threw);
+
+    std::filesystem::remove_all(dir);
+}
+
 int main()
 {
     test_lexer();
+    test_token_files();
+    test_fused_lexer();
+    test_load_source();
+    test_dfa_table();
 
     return 0;
 }
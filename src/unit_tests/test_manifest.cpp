@@ -0,0 +1,117 @@
+/*
+Unit testing for Oak.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "../oakc_fns.hpp"
+#include "test.hpp"
+#include <filesystem>
+#include <fstream>
+
+////////////////////////////////////////////////////////////////
+// Test cases
+
+/*
+void saveManifest(const std::string &Name, const BuildManifest
+&manifest)
+BuildManifest loadManifest(const std::string &Name)
+*/
+void testManifestRoundTrip()
+{
+    BuildManifest manifest;
+    manifest.key = getBuildKey({"main.oak", "-o", "main.out"});
+    manifest.inputs["with spaces.oak"] = {123, 456};
+    manifest.packages["std"] = "0.0.1";
+    manifest.cflags.insert("-lm");
+    manifest.sources[".oak_build/main_out.c"] = "abc";
+    manifest.outputs["main.out"] = 789;
+    manifest.link = "def";
+
+    saveManifest("main.out", manifest);
+    BuildManifest loaded = loadManifest("main.out");
+
+    fakeAssert(loaded.key == manifest.key);
+    fakeAssert(loaded.inputs == manifest.inputs);
+    fakeAssert(loaded.packages == manifest.packages);
+    fakeAssert(loaded.cflags == manifest.cflags);
+    fakeAssert(loaded.sources == manifest.sources);
+    fakeAssert(loaded.outputs == manifest.outputs);
+    fakeAssert(loaded.link == manifest.link);
+
+    // Differing arguments make for differing builds
+    fakeAssert(manifest.key !=
+               getBuildKey({"main.oak", "-o", "other.out"}));
+
+    // The number of jobs does not change the output
+    fakeAssert(manifest.key ==
+               getBuildKey({"main.oak", "-o", "main.out",
+                            "--jobs", "4"}));
+    fakeAssert(manifest.key ==
+               getBuildKey({"-j", "2", "main.oak", "-o",
+                            "main.out"}));
+
+    fakeAssert(loadManifest("nonexistant.out").key == "");
+}
+
+/*
+bool isUpToDate(const BuildManifest &manifest, const
+std::string &key)
+*/
+void testUpToDate()
+{
+    std::ofstream("input.oak") << "let main() -> i32 { 0 }\n";
+    std::ofstream("output.out") << "binary";
+
+    BuildManifest manifest;
+    manifest.key = "key";
+    manifest.inputs["input.oak"] = getFileStamp("input.oak");
+    addBuildOutput(manifest, "output.out");
+
+    fakeAssert(isUpToDate(manifest, "key"));
+    fakeAssert(!isUpToDate(manifest, "other key"));
+
+    // Volatile builds are never up to date
+    BuildManifest isVolatile = manifest;
+    isVolatile.key = "";
+    fakeAssert(!isUpToDate(isVolatile, ""));
+
+    // As are those which called impure macros
+    AcornSettings settings;
+    BuildManifest called = manifest;
+    addBuildInputs(called, {}, settings);
+    fakeAssert(called.key == "key");
+    settings.impureMacroCalled = true;
+    addBuildInputs(called, {}, settings);
+    fakeAssert(called.key == "");
+
+    // Changed inputs
+    std::ofstream("input.oak")
+        << "let main() -> i32 { 1234 }\n";
+    fakeAssert(!isUpToDate(manifest, "key"));
+    manifest.inputs["input.oak"] = getFileStamp("input.oak");
+    fakeAssert(isUpToDate(manifest, "key"));
+
+    // Missing outputs
+    fs::remove("output.out");
+    fakeAssert(!isOutputUnchanged(manifest, "output.out"));
+    fakeAssert(!isUpToDate(manifest, "key"));
+}
+
+////////////////////////////////////////////////////////////////
+
+int main()
+{
+    auto dir = fs::temp_directory_path() / "oak_test_manifest";
+    fs::create_directories(dir);
+    fs::current_path(dir);
+
+    testManifestRoundTrip();
+    testUpToDate();
+
+    fs::current_path(fs::temp_directory_path());
+    fs::remove_all(dir);
+
+    return 0;
+}
@@ -8,8 +8,8 @@ jdehmel@outlook.com
 #include "../oakc_fns.hpp"
 #include "test.hpp"
 
-static void assertEqual(const std::list<Token> &obs,
-                        const std::list<Token> &exp)
+static void assertEqual(const TokenList &obs,
+                        const TokenList &exp)
 {
     bool isEqual = true;
 
@@ -59,8 +59,8 @@ void test(const std::string &_inp, const std::string &_exp)
 {
     Lexer l;
 
-    std::list<Token> inp = l.lex_list(_inp);
-    std::list<Token> exp = l.lex_list(_exp);
+    TokenList inp = l.lex_list(_inp);
+    TokenList exp = l.lex_list(_exp);
 
     operatorSub(inp);
     assertEqual(inp, exp);
@@ -6,6 +6,7 @@ jdehmel@outlook.com
 */
 
 #include "../oakc_fns.hpp"
+#include "test.hpp"
 
 #warning "File is unimplemented!"
 
@@ -17,8 +18,64 @@ void test_reconstruct_and_save()
 {
 }
 
+// Adds a function of type `() -> ret` which calls `calls`,
+// defined in the file `from`.
+static void addFunction(AcornSettings &settings,
+                        const std::string &name,
+                        const std::string &ret,
+                        const std::string &calls,
+                        const std::string &from = "a.oak")
+{
+    MultiTableSymbol s;
+    s.sourceFilePath = from;
+    s.type = Type(function);
+    s.type.append(maps);
+    s.type.append(atomic, ret);
+
+    ASTNode call;
+    call.info = atom;
+    call.type = nullType;
+    call.raw = calls;
+
+    s.seq.info = code_scope;
+    s.seq.items.push_back(call);
+
+    settings.table[name].push_back(s);
+}
+
 void test_reconstruct()
 {
+    AcornSettings settings;
+    addFunction(settings, "main", "i32",
+                "used_FN_MAPS_void()");
+    addFunction(settings, "used", "void", "");
+    addFunction(settings, "unused", "void",
+                "used_FN_MAPS_void()");
+    addFunction(settings, "exported", "void",
+                "helper_FN_MAPS_void()", "b.oak");
+    addFunction(settings, "helper", "void", "", "b.oak");
+    settings.file_tags["b.oak"]["export"] = "";
+
+    // Only what main reaches is emitted when linking
+    std::stringstream linked;
+    reconstruct("a.out", settings, linked);
+    fakeAssert(linked.str().find("used_FN_MAPS_void(void)") !=
+               std::string::npos);
+    fakeAssert(linked.str().find("unused_FN") ==
+               std::string::npos);
+
+    // As is everything exported, even if main never calls it
+    fakeAssert(linked.str().find("exported_FN") !=
+               std::string::npos);
+    fakeAssert(linked.str().find("helper_FN") !=
+               std::string::npos);
+
+    // Anything may be called from elsewhere when not linking
+    settings.doLink = false;
+    std::stringstream unlinked;
+    reconstruct("a.out", settings, unlinked);
+    fakeAssert(unlinked.str().find("unused_FN") !=
+               std::string::npos);
 }
 
 void test_save()
@@ -43,5 +100,7 @@ void test_enum_to_c()
 
 int main()
 {
+    test_reconstruct();
+
     return 0;
 }
@@ -6,12 +6,13 @@ jdehmel@outlook.com
 */
 
 #include "../oakc_fns.hpp"
+#include "test.hpp"
 
 ////////////////////////////////////////////////////////////////
 // Utility functions
 
-static void assertEqual(const std::list<Token> &obs,
-                        const std::list<Token> &exp)
+static void assertEqual(const TokenList &obs,
+                        const TokenList &exp)
 {
     bool isEqual = true;
 
@@ -137,6 +138,98 @@ void testPairMatching()
                "$~ $<${$}$> $>v", "hi");
 }
 
+void testRuleIndex()
+{
+    Lexer l;
+    AcornSettings settings;
+
+    auto addRule = [&](const std::string &name,
+                       const std::string &inputPattern)
+    {
+        auto lexed = l.lex_list(inputPattern);
+        settings.rules[name].engineName = "sapling";
+        settings.rules[name].inputPattern.assign(lexed.begin(),
+                                                 lexed.end());
+        settings.activeRules.push_back(name);
+    };
+
+    addRule("a", "foo $<$*$>");
+    addRule("b", "$* bar");
+    addRule("c", "foo bar");
+    settings.activeRules.push_back("missing");
+
+    RuleIndex index;
+    buildRuleIndex(index, settings);
+
+    fakeAssert(index.names.size() == 3);
+    fakeAssert(index.wildcards.size() == 1);
+
+    // Rules must be visited in order, skipping ones which
+    // cannot begin at the given token
+    fakeAssert(getNextRule(index, "foo", -1) == 0);
+    fakeAssert(getNextRule(index, "foo", 0) == 1);
+    fakeAssert(getNextRule(index, "foo", 1) == 2);
+    fakeAssert(getNextRule(index, "foo", 2) == -1);
+    fakeAssert(getNextRule(index, "bar", -1) == 1);
+    fakeAssert(getNextRule(index, "bar", 1) == -1);
+}
+
+void testRuleMacroCalls()
+{
+    Lexer l;
+    AcornSettings settings;
+
+    auto lexed = l.lex_list("foo;");
+    settings.rules["a"].engineName = "sapling";
+    settings.rules["a"].inputPattern.assign(lexed.begin(),
+                                            lexed.end());
+    lexed = l.lex_list("link!(\"a.o\"); bar;");
+    settings.rules["a"].outputPattern.assign(lexed.begin(),
+                                             lexed.end());
+    settings.activeRules.push_back("a");
+
+    // Only compiler macros which the rules output are reported
+    auto text =
+        l.lex_list("link!(\"b.o\"); foo; bar; foo; baz;");
+    std::vector<TokenList::iterator> calls;
+    doRules(text, settings, &calls);
+
+    fakeAssert(calls.size() == 2);
+    for (const auto &call : calls)
+    {
+        fakeAssert(*call == "link!");
+        fakeAssert(call != text.begin());
+    }
+    fakeAssert(calls[0] != calls[1]);
+}
+
+void testRuleStats()
+{
+    Lexer l;
+    AcornSettings settings;
+
+    auto lexed = l.lex_list("foo;");
+    settings.rules["a"].engineName = "sapling";
+    settings.rules["a"].inputPattern.assign(lexed.begin(),
+                                            lexed.end());
+    lexed = l.lex_list("bar;");
+    settings.rules["a"].outputPattern.assign(lexed.begin(),
+                                             lexed.end());
+    settings.activeRules.push_back("a");
+
+    // Statistics are only kept in debug mode
+    auto text = l.lex_list("foo; baz; foo; baz;");
+    doRules(text, settings);
+    fakeAssert(settings.ruleStats.empty());
+
+    settings.debug = true;
+    text = l.lex_list("foo; baz; foo; baz;");
+    doRules(text, settings);
+    fakeAssert(settings.ruleStats.count("a") == 1);
+    fakeAssert(settings.ruleStats["a"].matches == 2);
+    fakeAssert(settings.ruleStats["a"].attempts >= 2);
+}
+
 ////////////////////////////////////////////////////////////////
 // Main function
 
@@ -150,6 +243,9 @@ int main()
     testSuits();
     testLookarounds();
     testPairMatching();
+    testRuleIndex();
+    testRuleMacroCalls();
+    testRuleStats();
 
     return 0;
 }
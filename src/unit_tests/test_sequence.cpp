@@ -17,7 +17,7 @@ void test_create_sequence()
     std::string expected = "void foo_FN_MAPS_void(void) { }";
 
     AcornSettings s;
-    std::list<Token> from = Lexer().lex_list(input);
+    TokenList from = Lexer().lex_list(input);
 
     ASTNode root = createSequence(from, s);
     std::string c = toC(root, s);
@@ -6,6 +6,7 @@ jdehmel@outlook.com
 */
 
 #include "../oakc_fns.hpp"
+#include "test.hpp"
 
 #warning "File is unimplemented!"
 
@@ -81,7 +82,134 @@ void test_insertDestructors()
 {
 }
 
+void test_get_atomic_operator_c()
+{
+    AcornSettings s;
+    Lexer l;
+    std::string out;
+
+    // Binary operators are cast back to the return type
+    MultiTableSymbol sym;
+    sym.sourceFilePath =
+        fs::weakly_canonical(ATOMIC_OPERATORS_FILE).string();
+    sym.type =
+        toType(l.lex_list("(self: u8, other: u8) -> u8"), s);
+    std::list<Type> argTypes = {Type(atomic, "u8"),
+                                Type(atomic, "u8")};
+    fakeAssert(getAtomicOperatorC("Add", sym, argTypes,
+                                  {"(a)", "(b)"}, out, s));
+    fakeAssert(out == "((u8)((a)+(b)))");
+
+    // Logical operators must not short circuit, since both
+    // arguments of a call are evaluated
+    sym.type = toType(
+        l.lex_list("(self: bool, other: bool) -> bool"), s);
+    argTypes = {Type(atomic, "bool"), Type(atomic, "bool")};
+    fakeAssert(getAtomicOperatorC("Andd", sym, argTypes,
+                                  {"(a)", "f()"}, out, s));
+    fakeAssert(out == "((bool)((a)&f()))");
+    fakeAssert(getAtomicOperatorC("Orr", sym, argTypes,
+                                  {"(a)", "f()"}, out, s));
+    fakeAssert(out == "((bool)((a)|f()))");
+
+    // Assignment operators use the referenced lvalue
+    sym.type = toType(
+        l.lex_list("(self: ^i32, other: i32) -> i32"), s);
+    argTypes = {Type(atomic, "i32"), Type(atomic, "i32")};
+    fakeAssert(getAtomicOperatorC("AddEq", sym, argTypes,
+                                  {"&(a)", "(b)"}, out, s));
+    fakeAssert(out == "((a)+=(b))");
+    fakeAssert(getAtomicOperatorC("Copy", sym, argTypes,
+                                  {"(p)", "(b)"}, out, s));
+    fakeAssert(out == "((*(p))=(b))");
+
+    // Unary operators
+    sym.type = toType(l.lex_list("(self: ^i32) -> i32"), s);
+    argTypes = {Type(atomic, "i32")};
+    fakeAssert(getAtomicOperatorC("Incr", sym, argTypes,
+                                  {"&(i)"}, out, s));
+    fakeAssert(out == "(++(i))");
+
+    // Not an operator
+    fakeAssert(!getAtomicOperatorC("foo", sym, argTypes,
+                                   {"&(i)"}, out, s));
+    fakeAssert(out == "");
+
+    // Non-atomic arguments must be called as normal
+    sym.type = toType(
+        l.lex_list("(self: str, other: str) -> bool"), s);
+    argTypes = {Type(atomic, "str"), Type(atomic, "str")};
+    fakeAssert(!getAtomicOperatorC("Eq", sym, argTypes,
+                                   {"(a)", "(b)"}, out, s));
+
+    // User declarations of the same name are called as normal
+    sym.type = toType(
+        l.lex_list("(self: ^i32, other: ^i32) -> bool"), s);
+    argTypes = {Type(atomic, "i32"), Type(atomic, "i32")};
+    sym.sourceFilePath = "/tmp/user_file.oak";
+    fakeAssert(!getAtomicOperatorC("Eq", sym, argTypes,
+                                   {"(a)", "(b)"}, out, s));
+    fakeAssert(out == "");
+
+    // Definitions with bodies must be called as normal
+    sym.sourceFilePath =
+        fs::weakly_canonical(ATOMIC_OPERATORS_FILE).string();
+    sym.type =
+        toType(l.lex_list("(self: u8, other: u8) -> u8"), s);
+    sym.seq.items.push_back(ASTNode{});
+    argTypes = {Type(atomic, "u8"), Type(atomic, "u8")};
+    fakeAssert(!getAtomicOperatorC("Add", sym, argTypes,
+                                   {"(a)", "(b)"}, out, s));
+}
+
+void test_get_overloads()
+{
+    AcornSettings s;
+    Lexer l;
+
+    for (std::string sig : {"(self: ^i32, other: i32) -> void",
+                            "(self: ^u8, other: u8) -> void",
+                            "(self: ^i32) -> void"})
+    {
+        MultiTableSymbol sym;
+        sym.type = toType(l.lex_list(sig), s);
+        s.table["Copy"].push_back(sym);
+    }
+
+    OverloadSet &overloads = getOverloads("Copy", s);
+    fakeAssert(overloads.symbols.size() == 3);
+    fakeAssert(overloads.byArity[2] ==
+               std::vector<int>({0, 1}));
+    fakeAssert(overloads.byArity[1] == std::vector<int>({2}));
+
+    // Only the candidates given are considered
+    std::list<Type> argTypes = {toType(l.lex_list("^u8"), s),
+                                Type(atomic, "u8")};
+    fakeAssert(
+        getExactCandidates(overloads.args, {0, 1}, argTypes) ==
+        std::list<int>({1}));
+    fakeAssert(getExactCandidates(overloads.args, {0}, argTypes)
+                   .empty());
+
+    // Additions are picked up without invalidation
+    MultiTableSymbol sym;
+    sym.type = toType(l.lex_list("() -> void"), s);
+    s.table["Copy"].push_back(sym);
+    fakeAssert(getOverloads("Copy", s).byArity[0] ==
+               std::vector<int>({3}));
+
+    // Anything else must be invalidated
+    s.table["Copy"].pop_back();
+    s.table["Copy"].pop_front();
+    s.table["Copy"].push_back(sym);
+    invalidateOverloads("Copy", s);
+    fakeAssert(getOverloads("Copy", s).byArity[0] ==
+               std::vector<int>({2}));
+}
+
 int main()
 {
+    test_get_atomic_operator_c();
+    test_get_overloads();
     return 0;
 }
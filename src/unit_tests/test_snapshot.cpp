@@ -0,0 +1,90 @@
+/*
+Unit testing for Oak.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "../oakc_fns.hpp"
+#include "test.hpp"
+#include <filesystem>
+
+////////////////////////////////////////////////////////////////
+// Test cases
+
+/*
+bool loadPackageSnapshot(const std::string &Name, AcornSettings
+&settings)
+*/
+void testRejectedSnapshots()
+{
+    AcornSettings settings;
+    fakeAssert(!loadPackageSnapshot("not_a_package", settings));
+
+    // A snapshot cannot apply once anything has been loaded
+    settings.table["foo"].push_back(MultiTableSymbol());
+    fakeAssert(!loadPackageSnapshot("std", settings));
+    fakeAssert(settings.table.size() == 1);
+}
+
+/*
+void loadPackage(const std::string &Name, AcornSettings
+&settings)
+*/
+void testSnapshotRoundTrip()
+{
+    if (!fs::exists("/usr/include/oak/std/std.oak"))
+    {
+        return;
+    }
+
+    AcornSettings processed, restored;
+    loadPackage("std", processed);
+
+    // Saving the snapshot requires write access to the package
+    if (!loadPackageSnapshot("std", restored))
+    {
+        return;
+    }
+
+    fakeAssert(restored.table.size() == processed.table.size());
+    for (const auto &p : processed.table)
+    {
+        fakeAssert(restored.table[p.first].size() ==
+                   p.second.size());
+    }
+
+    fakeAssert(restored.structOrder == processed.structOrder);
+    fakeAssert(restored.rules.size() == processed.rules.size());
+    fakeAssert(restored.macros == processed.macros);
+    fakeAssert(restored.objects == processed.objects);
+    fakeAssert(restored.generics.size() ==
+               processed.generics.size());
+    fakeAssert(restored.visitedFiles.size() ==
+               processed.visitedFiles.size());
+
+    // Types are rebuilt in this process, so must compare equal
+    for (const auto &p : processed.structData)
+    {
+        fakeAssert(restored.structData.count(p.first) != 0);
+        for (const auto &m : p.second.members)
+        {
+            fakeAssert(
+                restored.structData[p.first].members[m.first] ==
+                m.second);
+        }
+    }
+
+    // A second load of the same package is a no-op
+    fakeAssert(!loadPackageSnapshot("std", restored));
+}
+
+////////////////////////////////////////////////////////////////
+
+int main()
+{
+    testRejectedSnapshots();
+    testSnapshotRoundTrip();
+
+    return 0;
+}
@@ -0,0 +1,201 @@
+/*
+Unit testing for Oak.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "../oakc_fns.hpp"
+#include "test.hpp"
+#include <algorithm>
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+// Returns the contents of the given file.
+static std::string readFile(const std::string &path)
+{
+    std::ifstream file(path);
+    std::stringstream contents;
+    contents << file.rdbuf();
+    return contents.str();
+}
+
+////////////////////////////////////////////////////////////////
+// Test cases
+
+/*
+std::string toJsonString(const std::string &what)
+*/
+void testToJsonString()
+{
+    fakeAssert(toJsonString("") == "\"\"");
+    fakeAssert(toJsonString("a b") == "\"a b\"");
+    fakeAssert(toJsonString("\"q\"") == "\"\\\"q\\\"\"");
+    fakeAssert(toJsonString("a\\b") == "\"a\\\\b\"");
+    fakeAssert(toJsonString("a\nb") == "\"a\\u000ab\"");
+    fakeAssert(toJsonString("\t") == "\"\\u0009\"");
+}
+
+/*
+void saveTestReport(const std::vector<TestResult> &results,
+const unsigned long long &wallMs, const std::string &path)
+*/
+void testSaveTestReport()
+{
+    TestResult passed;
+    passed.file = "tests/a \"b\".oak";
+    passed.result = 0;
+    passed.wallMs = 12;
+    passed.cpuMs = 34;
+    passed.peakKb = 56;
+
+    TestResult skipped;
+    skipped.file = "tests/c.oak";
+    skipped.skipped = true;
+
+    saveTestReport({passed, skipped}, 789, "report.json");
+    const std::string report = readFile("report.json");
+
+    fakeAssert(report.find("\"wall_ms\": 789") !=
+               std::string::npos);
+    fakeAssert(
+        report.find("{\"file\": \"tests/a \\\"b\\\".oak\", "
+                    "\"result\": 0, \"skipped\": false, "
+                    "\"wall_ms\": 12, \"cpu_ms\": 34, "
+                    "\"peak_rss_kb\": 56}") !=
+        std::string::npos);
+    fakeAssert(report.find("\"file\": \"tests/c.oak\"") !=
+               std::string::npos);
+    fakeAssert(report.find("\"skipped\": true") !=
+               std::string::npos);
+
+    // An empty suite is still valid JSON
+    saveTestReport({}, 0, "report.json");
+    fakeAssert(readFile("report.json") ==
+               "{\n  \"wall_ms\": 0,\n  \"tests\": ["
+               "\n  ]\n}\n");
+}
+
+/*
+void saveTestLog(const std::vector<TestResult> &results, const
+std::string &path)
+*/
+void testSaveTestLog()
+{
+    std::ofstream("a.log") << "output of a\n";
+    std::ofstream("empty.log");
+
+    TestResult a, empty, skipped;
+    a.file = "a.oak";
+    a.log = "a.log";
+    empty.file = "empty.oak";
+    empty.log = "empty.log";
+    skipped.file = "skipped.oak";
+    skipped.skipped = true;
+
+    // Empty logs do not stop those after them
+    saveTestLog({empty, a, skipped}, "suite.log");
+    fakeAssert(readFile("suite.log") ==
+               "empty.oak\na.oak\noutput of a\nskipped.oak\n"
+               "(Skipped: Unchanged since last pass)\n");
+}
+
+/*
+std::vector<std::string> getTestArgs(const std::string &test,
+const size_t &workers, const AcornSettings &settings)
+*/
+void testGetTestArgs()
+{
+    AcornSettings settings;
+    settings.jobs = 8;
+
+    // Concurrent tests split the jobs between them
+    auto args = getTestArgs("a.oak", 4, settings);
+    fakeAssert(args.size() == 5);
+    fakeAssert(args[2] == "--jobs" && args[3] == "2");
+    fakeAssert(args.back() == fs::absolute("a.oak").string());
+
+    args = getTestArgs("a.oak", 1, settings);
+    fakeAssert(args[3] == "8");
+
+    // Each always gets at least one
+    args = getTestArgs("a.oak", 16, settings);
+    fakeAssert(args[3] == "1");
+
+    settings.execute = true;
+    args = getTestArgs("a.oak", 1, settings);
+    fakeAssert(std::find(args.begin(), args.end(),
+                         "--execute") != args.end());
+}
+
+/*
+bool isTestCurrent(const std::string &test, const
+std::vector<std::string> &args, const std::string &mode)
+*/
+void testIsTestCurrent()
+{
+    AcornSettings settings;
+    settings.jobs = 4;
+    std::ofstream("current.oak") << "let main() -> i32 { 0 }\n";
+    const auto args = getTestArgs("current.oak", 1, settings);
+    const std::string dir = getTestDir("current.oak");
+    fs::create_directories(dir);
+
+    // Never passed
+    fakeAssert(!isTestCurrent("current.oak", args, "compile"));
+
+    // Passed, and its build is up to date
+    std::ofstream(dir + "passed") << "compile\n";
+    const fs::path original = fs::current_path();
+    fs::current_path(dir);
+    BuildManifest manifest;
+    manifest.key = getBuildKey(args);
+    manifest.inputs[fs::absolute(original / "current.oak")] =
+        getFileStamp((original / "current.oak").string());
+    std::ofstream("a.out") << "binary\n";
+    addBuildOutput(manifest, "a.out");
+    saveManifest("a.out", manifest);
+    fs::current_path(original);
+    fakeAssert(isTestCurrent("current.oak", args, "compile"));
+
+    // The number of jobs does not matter
+    fakeAssert(isTestCurrent(
+        "current.oak", getTestArgs("current.oak", 4, settings),
+        "compile"));
+
+    // Passing in another mode does not count
+    fakeAssert(!isTestCurrent("current.oak", args, "execute"));
+
+    // Nor does passing with other arguments
+    settings.execute = true;
+    fakeAssert(!isTestCurrent(
+        "current.oak", getTestArgs("current.oak", 1, settings),
+        "compile"));
+
+    fs::remove_all(dir);
+}
+
+////////////////////////////////////////////////////////////////
+// Main function
+
+int main()
+{
+    const fs::path original = fs::current_path();
+    const fs::path dir =
+        fs::temp_directory_path() / "oak_test_suite_test";
+    fs::remove_all(dir);
+    fs::create_directories(dir);
+    fs::current_path(dir);
+
+    testToJsonString();
+    testSaveTestReport();
+    testSaveTestLog();
+    testGetTestArgs();
+    testIsTestCurrent();
+
+    fs::current_path(original);
+    fs::remove_all(dir);
+
+    return 0;
+}
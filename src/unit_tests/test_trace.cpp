@@ -0,0 +1,146 @@
+/*
+Unit testing for Oak.
+
+Jordan Dehmel, 2024
+jdehmel@outlook.com
+*/
+
+#include "../oakc_fns.hpp"
+#include "test.hpp"
+#include <filesystem>
+#include <fstream>
+#include <sstream>
+
+////////////////////////////////////////////////////////////////
+// Test cases
+
+/*
+void beginTrace(const std::string &name, const std::string
+&category, AcornSettings &settings)
+void endTrace(AcornSettings &settings)
+*/
+void testSpans()
+{
+    // Nothing is recorded unless tracing
+    AcornSettings off;
+    beginTrace("a", "phase", off);
+    endTrace(off);
+    {
+        TraceSpan span("b", "phase", off);
+    }
+    fakeAssert(off.traceEvents.empty());
+    fakeAssert(off.openTraces.empty());
+
+    AcornSettings settings;
+    settings.tracePath = "trace.json";
+
+    beginTrace("outer", "phase", settings);
+    beginTrace("inner", "phase", settings);
+    endTrace(settings);
+    endTrace(settings);
+
+    fakeAssert(settings.traceEvents.size() == 2);
+    const TraceEvent &inner = settings.traceEvents[0];
+    const TraceEvent &outer = settings.traceEvents[1];
+    fakeAssert(inner.name == "inner");
+    fakeAssert(outer.name == "outer");
+    fakeAssert(outer.start <= inner.start);
+    fakeAssert(inner.start + inner.duration <=
+               outer.start + outer.duration);
+
+    // Unwinding closes the spans opened within
+    try
+    {
+        TraceSpan span("file", "file", settings);
+        beginTrace("unclosed", "phase", settings);
+        throw std::runtime_error("error");
+    }
+    catch (std::runtime_error &e)
+    {
+    }
+
+    fakeAssert(settings.openTraces.empty());
+    fakeAssert(settings.traceEvents.size() == 4);
+    fakeAssert(settings.traceEvents[2].name == "unclosed");
+    fakeAssert(settings.traceEvents[3].name == "file");
+}
+
+/*
+void saveTrace(AcornSettings &settings)
+*/
+void testSaveTrace()
+{
+    AcornSettings settings;
+    settings.tracePath = "trace.json";
+
+    addTrace("clang \"a.c\"", "clang", 10, 25, 2, settings);
+    beginTrace("left open", "phase", settings);
+    saveTrace(settings);
+
+    std::ifstream file("trace.json");
+    std::stringstream contents;
+    contents << file.rdbuf();
+    const std::string text = contents.str();
+
+    fakeAssert(text.find("\"traceEvents\"") !=
+               std::string::npos);
+    fakeAssert(text.find("\"name\": \"clang \\\"a.c\\\"\"") !=
+               std::string::npos);
+    fakeAssert(text.find("\"ts\": 10, \"dur\": 15") !=
+               std::string::npos);
+    fakeAssert(text.find("\"tid\": 2") != std::string::npos);
+    fakeAssert(text.find("left open") != std::string::npos);
+}
+
+/*
+void reportMemory(const AcornSettings &settings)
+*/
+void testMemory()
+{
+    // Phases are measured without tracing
+    AcornSettings settings;
+    settings.memoryPath = "memory.json";
+
+    beginTrace("Lexing", "phase", settings);
+    endTrace(settings);
+    beginTrace("Lexing", "phase", settings);
+    beginTrace("main.oak", "file", settings);
+    endTrace(settings);
+    endTrace(settings);
+
+    fakeAssert(settings.traceEvents.empty());
+    fakeAssert(settings.phaseMemory.size() == 1);
+    fakeAssert(settings.phaseMemory["Lexing"].calls == 2);
+    fakeAssert(settings.phaseMemory["Lexing"].peakKb > 0);
+
+    ASTNode node;
+    node.items.push_back(ASTNode());
+    node.items.push_back(ASTNode());
+    node.items.back().items.push_back(ASTNode());
+    fakeAssert(countNodes(node) == 4);
+
+    reportMemory(settings);
+    std::ifstream file("memory.json");
+    std::stringstream contents;
+    contents << file.rdbuf();
+    fakeAssert(contents.str().find("\"name\": \"Lexing\"") !=
+               std::string::npos);
+}
+
+////////////////////////////////////////////////////////////////
+
+int main()
+{
+    auto dir = fs::temp_directory_path() / "oak_test_trace";
+    fs::create_directories(dir);
+    fs::current_path(dir);
+
+    testSpans();
+    testSaveTrace();
+    testMemory();
+
+    fs::current_path(fs::temp_directory_path());
+    fs::remove_all(dir);
+
+    return 0;
+}
@@ -73,5 +73,46 @@ int main()
     fakeAssert(checkLiteral("\"foobar foo\"") ==
                Type(atomic, "str"));
 
+    // Interned IDs are shared by structurally identical types
+    a = toType("(a: i32, b: f32) -> void");
+    b = toType("(a: i32, b: f32) -> void");
+    Type c = toType("(x: i32, y: f32) -> void");
+    fakeAssert(a.getID() == b.getID());
+    fakeAssert(a.getID() != c.getID());
+    fakeAssert(a.getStructuralID() == c.getStructuralID());
+    fakeAssert(a == c);
+
+    // Copies keep their ID, modifications do not
+    Type d = a;
+    fakeAssert(d.getID() == a.getID());
+    d.pop_back();
+    d.append(atomic, "i32");
+    fakeAssert(d.getID() != a.getID());
+    fakeAssert(d != a);
+    d.pop_back();
+    d.append(atomic, "void");
+    fakeAssert(d.getID() == a.getID());
+
+    // Replacing a node also gives a new ID
+    d.set(d.size() - 1, atomic, "i32");
+    fakeAssert(d[d.size() - 1].name == "i32");
+    fakeAssert(d.getID() != a.getID());
+    fakeAssert(d != a);
+
+    // Sized and unsized arrays match exactly
+    a = toType("[5]i32");
+    b = toType("[]i32");
+    fakeAssert(a != b);
+    fakeAssert(typesAreSameExact(&a, &b));
+
+    // Identical types share one stored copy
+    TypeRef e = toType("(a: i32, b: f32) -> void");
+    TypeRef f = toType("(a: i32, b: f32) -> void");
+    TypeRef g = toType("(x: i32, y: f32) -> void");
+    fakeAssert(&e.get() == &f.get());
+    fakeAssert(&e.get() != &g.get());
+    fakeAssert(e == g.get());
+    fakeAssert(TypeRef() == nullType);
+
     return 0;
 }
@@ -27,7 +27,8 @@ void now_FN_PTR_ns_MAPS_void(struct ns *self)
 
 i128 count_FN_PTR_ns_JOIN_PTR_ns_MAPS_i128(struct ns *start, struct ns *end)
 {
-    return end->raw.tv_nsec - start->raw.tv_nsec;
+    i128 sec = end->raw.tv_sec - start->raw.tv_sec;
+    return sec * 1000000000 + (end->raw.tv_nsec - start->raw.tv_nsec);
 }
 
 i64 time_FN_MAPS_i64(void)